@@ -0,0 +1,543 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <mpi.h>
+#include <omp.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "line_store.h"
+#include "max_kernel.h"
+#include "options.h"
+#include "output.h"
+#include "results_file.h"
+#include "partition.h"
+#include "distribute.h"
+#include "line_stats.h"
+#include "long_lines.h"
+#include "line_index.h"
+#include "instrument.h"
+#include "report.h"
+#include "trace.h"
+
+// Structure to hold memory usage information
+typedef struct {
+    uint32_t virtual_memory; // Virtual memory used by the process
+    uint32_t physical_memory; // Physical memory used by the process
+    uint32_t peak_memory; // Most physical memory the process ever used (VmHWM)
+} process_memory_t;
+
+/*
+ * find_max 
+ * Finds maximum ASCII value in lines, spreading them over the process's OpenMP threads
+ * @param start_line Starting index of lines for this process
+ * @param end_line Ending index of lines for this process
+ * @param store Pointer to the line store
+ * @param partition How the lines are cut into per-thread ranges
+ * @param local_max_values Pointer to local max values array
+ * @param long_line Lines longer than this are cut into pieces scanned as OpenMP tasks (SIZE_MAX for none)
+ */
+void find_max(int start_line, int end_line, const line_store_t* store, partition_mode_t partition, int* local_max_values, size_t long_line) 
+{
+    if (partition == PARTITION_BYTES) {
+        // One range of lines per thread, cut at equal byte counts
+        line_store_t view = *store; // The same lines, seen from start_line
+        view.offsets = store->offsets + start_line;
+        view.num_lines = end_line - start_line;
+
+        int threads_num = omp_get_max_threads();
+        int *bounds = (int *)malloc((threads_num + 1) * sizeof(int));
+        if (!bounds) {
+            fprintf(stderr, "Memory allocation failed for the line ranges.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        partition_lines(&view, threads_num, PARTITION_BYTES, bounds);
+
+        #pragma omp parallel for schedule(static, 1)
+        for (int t = 0; t < threads_num; t++) {
+            phase_mark_t mark;
+            instrument_start(&mark);
+            int64_t trace_start = trace_now();
+            for (int i = bounds[t]; i < bounds[t + 1]; i++) {
+                size_t length;
+                const char *line = line_store_line(&view, i, &length);
+                if (length <= long_line) {
+                    local_max_values[i] = line_max(line, length);
+                }
+            }
+            instrument_stop(&mark, 1 + omp_get_thread_num(), PHASE_COMPUTE,
+                            view.offsets[bounds[t + 1]] - view.offsets[bounds[t]]);
+            trace_event(1 + omp_get_thread_num(), "range", trace_start, "lines", (uint64_t)(bounds[t + 1] - bounds[t]));
+        }
+        free(bounds);
+    } else {
+        #pragma omp parallel
+        {
+            // Each thread times its own share of the loop for --report
+            phase_mark_t mark;
+            uint64_t bytes = 0;
+            uint64_t lines = 0;
+            instrument_start(&mark);
+            int64_t trace_start = trace_now();
+            #pragma omp for nowait
+            for (int i = start_line; i < end_line; i++) {
+                size_t length;
+                lines++;
+                const char *line = line_store_line(store, i, &length);
+                if (length <= long_line) {
+                    local_max_values[i - start_line] = line_max(line, length);
+                    bytes += length; // Long lines are counted by their pieces' tasks
+                }
+            }
+            instrument_stop(&mark, 1 + omp_get_thread_num(), PHASE_COMPUTE, bytes);
+            trace_event(1 + omp_get_thread_num(), "range", trace_start, "lines", lines);
+        }
+    }
+
+    if (long_line != SIZE_MAX) {
+        // One task per piece of this process's long lines, then the pieces are combined per line
+        long_lines_t long_plan;
+        if (long_lines_plan(store, start_line, end_line, long_line, &long_plan) != 0) {
+            fprintf(stderr, "Memory allocation failed for the long line pieces.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        #pragma omp parallel shared(long_plan)
+        #pragma omp single
+        for (int c = 0; c < long_plan.num_chunks; c++) {
+            #pragma omp task firstprivate(c) shared(long_plan)
+            {
+                phase_mark_t mark;
+                instrument_start(&mark);
+                int64_t trace_start = trace_now();
+                long_lines_scan(&long_plan, c, c + 1);
+                instrument_stop(&mark, 1 + omp_get_thread_num(), PHASE_COMPUTE, long_plan.chunks[c].length);
+                trace_event(1 + omp_get_thread_num(), "long line piece", trace_start, "bytes", long_plan.chunks[c].length);
+            }
+        }
+        int64_t trace_start = trace_now();
+        long_lines_combine(&long_plan, local_max_values, start_line);
+        trace_event(TRACE_MAIN, "combine", trace_start, "pieces", (uint64_t)long_plan.num_chunks);
+        long_lines_free(&long_plan);
+    }
+}
+
+/*
+ * get_process_memory
+ * Finds the amount of virtual and physical memory used during the system process, and the peak physical memory
+ * @param processMem Pointer to the process_memory_t structure
+ * 
+ * Referenced: /homes/dan/625/checkmem.c
+*/
+void get_process_memory(process_memory_t* processMem) 
+{
+    FILE *file = fopen("/proc/self/status", "r");
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "VmSize:", 7) == 0) {
+            sscanf(line + 7, "%u", &processMem->virtual_memory);
+        }
+        if (strncmp(line, "VmRSS:", 6) == 0) {
+            sscanf(line + 6, "%u", &processMem->physical_memory);
+        }
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            sscanf(line + 6, "%u", &processMem->peak_memory);
+        }
+    }
+    fclose(file);
+}
+
+/*
+ * print_results
+ * Writes "<line>: <max>" for every line: each thread formats its own slice
+ * of the results into a private buffer, then the buffers are written in order
+ * @param fd File descriptor to write to
+ * @param max_values Max value of each line
+ * @param total_lines Number of lines
+ * @param line_base File line number of the first result (--lines)
+ * @param threads_num Number of slices (one per thread)
+ * @return int 0 on success, -1 on failure
+ */
+int print_results(int fd, const int* max_values, int total_lines, int line_base, int threads_num)
+{
+    struct iovec *iov = (struct iovec *)calloc(threads_num, sizeof(struct iovec));
+    if (!iov) {
+        return -1;
+    }
+
+    int status = 0;
+    #pragma omp parallel for schedule(static, 1)
+    for (int t = 0; t < threads_num; t++) {
+        int first = (int)((long)total_lines * t / threads_num);
+        int last = (int)((long)total_lines * (t + 1) / threads_num);
+        size_t length = 0;
+        phase_mark_t mark;
+        instrument_start(&mark);
+        int64_t trace_start = trace_now();
+        iov[t].iov_base = results_format_alloc(max_values + first, line_base + first, last - first, &length);
+        iov[t].iov_len = length;
+        instrument_memory(MEMORY_RESULTS, (int64_t)length);
+        instrument_stop(&mark, 1 + omp_get_thread_num(), PHASE_FORMAT, length);
+        trace_event(1 + omp_get_thread_num(), "format", trace_start, "lines", (uint64_t)(last - first));
+        if (!iov[t].iov_base) {
+            #pragma omp atomic write
+            status = -1;
+        }
+    }
+
+    if (status == 0) {
+        phase_mark_t mark;
+        uint64_t bytes = 0;
+        for (int t = 0; t < threads_num; t++) {
+            bytes += iov[t].iov_len;
+        }
+        instrument_start(&mark);
+        int64_t trace_start = trace_now();
+        status = results_write(fd, iov, threads_num);
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_WRITE, bytes);
+        trace_event(TRACE_MAIN, "write", trace_start, "bytes", bytes);
+    }
+    for (int t = 0; t < threads_num; t++) {
+        instrument_memory(MEMORY_RESULTS, -(int64_t)iov[t].iov_len);
+        free(iov[t].iov_base);
+    }
+    free(iov);
+    return status;
+}
+
+/*
+ * main 
+ * Entry point of the program. Meant to run one MPI process per node (or per
+ * socket) with OpenMP threads on that node's cores, so each node holds one
+ * copy of its lines and rank 0 gathers from one process per node.
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return int Exit status
+ */
+int main(int argc, char *argv[]) 
+{
+    int rank, num_procs, provided;
+    // Initialize the MPI environment, only the main thread of each process calls MPI
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    // Get the rank of the process in the global communicator
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    // Get the number of processes in the global communicator
+    MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+
+    if (provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: The MPI library does not support MPI_THREAD_FUNNELED.\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Ensure the correct number of command-line arguments are passed
+    if (argc < 4) {
+        if (rank == 0) {
+            printf("Usage: %s <filename> <max_lines> <threads_per_process> [options]\n%s", argv[0], OPTIONS_USAGE);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    run_options_t options;
+    if (parse_options(argc, argv, 4, &options) != 0 || max_kernel_select(options.kernel, options.semantics) != 0) {
+        if (rank == 0) {
+            printf("Usage: %s <filename> <max_lines> <threads_per_process> [options]\n%s", argv[0], OPTIONS_USAGE);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (options.stream || options.fused || options.stats != STAT_MAX || (options.dist != DIST_BCAST && options.dist != DIST_SCATTER)) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: The hybrid program supports --dist bcast and scatter only, without --fused, --stream or --stats.\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (options.schedule == SCHEDULE_DYNAMIC || options.waves != 0) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: %s is only supported by the MPI program.\n", options.waves != 0 ? "--waves" : "--schedule dynamic");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (options.pin) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: --pin is only supported by the Pthreads program.\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (options.grain != 0) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: --grain is only supported by the Pthreads and MPI programs.\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (options.long_lines > 0) {
+        line_store_set_max_length(0); // Keep lines whole, the long ones are split into tasks instead
+    }
+
+    char *filename = argv[1]; // Input filename from command line
+    int max_lines = atoi(argv[2]); // Maximum number of lines to read from command line
+    int line_count = options_line_count(&options, max_lines); // Lines to load from --lines on
+    int threads_num = atoi(argv[3]); // Number of OpenMP threads per process (0 for the OpenMP default)
+
+    if (threads_num > 0) {
+        omp_set_num_threads(threads_num);
+    }
+    threads_num = omp_get_max_threads();
+
+    // Results go to standard output unless --output names a file (written by the root)
+    int out_fd = -1;
+    if (rank == 0) {
+        out_fd = results_open(options.output);
+        if (out_fd < 0) {
+            fprintf(stderr, "ERROR: Could not open output file.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+
+    int total_lines = 0;
+    line_store_t store; // Packed lines of the input file (only this process's share with --dist scatter)
+    int *max_values = NULL;
+
+    struct timeval start_time, end_time; // Variables for timing
+    struct rusage usage_start, usage_end; // Variables for resource usage
+
+    int local_count = 0; // Number of lines handled by this process
+    int first_line = 0; // Index of this process's first line
+    int *local_max_values = NULL; // Local array for storing max values found by this process
+
+    if (options.report && instrument_init(threads_num + 1) != 0) {
+        fprintf(stderr, "Memory allocation failed for the report.\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (options.counters) {
+        instrument_counters_init(); // Without counters the report keeps its timings (a warning says why)
+    }
+    if (options.trace && trace_init(threads_num + 1) != 0) {
+        fprintf(stderr, "Memory allocation failed for the trace.\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    phase_mark_t mark; // Start of the phase being timed for --report
+    instrument_start(&mark);
+    int64_t trace_start = trace_now(); // Start of the span being traced for --trace
+
+    if (options.dist == DIST_SCATTER) {
+        line_store_t full; // Whole input, on the root only
+        if (rank == 0) {
+            // Read the lines into one packed buffer
+            if (line_store_load(&full, filename, options.index, 0, options.line_first, line_count) != 0) {
+                fprintf(stderr, "ERROR: Could not open input file.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, full.data_size);
+            trace_event(TRACE_MAIN, "read", trace_start, "bytes", full.data_size);
+            instrument_memory(MEMORY_STORE, (int64_t)line_store_bytes(&full));
+        }
+        // Send every process only the lines it owns
+        instrument_start(&mark);
+        TRACE_CALL(TRACE_MAIN, "scatter_store", scatter_store(&full, rank, num_procs, options.partition, &store, &first_line));
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_DISTRIBUTE, store.data_size);
+        if (rank == 0) {
+            total_lines = full.num_lines;
+            instrument_memory(MEMORY_STORE, -(int64_t)line_store_bytes(&full));
+            line_store_free(&full);
+        }
+    } else if (options.use_mmap) {
+        // Every process maps the file itself, so no lines are broadcast
+        if (line_store_load(&store, filename, options.index, 1, options.line_first, line_count) != 0) {
+            fprintf(stderr, "ERROR: Could not open input file.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, store.data_size);
+        trace_event(TRACE_MAIN, "read", trace_start, "bytes", store.data_size);
+    } else {
+        if (rank == 0) { // Code to execute by the root process only
+            // Read the lines into one packed buffer
+            if (line_store_load(&store, filename, options.index, 0, options.line_first, line_count) != 0) {
+                fprintf(stderr, "ERROR: Could not open input file.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, store.data_size);
+            trace_event(TRACE_MAIN, "read", trace_start, "bytes", store.data_size);
+        }
+        // Broadcast the packed buffer and its offsets to all processes
+        instrument_start(&mark);
+        TRACE_CALL(TRACE_MAIN, "broadcast_store", broadcast_store(&store, rank));
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_DISTRIBUTE, store.data_size);
+    }
+    instrument_memory(MEMORY_STORE, (int64_t)line_store_bytes(&store));
+    if (options.dist != DIST_SCATTER) {
+        total_lines = store.num_lines;
+    }
+
+    if (rank == 0) {
+        // Allocate memory for max_values
+        max_values = (int *)malloc((total_lines > 0 ? total_lines : 1) * sizeof(int));
+        if (!max_values) {
+            fprintf(stderr, "Memory allocation failed for max_values.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        instrument_memory(MEMORY_RESULTS, (int64_t)total_lines * (int64_t)sizeof(int));
+
+        // Start timing and resource usage tracking
+        gettimeofday(&start_time, NULL);
+        getrusage(RUSAGE_SELF, &usage_start);
+    }
+
+    // Calculate which lines this process will handle
+    int start_line = 0;
+    int end_line = store.num_lines; // The local store holds exactly this process's lines with --dist scatter
+    if (options.dist != DIST_SCATTER) {
+        int *bounds = (int *)malloc((num_procs + 1) * sizeof(int));
+        if (!bounds) {
+            fprintf(stderr, "Memory allocation failed for the line ranges.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        partition_lines(&store, num_procs, options.partition, bounds);
+        start_line = bounds[rank];
+        end_line = bounds[rank + 1];
+        first_line = start_line;
+        free(bounds);
+    }
+    local_count = end_line - start_line;
+
+    local_max_values = (int *)malloc((local_count > 0 ? local_count : 1) * sizeof(int));
+    if (!local_max_values) {
+        fprintf(stderr, "Memory allocation failed for local_max_values.\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    instrument_memory(MEMORY_MPI, (int64_t)local_count * (int64_t)sizeof(int)); // Only exists to be gathered at the root
+    // The threads work on the local lines, MPI is only called again once they have joined
+    trace_start = trace_now();
+    find_max(start_line, end_line, &store, options.partition, local_max_values,
+             options.long_lines > 0 ? options.long_lines : SIZE_MAX);
+    trace_event(TRACE_MAIN, "compute", trace_start, "lines", (uint64_t)local_count);
+
+    int *recvcounts = NULL;
+    int *displs = NULL;
+
+    if (rank == 0) {
+        recvcounts = malloc(num_procs * sizeof(int));
+        displs = malloc(num_procs * sizeof(int));
+    }
+
+    // Every process reports how many lines it has and where they start
+    instrument_start(&mark);
+    TRACE_CALL(TRACE_MAIN, "MPI_Gather", MPI_Gather(&local_count, 1, MPI_INT, recvcounts, 1, MPI_INT, 0, MPI_COMM_WORLD));
+    TRACE_CALL(TRACE_MAIN, "MPI_Gather", MPI_Gather(&first_line, 1, MPI_INT, displs, 1, MPI_INT, 0, MPI_COMM_WORLD));
+
+    // Gather all max values found by all processes at the root process
+    TRACE_CALL(TRACE_MAIN, "MPI_Gatherv", MPI_Gatherv(local_max_values, local_count, MPI_INT, max_values, recvcounts, displs, MPI_INT, 0, MPI_COMM_WORLD));
+
+    if (rank == 0) {
+        free(recvcounts);
+        free(displs);
+    }
+    instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_GATHER, (uint64_t)local_count * sizeof(int));
+
+    if (rank == 0) {
+        // Stop timing and resource usage tracking
+        gettimeofday(&end_time, NULL);
+        getrusage(RUSAGE_SELF, &usage_end);
+
+        // Calculate and print performance metrics
+        long seconds = end_time.tv_sec - start_time.tv_sec;
+        long micros = end_time.tv_usec - start_time.tv_usec;
+
+        // Normalize the microseconds
+        if (micros < 0) {
+            micros += 1000000;  // adjust by one second
+            seconds -= 1;
+        }
+
+        long total_micros = seconds * 1000000 + micros;
+
+        // Calculate user and system CPU time used
+        long user_seconds = usage_end.ru_utime.tv_sec - usage_start.ru_utime.tv_sec;
+        long user_microseconds = usage_end.ru_utime.tv_usec - usage_start.ru_utime.tv_usec;
+
+        // Normalize user CPU time
+        if (user_microseconds < 0) {
+            user_microseconds += 1000000;
+            user_seconds -= 1;
+        }
+
+        long system_seconds = usage_end.ru_stime.tv_sec - usage_start.ru_stime.tv_sec;
+        long system_microseconds = usage_end.ru_stime.tv_usec - usage_start.ru_stime.tv_usec;
+
+        // Normalize system CPU time
+        if (system_microseconds < 0) {
+            system_microseconds += 1000000;
+            system_seconds -= 1;
+        }
+
+        process_memory_t myMem;
+        get_process_memory(&myMem);
+
+        // Print results (binary formats are a header and one value per line or per run)
+        int status;
+        if (options.format == FORMAT_TEXT) {
+            status = print_results(out_fd, max_values, total_lines, options.line_first, threads_num);
+        } else {
+            instrument_start(&mark); // Encoding and writing, as one step
+            trace_start = trace_now();
+            status = results_file_write(out_fd, max_values, total_lines, options.format == FORMAT_RLE);
+            instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_WRITE, (uint64_t)total_lines * sizeof(int));
+            trace_event(TRACE_MAIN, "write", trace_start, "lines", (uint64_t)total_lines);
+        }
+        if (status != 0) {
+            fprintf(stderr, "ERROR: Could not write the results.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        // Output performance metrics
+        printf("\n");
+        printf("Total runtime: %ld microseconds\n", total_micros);
+        printf("User CPU time used: %ld seconds, %ld microseconds\n", user_seconds, user_microseconds);
+        printf("System CPU time used: %ld seconds, %ld microseconds\n", system_seconds, system_microseconds);
+        printf("Virtual memory used: %u KB\n", myMem.virtual_memory);
+        printf("Physical memory used: %u KB\n", myMem.physical_memory);
+        printf("Peak physical memory used: %u KB\n", myMem.peak_memory);
+        printf("Total threads used: %d processes x %d threads\n", num_procs, threads_num);
+        printf("\n");
+    }
+
+    if (options.report) {
+        // Every process sends its phases to the root, which writes the report
+        if (report_gather_write(options.report, "hybrid", rank, num_procs) != 0) {
+            fprintf(stderr, "ERROR: Could not write the report.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        instrument_free();
+    }
+    if (options.trace) {
+        // Every process sends its events to the root, which writes one timeline with a track per rank
+        if (trace_gather_write(options.trace, "hybrid", rank, num_procs) != 0) {
+            fprintf(stderr, "ERROR: Could not write the trace.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        trace_free();
+    }
+
+    // Free allocated memory
+    free(local_max_values);
+    line_store_free(&store);
+    if (rank == 0) {
+        free(max_values);
+        if (options.output) {
+            close(out_fd); // Close the results file
+        }
+    }
+
+    // Clean up MPI environment
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef DISTRIBUTE_H__
+#define DISTRIBUTE_H__
+
+#include <mpi.h>
+#include "line_store.h"
+#include "options.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Function prototype to send the root's whole line store to every process
+void broadcast_store(line_store_t* store, int rank);
+
+// Function prototype to send each process only the lines it owns
+void scatter_store(const line_store_t* store, int rank, int num_procs, partition_mode_t partition, line_store_t* local, int* first_line);
+
+// Function prototype to allocate memory shared by the processes of one node, owned by the node's first process
+void* shared_alloc(size_t size, MPI_Comm node_comm, MPI_Win* win);
+
+// Function prototype to copy the node leader's line store into a segment every process on the node reads in place
+void share_store(const line_store_t* store, MPI_Comm node_comm, line_store_t* shared, MPI_Win* win);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
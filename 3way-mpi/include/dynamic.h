@@ -0,0 +1,17 @@
+#ifndef DYNAMIC_H__
+#define DYNAMIC_H__
+
+#include "line_store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Function prototype to process the lines in chunks taken from a shared counter, putting the results on the root
+int dynamic_find_max(const line_store_t* store, int grain, int rank, int* max_values, int* local_max_values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef MPI_IO_H__
+#define MPI_IO_H__
+
+#include "line_store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Function prototype to read this rank's share of the input with MPI-IO
+int mpiio_read_range(const char* filename, int max_lines, int rank, int num_procs, line_store_t* local);
+
+// Function prototype to write every process's results to one file with a collective write
+int mpiio_write_results(const char* path, const int* values, int first_line, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef PIPELINE_H__
+#define PIPELINE_H__
+
+#include "line_store.h"
+#include "options.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEFAULT_WAVES 8 // Default number of waves the input is sent in
+
+// Function prototype to scatter, scan and gather the root's lines in overlapping waves
+void pipeline_find_max(const line_store_t* store, int rank, int num_procs, int num_waves, partition_mode_t partition, int* max_values);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
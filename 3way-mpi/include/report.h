@@ -0,0 +1,18 @@
+#ifndef REPORT_H__
+#define REPORT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Function prototype to gather every process's instrument records on the root and write them as one JSON report
+int report_gather_write(const char* path, const char* program, int rank, int num_procs);
+
+// Function prototype to gather every process's trace events on the root and write them as one timeline
+int trace_gather_write(const char* path, const char* program, int rank, int num_procs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
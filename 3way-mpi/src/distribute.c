@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <mpi.h>
+#include "distribute.h"
+#include "partition.h"
+
+/*
+ * broadcast_store
+ * Sends the root's line store to every process as one offsets array and one
+ * packed data buffer, instead of one MAX_LINE_LENGTH broadcast per line
+ * @param store Pointer to the line store (filled on the root, received elsewhere)
+ * @param rank Rank of this process
+ */
+void broadcast_store(line_store_t* store, int rank)
+{
+    uint64_t sizes[2]; // Line count and data size
+    if (rank == 0) {
+        sizes[0] = (uint64_t)store->num_lines;
+        sizes[1] = (uint64_t)store->data_size;
+    }
+    MPI_Bcast(sizes, 2, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    if (rank != 0) {
+        memset(store, 0, sizeof(*store));
+        store->num_lines = (int)sizes[0];
+        store->data_size = (size_t)sizes[1];
+        store->offsets = (uint64_t *)malloc((sizes[0] + 1) * sizeof(uint64_t));
+        store->data = (const char *)malloc(sizes[1] > 0 ? sizes[1] : 1);
+        if (!store->offsets || !store->data) {
+            fprintf(stderr, "Memory allocation failed for the line store.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    MPI_Bcast(store->offsets, store->num_lines + 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    // MPI counts are ints, so send the data in pieces of at most INT_MAX bytes
+    char *data = (char *)store->data;
+    for (size_t sent = 0; sent < store->data_size; ) {
+        size_t remaining = store->data_size - sent;
+        int count = remaining > INT_MAX ? INT_MAX : (int)remaining;
+        MPI_Bcast(data + sent, count, MPI_CHAR, 0, MPI_COMM_WORLD);
+        sent += (size_t)count;
+    }
+}
+
+/*
+ * scatter_store
+ * Splits the root's line store into one contiguous slice per process and
+ * sends each process only its slice: the line counts with MPI_Scatter, then
+ * the offsets and the packed bytes with one MPI_Scatterv each. Slices too
+ * large for int counts are sent point to point in INT_MAX pieces instead.
+ * @param store Pointer to the full line store (used on the root only)
+ * @param rank Rank of this process
+ * @param num_procs Number of processes
+ * @param partition How the lines are cut into per-process ranges
+ * @param local Pointer to the line store to fill with this process's lines
+ * @param first_line Set to the index of this process's first line
+ */
+void scatter_store(const line_store_t* store, int rank, int num_procs, partition_mode_t partition, line_store_t* local, int* first_line)
+{
+    uint64_t* slices = NULL; // Per process: first line, line count, first byte, byte count
+    int* line_counts = NULL;
+    int* line_displs = NULL;
+    int fits = 1; // Whether every byte count and displacement fits in an int
+
+    if (rank == 0) {
+        slices = (uint64_t *)malloc(num_procs * 4 * sizeof(uint64_t));
+        line_counts = (int *)malloc(num_procs * sizeof(int));
+        line_displs = (int *)malloc(num_procs * sizeof(int));
+        if (!slices || !line_counts || !line_displs) {
+            fprintf(stderr, "Memory allocation failed for the scatter tables.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        int* bounds = (int *)malloc((num_procs + 1) * sizeof(int));
+        if (!bounds) {
+            fprintf(stderr, "Memory allocation failed for the scatter tables.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        partition_lines(store, num_procs, partition, bounds);
+        for (int r = 0; r < num_procs; r++) {
+            int start_line = bounds[r];
+            int count = bounds[r + 1] - bounds[r];
+            slices[4 * r] = (uint64_t)start_line;
+            slices[4 * r + 1] = (uint64_t)count;
+            slices[4 * r + 2] = store->offsets[start_line];
+            slices[4 * r + 3] = store->offsets[start_line + count] - store->offsets[start_line];
+            line_counts[r] = count;
+            line_displs[r] = start_line;
+            if (slices[4 * r + 2] + slices[4 * r + 3] > INT_MAX) {
+                fits = 0;
+            }
+        }
+        free(bounds);
+    }
+
+    uint64_t slice[4];
+    MPI_Scatter(slices, 4, MPI_UINT64_T, slice, 4, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&fits, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    memset(local, 0, sizeof(*local));
+    local->num_lines = (int)slice[1];
+    local->data_size = (size_t)slice[3];
+    local->offsets = (uint64_t *)malloc((slice[1] + 1) * sizeof(uint64_t));
+    local->data = (const char *)malloc(slice[3] > 0 ? slice[3] : 1);
+    if (!local->offsets || !local->data) {
+        fprintf(stderr, "Memory allocation failed for the local line store.\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    *first_line = (int)slice[0];
+
+    // Offsets of this process's lines, rebased below to its own buffer
+    MPI_Scatterv(rank == 0 ? store->offsets : NULL, line_counts, line_displs, MPI_UINT64_T,
+                 local->offsets, local->num_lines, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    for (int i = 0; i < local->num_lines; i++) {
+        local->offsets[i] -= slice[2];
+    }
+    local->offsets[local->num_lines] = slice[3];
+
+    char* data = (char *)local->data;
+    if (fits) {
+        int* byte_counts = NULL;
+        int* byte_displs = NULL;
+        if (rank == 0) {
+            byte_counts = line_counts; // Reuse the tables, the line counts are no longer needed
+            byte_displs = line_displs;
+            for (int r = 0; r < num_procs; r++) {
+                byte_counts[r] = (int)slices[4 * r + 3];
+                byte_displs[r] = (int)slices[4 * r + 2];
+            }
+        }
+        MPI_Scatterv(rank == 0 ? store->data : NULL, byte_counts, byte_displs, MPI_CHAR,
+                     data, (int)slice[3], MPI_CHAR, 0, MPI_COMM_WORLD);
+    } else if (rank == 0) {
+        memcpy(data, store->data + slice[2], (size_t)slice[3]);
+        for (int r = 1; r < num_procs; r++) {
+            for (uint64_t sent = 0; sent < slices[4 * r + 3]; ) {
+                uint64_t remaining = slices[4 * r + 3] - sent;
+                int count = remaining > INT_MAX ? INT_MAX : (int)remaining;
+                MPI_Send(store->data + slices[4 * r + 2] + sent, count, MPI_CHAR, r, 0, MPI_COMM_WORLD);
+                sent += (uint64_t)count;
+            }
+        }
+    } else {
+        for (uint64_t received = 0; received < slice[3]; ) {
+            uint64_t remaining = slice[3] - received;
+            int count = remaining > INT_MAX ? INT_MAX : (int)remaining;
+            MPI_Recv(data + received, count, MPI_CHAR, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            received += (uint64_t)count;
+        }
+    }
+
+    free(slices);
+    free(line_counts);
+    free(line_displs);
+}
+
+/*
+ * shared_alloc
+ * Allocates an MPI shared memory window in which the node's first process
+ * owns all the memory, and returns every process's pointer to its start
+ * @param size Number of bytes
+ * @param node_comm Communicator of the processes on this node
+ * @param win Set to the window, released with MPI_Win_free
+ * @return void* Start of the shared memory, in this process's address space
+ */
+void* shared_alloc(size_t size, MPI_Comm node_comm, MPI_Win* win)
+{
+    int node_rank;
+    MPI_Comm_rank(node_comm, &node_rank);
+
+    void* base = NULL;
+    MPI_Aint local_size = node_rank == 0 ? (MPI_Aint)(size > 0 ? size : 1) : 0;
+    MPI_Win_allocate_shared(local_size, 1, MPI_INFO_NULL, node_comm, &base, win);
+
+    MPI_Aint segment_size;
+    int disp_unit;
+    MPI_Win_shared_query(*win, 0, &segment_size, &disp_unit, &base);
+    return base;
+}
+
+/*
+ * share_store
+ * Copies the node leader's line store into one shared segment (offsets first,
+ * then the packed bytes) and points every process's store at it, so a node
+ * holds one copy of the lines however many processes it runs
+ * @param store Pointer to the line store (used on the node leader only)
+ * @param node_comm Communicator of the processes on this node
+ * @param shared Pointer to the line store to point at the segment (must not be passed to line_store_free)
+ * @param win Set to the segment's window, released with MPI_Win_free
+ */
+void share_store(const line_store_t* store, MPI_Comm node_comm, line_store_t* shared, MPI_Win* win)
+{
+    int node_rank;
+    MPI_Comm_rank(node_comm, &node_rank);
+
+    uint64_t sizes[2]; // Line count and data size
+    if (node_rank == 0) {
+        sizes[0] = (uint64_t)store->num_lines;
+        sizes[1] = (uint64_t)store->data_size;
+    }
+    MPI_Bcast(sizes, 2, MPI_UINT64_T, 0, node_comm);
+
+    size_t offsets_size = (sizes[0] + 1) * sizeof(uint64_t);
+    char* base = (char *)shared_alloc(offsets_size + sizes[1], node_comm, win);
+
+    MPI_Win_fence(0, *win);
+    if (node_rank == 0) {
+        memcpy(base, store->offsets, offsets_size);
+        memcpy(base + offsets_size, store->data, sizes[1]);
+    }
+    MPI_Win_fence(0, *win); // The copy is visible to the whole node after this
+
+    memset(shared, 0, sizeof(*shared));
+    shared->num_lines = (int)sizes[0];
+    shared->data_size = (size_t)sizes[1];
+    shared->offsets = (uint64_t *)base;
+    shared->data = base + offsets_size;
+}
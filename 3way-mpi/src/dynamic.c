@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "dynamic.h"
+#include "max_kernel.h"
+#include "options.h"
+#include "trace.h"
+#include "instrument.h"
+
+/*
+ * dynamic_find_max
+ * Lets every process take the next chunk of grain lines from a counter on
+ * the root with MPI_Fetch_and_op until none are left, so faster nodes end up
+ * doing more chunks. Each chunk's results are put straight into the root's
+ * results window with MPI_Put; nothing is gathered afterwards.
+ * @param store Pointer to the line store (every process holds all the lines)
+ * @param grain Lines per chunk (DEFAULT_GRAIN if not positive)
+ * @param rank Rank of this process
+ * @param max_values Array of store->num_lines results (used on the root only)
+ * @param local_max_values Array of store->num_lines results, used as the put source
+ * @return int Number of chunks this process handled
+ */
+int dynamic_find_max(const line_store_t* store, int grain, int rank, int* max_values, int* local_max_values)
+{
+    int total_lines = store->num_lines;
+    int chunks = 0;
+    if (grain <= 0) {
+        grain = DEFAULT_GRAIN;
+    }
+
+    // The next line to hand out, and the results, both live on the root
+    int* next_line = NULL;
+    MPI_Win counter_win;
+    MPI_Win_allocate(rank == 0 ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, MPI_COMM_WORLD, &next_line, &counter_win);
+    if (rank == 0) {
+        *next_line = 0;
+    }
+    // MPI_Win_allocate rather than exposing max_values with MPI_Win_create, which not every
+    // one-sided component supports (Open MPI 4.1 has none for it in a single-process job)
+    int* results = NULL;
+    MPI_Win results_win;
+    MPI_Win_allocate(rank == 0 ? (MPI_Aint)total_lines * sizeof(int) : 0, sizeof(int),
+                     MPI_INFO_NULL, MPI_COMM_WORLD, &results, &results_win);
+    if (rank == 0) {
+        instrument_memory(MEMORY_MPI, (int64_t)total_lines * (int64_t)sizeof(int));
+    }
+    MPI_Barrier(MPI_COMM_WORLD); // The counter is initialized before anyone takes from it
+
+    MPI_Win_lock_all(0, counter_win);
+    MPI_Win_lock_all(0, results_win);
+    for (;;) {
+        int start_line;
+        int64_t trace_start = trace_now();
+        MPI_Fetch_and_op(&grain, &start_line, MPI_INT, 0, 0, MPI_SUM, counter_win);
+        MPI_Win_flush(0, counter_win);
+        trace_event(TRACE_MAIN, "MPI_Fetch_and_op", trace_start, NULL, 0);
+        if (start_line >= total_lines) {
+            break;
+        }
+        int end_line = start_line + grain < total_lines ? start_line + grain : total_lines;
+
+        trace_start = trace_now();
+        for (int i = start_line; i < end_line; i++) {
+            size_t length;
+            const char* line = line_store_line(store, i, &length);
+            local_max_values[i] = line_max(line, length);
+        }
+        trace_event(TRACE_MAIN, "chunk", trace_start, "lines", (uint64_t)(end_line - start_line));
+        // The source stays untouched until the unlock, so the put needs no flush here
+        MPI_Put(local_max_values + start_line, end_line - start_line, MPI_INT,
+                0, start_line, end_line - start_line, MPI_INT, results_win);
+        chunks++;
+    }
+    MPI_Win_unlock_all(results_win); // Completes every put
+    MPI_Win_unlock_all(counter_win);
+
+    TRACE_CALL(TRACE_MAIN, "MPI_Barrier", MPI_Barrier(MPI_COMM_WORLD)); // Every process's puts have landed on the root
+    if (rank == 0) {
+        memcpy(max_values, results, (size_t)total_lines * sizeof(int));
+    }
+    MPI_Win_free(&results_win);
+    MPI_Win_free(&counter_win);
+    if (rank == 0) {
+        instrument_memory(MEMORY_MPI, -(int64_t)total_lines * (int64_t)sizeof(int));
+    }
+    return chunks;
+}
@@ -3,15 +3,32 @@
 #include <stdint.h>
 #include <mpi.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include <sys/resource.h>
-
-#define MAX_LINE_LENGTH 3000 // Max length of a single line
+#include "line_store.h"
+#include "fused_scan.h"
+#include "max_kernel.h"
+#include "options.h"
+#include "partition.h"
+#include "mpi_io.h"
+#include "distribute.h"
+#include "dynamic.h"
+#include "pipeline.h"
+#include "output.h"
+#include "results_file.h"
+#include "line_stats.h"
+#include "long_lines.h"
+#include "line_index.h"
+#include "instrument.h"
+#include "report.h"
+#include "trace.h"
 
 // Structure to hold memory usage information
 typedef struct {
     uint32_t virtual_memory; // Virtual memory used by the process
     uint32_t physical_memory; // Physical memory used by the process
+    uint32_t peak_memory; // Most physical memory the process ever used (VmHWM)
 } process_memory_t;
 
 /*
@@ -19,26 +36,24 @@ typedef struct {
  * Finds maximum ASCII value in lines
  * @param start_line Starting index of lines for this process
  * @param end_line Ending index of lines for this process
- * @param lines Pointer to array of lines
+ * @param store Pointer to the line store
  * @param local_max_values Pointer to local max values array
+ * @param long_line Lines longer than this are skipped (scanned in pieces with --long-lines)
  */
-void find_max(int start_line, int end_line, char** lines, int* local_max_values) 
+void find_max(int start_line, int end_line, const line_store_t* store, int* local_max_values, size_t long_line) 
 {
     for (int i = start_line; i < end_line; i++) {
-        char *line = lines[i];
-        int maxVal = 0;
-        for (int j = 0; line[j] != '\0'; j++) {
-            if (line[j] > maxVal) {
-                maxVal = line[j];
-            }
+        size_t length;
+        const char *line = line_store_line(store, i, &length);
+        if (length <= long_line) {
+            local_max_values[i - start_line] = line_max(line, length);
         }
-        local_max_values[i - start_line] = maxVal;
     }
 }
 
 /*
  * get_process_memory
- * Finds the amount of virtual and physical memory used during the system process
+ * Finds the amount of virtual and physical memory used during the system process, and the peak physical memory
  * @param processMem Pointer to the process_memory_t structure
  * 
  * Referenced: /homes/dan/625/checkmem.c
@@ -54,6 +69,9 @@ void get_process_memory(process_memory_t* processMem)
         if (strncmp(line, "VmRSS:", 6) == 0) {
             sscanf(line + 6, "%u", &processMem->physical_memory);
         }
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            sscanf(line + 6, "%u", &processMem->peak_memory);
+        }
     }
     fclose(file);
 }
@@ -78,102 +96,433 @@ int main(int argc, char *argv[])
     // Ensure the correct number of command-line arguments are passed
     if (argc < 3) {
         if (rank == 0) {
-            printf("Usage: %s <filename> <max_lines>\n", argv[0]);
+            printf("Usage: %s <filename> <max_lines> [options]\n%s", argv[0], OPTIONS_USAGE);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    run_options_t options;
+    if (parse_options(argc, argv, 3, &options) != 0 || max_kernel_select(options.kernel, options.semantics) != 0) {
+        if (rank == 0) {
+            printf("Usage: %s <filename> <max_lines> [options]\n%s", argv[0], OPTIONS_USAGE);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (options.stream || options.pin) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: %s is only supported by the Pthreads program.\n", options.stream ? "--stream" : "--pin");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (options.fused) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: --fused is not supported by the MPI program (--dist mpiio always scans fused).\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (options.schedule == SCHEDULE_DYNAMIC && options.dist != DIST_BCAST) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: --schedule dynamic needs every process to hold all the lines (--dist bcast, with or without --mmap).\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    // With --index, --dist mpiio processes seek straight to their own lines instead of scanning byte ranges
+    int seek = options.dist == DIST_MPIIO && options.index;
+    if (options.dist == DIST_MPIIO && !seek && (options.line_first > 0 || options.line_last >= 0)) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: --lines with --dist mpiio needs --index.\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    int use_stats = options.stats != STAT_MAX; // --stats adds columns to the max values
+    if (use_stats && (options.format != FORMAT_TEXT || options.schedule == SCHEDULE_DYNAMIC
+                      || (options.dist != DIST_BCAST && options.dist != DIST_SCATTER && !seek))) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: --stats needs text results and --dist bcast, scatter or mpiio with --index, with --schedule static.\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (options.long_lines > 0 && (options.dist != DIST_BCAST || options.schedule == SCHEDULE_DYNAMIC)) {
+        if (rank == 0) {
+            fprintf(stderr, "ERROR: --long-lines needs every process to hold all the lines (--dist bcast, with or without --mmap) and --schedule static.\n");
         }
         MPI_Finalize();
         return 1;
     }
+    if (options.long_lines > 0) {
+        line_store_set_max_length(0); // Keep lines whole, the long ones are split between the processes instead
+    }
 
     char *filename = argv[1]; // Input filename from command line
     int max_lines = atoi(argv[2]); // Maximum number of lines to read from command line
+    int line_count = options_line_count(&options, max_lines); // Lines to load from --lines on
 
-    FILE *file = NULL;
     int total_lines = 0;
-    char **lines = NULL;
+    line_store_t store; // Packed lines of the input file (only this rank's share with --dist mpiio or scatter, root only with --dist pipeline)
     int *max_values = NULL;
 
     struct timeval start_time, end_time; // Variables for timing
     struct rusage usage_start, usage_end; // Variables for resource usage
 
-    if (rank == 0) { // Code to execute by the root process only
-        file = fopen(filename, "r"); // Open the file for reading
-        if (!file) {
-            fprintf(stderr, "ERROR: Could not open input file.\n");
+    int local_count = 0; // Number of lines handled by this process
+    int first_line = 0; // Index of this process's first line
+    int *local_max_values = NULL; // Local array for storing max values found by this process
+    stats_columns_t stats = { STAT_MAX, NULL, NULL, NULL }; // All lines' results (root, --stats)
+    stats_columns_t local_stats = { STAT_MAX, NULL, NULL, NULL }; // This process's results (--stats)
+    byte_histogram_t *hist = NULL; // This process's histogram bins (--stats hist)
+    uint64_t histogram[HIST_BINS] = { 0 }; // Histogram of all lines, on the root after the reduce
+    long_lines_t long_plan = { NULL, NULL, 0, 0 }; // Pieces of the lines above --long-lines, the same on every process
+    size_t long_line = options.long_lines > 0 ? options.long_lines : SIZE_MAX;
+
+    MPI_Comm node_comm = MPI_COMM_NULL; // Processes on this node (--dist shared)
+    MPI_Comm leader_comm = MPI_COMM_NULL; // First process of every node (--dist shared)
+    MPI_Win store_win = MPI_WIN_NULL; // Node's shared copy of the lines (--dist shared)
+    MPI_Win results_win = MPI_WIN_NULL; // Node's shared results (--dist shared)
+    int node_rank = 0;
+    int node_size = 1;
+
+    if (options.report && instrument_init(1) != 0) {
+        fprintf(stderr, "Memory allocation failed for the report.\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    if (options.counters) {
+        instrument_counters_init(); // Without counters the report keeps its timings (a warning says why)
+    }
+    if (options.trace && trace_init(1) != 0) {
+        fprintf(stderr, "Memory allocation failed for the trace.\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    phase_mark_t mark; // Start of the phase being timed for --report
+    uint64_t local_bytes = 0; // Bytes this process scanned, for --report
+    instrument_start(&mark);
+    int64_t trace_start = trace_now(); // Start of the span being traced for --trace
+
+    if (seek) {
+        // Every process cuts the indexed range the same way, then reads only its own lines' bytes
+        line_index_t index;
+        if (line_index_open(&index, options.index, filename) != 0) {
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
+        int range_first = options.line_first < index.num_lines ? options.line_first : index.num_lines;
+        total_lines = line_count < index.num_lines - range_first ? line_count : index.num_lines - range_first;
+        if (total_lines < 0) {
+            total_lines = 0;
+        }
 
-        // Allocate memory for line storage
-        lines = (char **)malloc(max_lines * sizeof(char *));
-        if (!lines) {
-            fprintf(stderr, "Memory allocation failed for lines.\n");
+        int *bounds = (int *)malloc((num_procs + 1) * sizeof(int));
+        if (!bounds) {
+            fprintf(stderr, "Memory allocation failed for the line ranges.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        line_store_t range; // Offsets of the range straight from the index, no bytes
+        memset(&range, 0, sizeof(range));
+        range.offsets = (uint64_t *)(index.offsets + range_first);
+        range.num_lines = total_lines;
+        partition_lines(&range, num_procs, options.partition, bounds);
+        first_line = bounds[rank];
+        if (line_index_load(&store, filename, &index, options.use_mmap, range_first + bounds[rank],
+                            bounds[rank + 1] - bounds[rank]) != 0) {
+            fprintf(stderr, "ERROR: Could not open input file.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        free(bounds);
+        line_index_close(&index);
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, store.data_size);
+        trace_event(TRACE_MAIN, "read", trace_start, "bytes", store.data_size);
+    } else if (options.dist == DIST_MPIIO) {
+        // Every process reads its own byte range of the file
+        if (mpiio_read_range(filename, max_lines, rank, num_procs, &store) != 0) {
+            fprintf(stderr, "ERROR: Could not open input file.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, store.data_size);
+        trace_event(TRACE_MAIN, "read", trace_start, "bytes", store.data_size);
+        fused_scan_select(max_kernel_name());
+    } else if (options.dist == DIST_PIPELINE) {
+        // Only the root loads the lines, the others receive theirs wave by wave while scanning
+        memset(&store, 0, sizeof(store));
+        if (rank == 0 && line_store_load(&store, filename, options.index, 0, options.line_first, line_count) != 0) {
+            fprintf(stderr, "ERROR: Could not open input file.\n");
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
-        char buffer[MAX_LINE_LENGTH];
-        total_lines = 0;
+        if (rank == 0) {
+            instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, store.data_size);
+            trace_event(TRACE_MAIN, "read", trace_start, "bytes", store.data_size);
+        }
+    } else if (options.dist == DIST_SCATTER) {
+        line_store_t full; // Whole input, on the root only
+        if (rank == 0) {
+            // Read the lines into one packed buffer
+            if (line_store_load(&full, filename, options.index, 0, options.line_first, line_count) != 0) {
+                fprintf(stderr, "ERROR: Could not open input file.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, full.data_size);
+            trace_event(TRACE_MAIN, "read", trace_start, "bytes", full.data_size);
+            instrument_memory(MEMORY_STORE, (int64_t)line_store_bytes(&full));
+        }
+        // Send every process only the lines it owns
+        instrument_start(&mark);
+        TRACE_CALL(TRACE_MAIN, "scatter_store", scatter_store(&full, rank, num_procs, options.partition, &store, &first_line));
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_DISTRIBUTE, store.data_size);
+        if (rank == 0) {
+            total_lines = full.num_lines;
+            instrument_memory(MEMORY_STORE, -(int64_t)line_store_bytes(&full));
+            line_store_free(&full);
+        }
+    } else if (options.dist == DIST_SHARED) {
+        // Group the processes by node, the first one on each node loads the lines for all of them
+        TRACE_CALL(TRACE_MAIN, "MPI_Comm_split_type", MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm));
+        MPI_Comm_rank(node_comm, &node_rank);
+        MPI_Comm_size(node_comm, &node_size);
+        TRACE_CALL(TRACE_MAIN, "MPI_Comm_split", MPI_Comm_split(MPI_COMM_WORLD, node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &leader_comm));
+
+        line_store_t loaded; // Private copy, on the node leader only
+        if (node_rank == 0) {
+            if (line_store_load(&loaded, filename, options.index, options.use_mmap, options.line_first, line_count) != 0) {
+                fprintf(stderr, "ERROR: Could not open input file.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, loaded.data_size);
+            trace_event(TRACE_MAIN, "read", trace_start, "bytes", loaded.data_size);
+            instrument_memory(MEMORY_STORE, (int64_t)line_store_bytes(&loaded));
+        }
+        // The other processes on the node read the lines in place
+        instrument_start(&mark);
+        TRACE_CALL(TRACE_MAIN, "share_store", share_store(&loaded, node_comm, &store, &store_win));
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_DISTRIBUTE, node_rank == 0 ? store.data_size : 0);
+        if (node_rank == 0) {
+            instrument_memory(MEMORY_STORE, -(int64_t)line_store_bytes(&loaded));
+            line_store_free(&loaded);
+        }
+    } else if (options.use_mmap) {
+        // Every process maps the file itself, so no lines are broadcast
+        if (line_store_load(&store, filename, options.index, 1, options.line_first, line_count) != 0) {
+            fprintf(stderr, "ERROR: Could not open input file.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, store.data_size);
+        trace_event(TRACE_MAIN, "read", trace_start, "bytes", store.data_size);
+    } else {
+        if (rank == 0) { // Code to execute by the root process only
+            // Read the lines into one packed buffer
+            if (line_store_load(&store, filename, options.index, 0, options.line_first, line_count) != 0) {
+                fprintf(stderr, "ERROR: Could not open input file.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, store.data_size);
+            trace_event(TRACE_MAIN, "read", trace_start, "bytes", store.data_size);
+        }
+        // Broadcast the packed buffer and its offsets to all processes
+        instrument_start(&mark);
+        TRACE_CALL(TRACE_MAIN, "broadcast_store", broadcast_store(&store, rank));
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_DISTRIBUTE, store.data_size);
+    }
+    if (options.dist != DIST_SHARED || node_rank == 0) {
+        instrument_memory(MEMORY_STORE, (int64_t)line_store_bytes(&store)); // A shared store is held once per node, by its leader
+    }
+    if (options.dist != DIST_SCATTER && !seek) {
+        total_lines = store.num_lines;
+    }
 
-        // Read lines from the file into the lines array
-        while (fgets(buffer, MAX_LINE_LENGTH, file) && total_lines < max_lines) {
-            buffer[strcspn(buffer, "\n")] = 0; // Remove newline character
-            lines[total_lines] = strdup(buffer); // Store the line
-            total_lines++;
+    if (rank == 0) {
+        // Allocate memory for max_values (--dist mpiio allocates it once the line count is known)
+        if (options.dist != DIST_MPIIO || seek) {
+            max_values = (int *)malloc(total_lines * sizeof(int));
+            if (!max_values) {
+                fprintf(stderr, "Memory allocation failed for max_values.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
         }
-        fclose(file); // Close the file
 
-        // Allocate memory for max_values
-        max_values = (int *)malloc(total_lines * sizeof(int));
-        if (!max_values) {
-            fprintf(stderr, "Memory allocation failed for max_values.\n");
+        if (use_stats && stats_columns_alloc(&stats, options.stats, max_values, total_lines) != 0) {
+            fprintf(stderr, "Memory allocation failed for the statistics.\n");
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
-
-        // Broadcast the total number of lines to all processes
-        MPI_Bcast(&total_lines, 1, MPI_INT, 0, MPI_COMM_WORLD);
-        // Broadcast each line to all processes
-        for (int i = 0; i < total_lines; i++) {
-            MPI_Bcast(lines[i], MAX_LINE_LENGTH, MPI_CHAR, 0, MPI_COMM_WORLD);
+        if (options.dist != DIST_MPIIO || seek) {
+            instrument_memory(MEMORY_RESULTS, (int64_t)stats_columns_bytes(&stats, total_lines));
         }
 
         // Start timing and resource usage tracking
         gettimeofday(&start_time, NULL);
         getrusage(RUSAGE_SELF, &usage_start);
+    }
+    if ((options.stats & STAT_HIST) && !(hist = (byte_histogram_t *)calloc(1, sizeof(byte_histogram_t)))) {
+        fprintf(stderr, "Memory allocation failed for the histogram.\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    instrument_start(&mark);
+    trace_start = trace_now();
+    if (options.dist == DIST_MPIIO && !seek) {
+        // Find the lines and their max values in one pass over the local bytes
+        local_bytes = store.data_size;
+        line_results_t local_results = { NULL, 0, 0 };
+        if (fused_scan(store.data, store.data_size, max_lines, &local_results) != 0) {
+            fprintf(stderr, "Memory allocation failed for local_max_values.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+
+        // Number the lines with a prefix sum of the local line counts
+        TRACE_CALL(TRACE_MAIN, "MPI_Exscan", MPI_Exscan(&local_results.count, &first_line, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD));
+        if (rank == 0) {
+            first_line = 0; // MPI_Exscan leaves the first rank's result undefined
+        }
+        local_count = local_results.count;
+        if (first_line >= max_lines) {
+            local_count = 0;
+        } else if (local_count > max_lines - first_line) {
+            local_count = max_lines - first_line; // Keep only the first max_lines lines overall
+        }
+        local_max_values = local_results.values;
+
+        TRACE_CALL(TRACE_MAIN, "MPI_Reduce", MPI_Reduce(&local_count, &total_lines, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD));
+        if (rank == 0) {
+            max_values = (int *)malloc((total_lines > 0 ? total_lines : 1) * sizeof(int));
+            if (!max_values) {
+                fprintf(stderr, "Memory allocation failed for max_values.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            instrument_memory(MEMORY_RESULTS, (int64_t)total_lines * (int64_t)sizeof(int));
+        }
+    } else if (options.dist == DIST_SCATTER || seek) {
+        // The local store holds exactly this process's lines
+        local_count = store.num_lines;
+        local_bytes = store.offsets[local_count] - store.offsets[0];
+        local_max_values = (int *)malloc((local_count > 0 ? local_count : 1) * sizeof(int));
+        if (!local_max_values) {
+            fprintf(stderr, "Memory allocation failed for local_max_values.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if (use_stats) {
+            // Max plus the extra statistics, all from one read of each line
+            if (stats_columns_alloc(&local_stats, options.stats, local_max_values, local_count) != 0) {
+                fprintf(stderr, "Memory allocation failed for the statistics.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            stats_scan_lines(&store, 0, local_count, &local_stats, 0, hist);
+        } else {
+            find_max(0, local_count, &store, local_max_values, SIZE_MAX);
+        }
+    } else if (options.dist == DIST_PIPELINE) {
+        // Sending, scanning and gathering overlap, so all three are inside the timed region
+        TRACE_CALL(TRACE_MAIN, "pipeline", pipeline_find_max(&store, rank, num_procs, options.waves, options.partition, max_values));
+    } else if (options.schedule == SCHEDULE_DYNAMIC) {
+        // Take chunks from the root's counter until the lines run out, results go straight to the root
+        local_max_values = (int *)malloc((total_lines > 0 ? total_lines : 1) * sizeof(int));
+        if (!local_max_values) {
+            fprintf(stderr, "Memory allocation failed for local_max_values.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        TRACE_CALL(TRACE_MAIN, "dynamic", dynamic_find_max(&store, options.grain, rank, max_values, local_max_values));
+    } else if (options.dist == DIST_SHARED) {
+        // Every node gets one range of lines, which its processes split between them
+        int node_info[2]; // Index of this node and number of nodes
+        if (node_rank == 0) {
+            MPI_Comm_rank(leader_comm, &node_info[0]);
+            MPI_Comm_size(leader_comm, &node_info[1]);
+        }
+        TRACE_CALL(TRACE_MAIN, "MPI_Bcast", MPI_Bcast(node_info, 2, MPI_INT, 0, node_comm));
+
+        int *bounds = (int *)malloc(((node_info[1] > node_size ? node_info[1] : node_size) + 1) * sizeof(int));
+        if (!bounds) {
+            fprintf(stderr, "Memory allocation failed for the line ranges.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        partition_lines(&store, node_info[1], options.partition, bounds);
+        int node_first = bounds[node_info[0]];
+        int node_count = bounds[node_info[0] + 1] - node_first;
+
+        line_store_t node_lines = store; // This node's lines, numbered from 0
+        node_lines.offsets = store.offsets + node_first;
+        node_lines.num_lines = node_count;
+        partition_lines(&node_lines, node_size, options.partition, bounds);
+
+        // Every process writes its results straight into the node's shared array
+        int *node_max_values = (int *)shared_alloc((size_t)node_count * sizeof(int), node_comm, &results_win);
+        TRACE_CALL(TRACE_MAIN, "MPI_Win_fence", MPI_Win_fence(0, results_win));
+        int64_t scan_start = trace_now();
+        find_max(node_first + bounds[node_rank], node_first + bounds[node_rank + 1], &store, node_max_values + bounds[node_rank], SIZE_MAX);
+        local_bytes = store.offsets[node_first + bounds[node_rank + 1]] - store.offsets[node_first + bounds[node_rank]];
+        trace_event(TRACE_MAIN, "scan", scan_start, "lines", (uint64_t)(bounds[node_rank + 1] - bounds[node_rank]));
+        TRACE_CALL(TRACE_MAIN, "MPI_Win_fence", MPI_Win_fence(0, results_win)); // All of the node's results are visible after this
+        free(bounds);
+
+        // Only the node leaders take part in the gather, each sending its whole node's results
+        first_line = node_first;
+        local_count = node_count;
+        local_max_values = node_max_values;
     } else {
-        // Non-root processes receive the broadcast of total line count
-        MPI_Bcast(&total_lines, 1, MPI_INT, 0, MPI_COMM_WORLD);
-        // Allocate memory for lines and receive the broadcasts
-        lines = (char **)malloc(total_lines * sizeof(char *));
-        if (!lines) {
-            fprintf(stderr, "Memory allocation failed for lines.\n");
+        // Calculate which lines each process will handle
+        int *bounds = (int *)malloc((num_procs + 1) * sizeof(int));
+        if (!bounds) {
+            fprintf(stderr, "Memory allocation failed for the line ranges.\n");
             MPI_Abort(MPI_COMM_WORLD, 1);
         }
-        for (int i = 0; i < total_lines; i++) {
-            lines[i] = (char *)malloc(MAX_LINE_LENGTH * sizeof(char));
-            if (!lines[i]) {
-                fprintf(stderr, "Memory allocation failed for lines[%d].\n", i);
+        partition_lines(&store, num_procs, options.partition, bounds);
+        int start_line = bounds[rank];
+        int end_line = bounds[rank + 1];
+        free(bounds);
+        first_line = start_line;
+        local_count = end_line - start_line;
+        local_bytes = store.offsets[end_line] - store.offsets[start_line];
+
+        local_max_values = (int *)malloc((local_count > 0 ? local_count : 1) * sizeof(int));
+        if (!local_max_values) {
+            fprintf(stderr, "Memory allocation failed for local_max_values.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if (use_stats) {
+            // Max plus the extra statistics, all from one read of each line
+            if (stats_columns_alloc(&local_stats, options.stats, local_max_values, local_count) != 0) {
+                fprintf(stderr, "Memory allocation failed for the statistics.\n");
                 MPI_Abort(MPI_COMM_WORLD, 1);
             }
-            MPI_Bcast(lines[i], MAX_LINE_LENGTH, MPI_CHAR, 0, MPI_COMM_WORLD);
+            stats_scan_lines(&store, start_line, end_line, &local_stats, start_line, hist);
+        } else {
+            find_max(start_line, end_line, &store, local_max_values, long_line);
         }
     }
 
-    // Calculate which lines each process will handle
-    int lines_per_proc = total_lines / num_procs;
-    int remainder = total_lines % num_procs;
-    int start_line = rank * lines_per_proc + (rank < remainder ? rank : remainder);
-    int end_line = start_line + lines_per_proc + (rank < remainder ? 1 : 0);
-    if (start_line >= total_lines) {
-        start_line = end_line = total_lines; // Ensure no work for excess processes
+    if (options.long_lines > 0) {
+        // Every process holds all the lines, so each scans an equal share of the long lines' pieces
+        if (long_lines_plan(&store, 0, total_lines, options.long_lines, &long_plan) != 0) {
+            fprintf(stderr, "Memory allocation failed for the long line pieces.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        int64_t long_start = trace_now();
+        long_lines_scan(&long_plan, (int)((long)long_plan.num_chunks * rank / num_procs),
+                        (int)((long)long_plan.num_chunks * (rank + 1) / num_procs));
+        trace_event(TRACE_MAIN, "long lines", long_start, NULL, 0);
     }
-
-    // Local array for storing max values found by this process
-    int *local_max_values = (int *)malloc((end_line - start_line) * sizeof(int));
-    if (!local_max_values) {
-        fprintf(stderr, "Memory allocation failed for local_max_values.\n");
-        MPI_Abort(MPI_COMM_WORLD, 1);
+    instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_COMPUTE, local_bytes);
+    trace_event(TRACE_MAIN, "compute", trace_start, "bytes", local_bytes);
+    if (local_max_values) {
+        // This process's results only exist to be sent to the root (a dynamic window has room for every line)
+        int local_size = options.schedule == SCHEDULE_DYNAMIC ? total_lines : local_count;
+        instrument_memory(MEMORY_MPI, (int64_t)stats_columns_bytes(&local_stats, local_size));
     }
-    for (int i = 0; i < (end_line - start_line); i++) {
-        local_max_values[i] = 0; // Initialize to 0
+
+    instrument_start(&mark);
+    trace_start = trace_now();
+    if (options.long_lines > 0) {
+        // Unscanned pieces are 0 and every value is at least 0, so a max reduce collects them at the root
+        TRACE_CALL(TRACE_MAIN, "MPI_Reduce", MPI_Reduce(rank == 0 ? MPI_IN_PLACE : long_plan.values, long_plan.values,
+                                                        long_plan.num_chunks, MPI_INT, MPI_MAX, 0, MPI_COMM_WORLD));
     }
-    find_max(start_line, end_line, lines, local_max_values);
 
     int *recvcounts = NULL;
     int *displs = NULL;
@@ -181,27 +530,77 @@ int main(int argc, char *argv[])
     if (rank == 0) {
         recvcounts = malloc(num_procs * sizeof(int));
         displs = malloc(num_procs * sizeof(int));
-        int displacement = 0;
-        for (int i = 0; i < num_procs; i++) {
-            recvcounts[i] = (i < remainder) ? lines_per_proc + 1 : lines_per_proc;
-            displs[i] = displacement;
-            displacement += recvcounts[i];
-        }
     }
 
-    // Gather all max values found by all processes at the root process
-    MPI_Gatherv(local_max_values, end_line - start_line, MPI_INT, max_values, recvcounts, displs, MPI_INT, 0, MPI_COMM_WORLD);
+    // With --dist shared one process per node gathers for the whole node (rank 0 is always a leader)
+    // With --schedule dynamic or --dist pipeline the results are already on the root
+    // With text --output every process writes its own results, so nothing is gathered (unless --stats or --long-lines need the root)
+    MPI_Comm gather_comm = options.dist == DIST_SHARED ? leader_comm : MPI_COMM_WORLD;
+    int write_local = options.output && options.format == FORMAT_TEXT && !use_stats && options.long_lines == 0; // Every process writes with MPI-IO
+    if (options.schedule == SCHEDULE_DYNAMIC || options.dist == DIST_PIPELINE || write_local) {
+        gather_comm = MPI_COMM_NULL;
+    }
+    if (gather_comm != MPI_COMM_NULL) {
+        // Every process reports how many lines it has and where they start
+        TRACE_CALL(TRACE_MAIN, "MPI_Gather", MPI_Gather(&local_count, 1, MPI_INT, recvcounts, 1, MPI_INT, 0, gather_comm));
+        TRACE_CALL(TRACE_MAIN, "MPI_Gather", MPI_Gather(&first_line, 1, MPI_INT, displs, 1, MPI_INT, 0, gather_comm));
+
+        // Gather all max values found by all processes at the root process
+        TRACE_CALL(TRACE_MAIN, "MPI_Gatherv", MPI_Gatherv(local_max_values, local_count, MPI_INT, max_values, recvcounts, displs, MPI_INT, 0, gather_comm));
+
+        // The --stats columns go to the same places as the max values
+        if (options.stats & STAT_MIN) {
+            TRACE_CALL(TRACE_MAIN, "MPI_Gatherv", MPI_Gatherv(local_stats.min, local_count, MPI_INT, stats.min, recvcounts, displs, MPI_INT, 0, gather_comm));
+        }
+        if (options.stats & STAT_MEAN) {
+            TRACE_CALL(TRACE_MAIN, "MPI_Gatherv", MPI_Gatherv(local_stats.mean, local_count, MPI_DOUBLE, stats.mean, recvcounts, displs, MPI_DOUBLE, 0, gather_comm));
+        }
+    }
+    if (hist) {
+        // Every process merges its own bins, then one reduce adds them up at the root
+        uint64_t local_histogram[HIST_BINS] = { 0 };
+        histogram_merge(local_histogram, hist);
+        TRACE_CALL(TRACE_MAIN, "MPI_Reduce", MPI_Reduce(local_histogram, histogram, HIST_BINS, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD));
+    }
 
     if (rank == 0) {
         free(recvcounts);
         free(displs);
+        long_lines_combine(&long_plan, max_values, 0); // The long lines' values replace what the gather left there
     }
+    instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_GATHER, gather_comm != MPI_COMM_NULL ? (uint64_t)local_count * sizeof(int) : 0);
+    trace_event(TRACE_MAIN, "gather", trace_start, "lines", gather_comm != MPI_COMM_NULL ? (uint64_t)local_count : 0);
+    long_lines_free(&long_plan);
 
     if (rank == 0) {
         // Stop timing and resource usage tracking
         gettimeofday(&end_time, NULL);
         getrusage(RUSAGE_SELF, &usage_end);
+    }
 
+    if (write_local) {
+        // Every process writes the lines it found; with dynamic or pipelined scheduling the root holds them all
+        const int *out_values = local_max_values;
+        int out_first = first_line;
+        int out_count = local_count;
+        if (options.schedule == SCHEDULE_DYNAMIC || options.dist == DIST_PIPELINE) {
+            out_values = max_values;
+            out_first = 0;
+            out_count = rank == 0 ? total_lines : 0;
+        } else if (options.dist == DIST_SHARED && leader_comm == MPI_COMM_NULL) {
+            out_count = 0; // The node leader writes the node's lines
+        }
+        instrument_start(&mark); // Formatting and writing, as one step
+        trace_start = trace_now();
+        if (mpiio_write_results(options.output, out_values, options.line_first + out_first, out_count) != 0) {
+            fprintf(stderr, "ERROR: Could not write output file.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_WRITE, (uint64_t)out_count * sizeof(int));
+        trace_event(TRACE_MAIN, "write", trace_start, "lines", (uint64_t)out_count);
+    }
+
+    if (rank == 0) {
         // Calculate and print performance metrics
         long seconds = end_time.tv_sec - start_time.tv_sec;
         long micros = end_time.tv_usec - start_time.tv_usec;
@@ -237,8 +636,45 @@ int main(int argc, char *argv[])
         get_process_memory(&myMem);
 
         // Print results
-        for (int i = 0; i < total_lines; i++) {
-            printf("%d: %d\n", i, max_values[i]);
+        if (options.format != FORMAT_TEXT) {
+            // Binary results: a header and one value per line (or per run)
+            instrument_start(&mark);
+            trace_start = trace_now();
+            int out_fd = results_open(options.output);
+            if (out_fd < 0 || results_file_write(out_fd, max_values, total_lines, options.format == FORMAT_RLE) != 0) {
+                fprintf(stderr, "ERROR: Could not write the results.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_WRITE, (uint64_t)total_lines * sizeof(int));
+            trace_event(TRACE_MAIN, "write", trace_start, "lines", (uint64_t)total_lines);
+            if (options.output) {
+                close(out_fd);
+            }
+        } else if (!write_local) {
+            stats.max = max_values;
+            size_t length = 0;
+            instrument_start(&mark);
+            trace_start = trace_now();
+            char *text = stats_format_alloc(&stats, options.line_first, total_lines, &length);
+            instrument_memory(MEMORY_RESULTS, (int64_t)length);
+            instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_FORMAT, length);
+            trace_event(TRACE_MAIN, "format", trace_start, "lines", (uint64_t)total_lines);
+            struct iovec iov = { text, length };
+            instrument_start(&mark);
+            trace_start = trace_now();
+            int out_fd = results_open(options.output);
+            if (!text || out_fd < 0 || results_write(out_fd, &iov, 1) != 0
+                || (hist && stats_write_histogram(out_fd, histogram) != 0)) {
+                fprintf(stderr, "ERROR: Could not write the results.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            if (options.output) {
+                close(out_fd);
+            }
+            instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_WRITE, length);
+            trace_event(TRACE_MAIN, "write", trace_start, "bytes", length);
+            instrument_memory(MEMORY_RESULTS, -(int64_t)length);
+            free(text);
         }
 
         // Output performance metrics
@@ -248,18 +684,46 @@ int main(int argc, char *argv[])
         printf("System CPU time used: %ld seconds, %ld microseconds\n", system_seconds, system_microseconds);
         printf("Virtual memory used: %u KB\n", myMem.virtual_memory);
         printf("Physical memory used: %u KB\n", myMem.physical_memory);
+        printf("Peak physical memory used: %u KB\n", myMem.peak_memory);
         printf("\n");
     }
 
+    if (options.report) {
+        // Every process sends its phases to the root, which writes the report
+        if (report_gather_write(options.report, "mpi", rank, num_procs) != 0) {
+            fprintf(stderr, "ERROR: Could not write the report.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        instrument_free();
+    }
+    if (options.trace) {
+        // Every process sends its events to the root, which writes one timeline with a track per rank
+        if (trace_gather_write(options.trace, "mpi", rank, num_procs) != 0) {
+            fprintf(stderr, "ERROR: Could not write the trace.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        trace_free();
+    }
+
     // Free allocated memory
-    free(local_max_values);
-    for (int i = 0; i < total_lines; i++) {
-        free(lines[i]);
+    if (options.dist == DIST_SHARED) {
+        // The lines and results live in the node's shared windows
+        MPI_Win_free(&results_win);
+        MPI_Win_free(&store_win);
+        if (leader_comm != MPI_COMM_NULL) {
+            MPI_Comm_free(&leader_comm);
+        }
+        MPI_Comm_free(&node_comm);
+    } else {
+        free(local_max_values);
+        line_store_free(&store);
     }
-    free(lines);
     if (rank == 0) {
         free(max_values);
     }
+    stats_columns_free(&local_stats);
+    stats_columns_free(&stats);
+    free(hist);
 
     // Clean up MPI environment
     MPI_Finalize();
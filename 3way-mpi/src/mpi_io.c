@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <mpi.h>
+#include "mpi_io.h"
+#include "fused_scan.h"
+#include "output.h"
+#include "trace.h"
+#include "instrument.h"
+
+#define WRITE_BLOCK_SIZE (1 << 20) // Bytes per element of the block type used for large collective writes
+
+/*
+ * read_at
+ * Reads a byte range with MPI_File_read_at, in pieces of at most INT_MAX bytes
+ * @param fh Open file handle
+ * @param offset File offset of the first byte
+ * @param buffer Destination buffer
+ * @param size Number of bytes to read
+ * @return int 0 on success, -1 on failure
+ */
+static int read_at(MPI_File fh, MPI_Offset offset, char* buffer, size_t size)
+{
+    for (size_t done = 0; done < size; ) {
+        size_t remaining = size - done;
+        int count = remaining > INT_MAX ? INT_MAX : (int)remaining;
+        int64_t trace_start = trace_now();
+        if (MPI_File_read_at(fh, offset + (MPI_Offset)done, buffer + done, count, MPI_CHAR, MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+            return -1;
+        }
+        trace_event(TRACE_MAIN, "MPI_File_read_at", trace_start, "bytes", (uint64_t)count);
+        done += (size_t)count;
+    }
+    return 0;
+}
+
+/*
+ * mpiio_read_range
+ * Reads this rank's share of the input straight from the file. Each rank
+ * reads about filesize / num_procs bytes (plus the byte before its range),
+ * the ranks agree on where their first whole line starts, and each rank
+ * then reads the tail of its last line up to the next rank's first line.
+ * @param filename Input filename
+ * @param max_lines Maximum number of lines wanted in total
+ * @param rank Rank of this process
+ * @param num_procs Number of processes
+ * @param local Pointer to the line store to fill with this rank's raw bytes (not indexed)
+ * @return int 0 on success, -1 on failure
+ */
+int mpiio_read_range(const char* filename, int max_lines, int rank, int num_procs, line_store_t* local)
+{
+    memset(local, 0, sizeof(*local));
+
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        return -1;
+    }
+
+    MPI_Offset file_size;
+    MPI_File_get_size(fh, &file_size);
+    uint64_t size = fused_prefix_size((size_t)file_size, max_lines); // No need to read past the first max_lines lines
+
+    // Nominal byte range, read together with the byte before it
+    uint64_t begin = size * (uint64_t)rank / (uint64_t)num_procs;
+    uint64_t end = size * (uint64_t)(rank + 1) / (uint64_t)num_procs;
+    uint64_t read_begin = begin > 0 ? begin - 1 : 0;
+    size_t read_size = (size_t)(end - read_begin);
+
+    char* buffer = (char *)malloc(read_size > 0 ? read_size : 1);
+    if (!buffer || read_at(fh, (MPI_Offset)read_begin, buffer, read_size) != 0) {
+        free(buffer);
+        MPI_File_close(&fh);
+        return -1;
+    }
+
+    // First line start in [begin, end), or end if a line spans the whole range
+    uint64_t first = end;
+    if (begin == 0) {
+        first = 0; // The file starts a line (ranges are empty when it has fewer bytes than ranks)
+    } else {
+        const char* newline = memchr(buffer, '\n', read_size);
+        if (newline && (uint64_t)(newline - buffer) + read_begin + 1 < end) {
+            first = read_begin + (uint64_t)(newline - buffer) + 1;
+        }
+    }
+
+    // Every rank learns where the others' first lines start
+    uint64_t* firsts = (uint64_t *)malloc(num_procs * sizeof(uint64_t));
+    if (!firsts) {
+        free(buffer);
+        MPI_File_close(&fh);
+        return -1;
+    }
+    TRACE_CALL(TRACE_MAIN, "MPI_Allgather", MPI_Allgather(&first, 1, MPI_UINT64_T, firsts, 1, MPI_UINT64_T, MPI_COMM_WORLD));
+
+    // This rank owns [first, stop), where stop is the next line start owned by a later rank
+    uint64_t stop = size;
+    for (int r = rank + 1; r < num_procs; r++) {
+        uint64_t r_end = size * (uint64_t)(r + 1) / (uint64_t)num_procs;
+        if (firsts[r] < r_end) {
+            stop = firsts[r];
+            break;
+        }
+    }
+    free(firsts);
+    if (first >= end) {
+        stop = first; // The range holds no line start, so the previous rank owns its bytes
+    }
+
+    // Drop the bytes before the first line and read the tail past the nominal end
+    size_t owned = (size_t)(stop - first);
+    size_t skip = first < end ? (size_t)(first - read_begin) : read_size; // Bytes before the first line
+    size_t in_buffer = read_size - skip; // The next rank's first line starts at or after end
+    memmove(buffer, buffer + skip, in_buffer);
+    char* data = (char *)realloc(buffer, owned > 0 ? owned : 1);
+    if (!data) {
+        free(buffer);
+        MPI_File_close(&fh);
+        return -1;
+    }
+    if (read_at(fh, (MPI_Offset)(first + in_buffer), data + in_buffer, owned - in_buffer) != 0) {
+        free(data);
+        MPI_File_close(&fh);
+        return -1;
+    }
+    MPI_File_close(&fh);
+
+    local->data = data;
+    local->data_size = owned;
+    return 0;
+}
+
+/*
+ * mpiio_write_results
+ * Writes every process's results to one file in parallel. Each process
+ * formats its own lines, an MPI_Exscan of the text lengths gives each one
+ * its file offset, and all of them write with MPI_File_write_at_all. The file
+ * holds exactly what the results loop would have printed.
+ * @param path Results file, created or truncated
+ * @param values Max values of this process's lines
+ * @param first_line Index of this process's first line
+ * @param count Number of lines this process writes (0 if another process writes them)
+ * @return int 0 on success, -1 on failure
+ */
+int mpiio_write_results(const char* path, const int* values, int first_line, int count)
+{
+    size_t length = 0;
+    int64_t trace_start = trace_now();
+    char* text = results_format_alloc(values, first_line, count, &length);
+    if (!text) {
+        return -1;
+    }
+    trace_event(TRACE_MAIN, "format", trace_start, "lines", (uint64_t)count);
+    instrument_memory(MEMORY_RESULTS, (int64_t)length);
+
+    // The processes hold consecutive runs of lines in rank order, so their text goes in rank order too
+    unsigned long long local_length = length;
+    unsigned long long offset = 0;
+    TRACE_CALL(TRACE_MAIN, "MPI_Exscan", MPI_Exscan(&local_length, &offset, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD));
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0) {
+        offset = 0; // MPI_Exscan leaves the first rank's result undefined
+    }
+
+    MPI_File fh;
+    if (MPI_File_open(MPI_COMM_WORLD, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        instrument_memory(MEMORY_RESULTS, -(int64_t)length);
+        free(text);
+        return -1;
+    }
+    MPI_File_set_size(fh, 0); // Truncate a previous, longer run
+
+    // Counts are ints, so write whole blocks with a block type and then the rest as bytes
+    MPI_Datatype block;
+    MPI_Type_contiguous(WRITE_BLOCK_SIZE, MPI_CHAR, &block);
+    MPI_Type_commit(&block);
+    size_t blocks = length / WRITE_BLOCK_SIZE;
+    size_t tail = length % WRITE_BLOCK_SIZE;
+    int status = 0;
+    trace_start = trace_now();
+    if (MPI_File_write_at_all(fh, (MPI_Offset)offset, text, (int)blocks, block, MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+        status = -1;
+    }
+    if (MPI_File_write_at_all(fh, (MPI_Offset)(offset + blocks * WRITE_BLOCK_SIZE), text + blocks * WRITE_BLOCK_SIZE,
+                              (int)tail, MPI_CHAR, MPI_STATUS_IGNORE) != MPI_SUCCESS) {
+        status = -1;
+    }
+    trace_event(TRACE_MAIN, "MPI_File_write_at_all", trace_start, "bytes", length);
+    MPI_Type_free(&block);
+    MPI_File_close(&fh);
+    instrument_memory(MEMORY_RESULTS, -(int64_t)length);
+    free(text);
+    return status;
+}
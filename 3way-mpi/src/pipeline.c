@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <mpi.h>
+#include "pipeline.h"
+#include "partition.h"
+#include "max_kernel.h"
+#include "trace.h"
+#include "instrument.h"
+
+// Structure to hold the root's send and receive layout of one wave
+typedef struct wave_layout {
+    int* line_counts; // Lines per process
+    int* line_displs; // First line of each process, relative to the wave (offsets scatter)
+    int* byte_counts; // Bytes per process
+    int* byte_displs; // First byte of each process, relative to the wave
+    int* result_displs; // First line of each process in max_values (results gather)
+    int first_line; // First line of the wave
+} wave_layout_t;
+
+// Structure to hold one process's buffers for a wave in flight
+typedef struct wave_buffer {
+    uint64_t* offsets; // Offsets of this process's lines, then the end of its last line
+    char* data; // Bytes of this process's lines
+    int* results; // Max value of each line
+    MPI_Request in[2]; // Offsets and data scatters
+    MPI_Request out; // Results gather
+} wave_buffer_t;
+
+/*
+ * post_scatter
+ * Starts sending one wave's offsets and bytes to every process
+ * @param store Pointer to the full line store (used on the root only)
+ * @param layout Pointer to the wave's layout (used on the root only)
+ * @param own This process's line count and byte count in the wave
+ * @param rank Rank of this process
+ * @param buffer Pointer to the buffers receiving the wave
+ */
+static void post_scatter(const line_store_t* store, const wave_layout_t* layout, const int* own, int rank, wave_buffer_t* buffer)
+{
+    const uint64_t* send_offsets = NULL;
+    const char* send_data = NULL;
+    if (rank == 0) {
+        send_offsets = store->offsets + layout->first_line;
+        send_data = store->data + store->offsets[layout->first_line];
+    }
+    MPI_Iscatterv(send_offsets, rank == 0 ? layout->line_counts : NULL, rank == 0 ? layout->line_displs : NULL, MPI_UINT64_T,
+                  buffer->offsets, own[0], MPI_UINT64_T, 0, MPI_COMM_WORLD, &buffer->in[0]);
+    MPI_Iscatterv(send_data, rank == 0 ? layout->byte_counts : NULL, rank == 0 ? layout->byte_displs : NULL, MPI_CHAR,
+                  buffer->data, own[1], MPI_CHAR, 0, MPI_COMM_WORLD, &buffer->in[1]);
+}
+
+/*
+ * pipeline_find_max
+ * Splits the root's lines into num_waves waves and each wave into one slice
+ * per process. Wave w + 1 is scattered with MPI_Iscatterv and wave w - 1's
+ * results are gathered with MPI_Igatherv while wave w is being scanned, so
+ * sending, scanning and collecting overlap instead of running one after the
+ * other. Every process keeps two waves of buffers.
+ * @param store Pointer to the full line store (used on the root only)
+ * @param rank Rank of this process
+ * @param num_procs Number of processes
+ * @param num_waves Number of waves (DEFAULT_WAVES if not positive, more if a wave would exceed int counts)
+ * @param partition How each wave is cut into per-process slices
+ * @param max_values Array receiving every line's max value (used on the root only)
+ */
+void pipeline_find_max(const line_store_t* store, int rank, int num_procs, int num_waves, partition_mode_t partition, int* max_values)
+{
+    wave_layout_t* layouts = NULL;
+    int* own_table = NULL; // Per process, per wave: line count and byte count
+    int own_max[2] = { 0, 0 }; // Largest line and byte counts this process gets in any wave
+
+    if (num_waves <= 0) {
+        num_waves = DEFAULT_WAVES;
+    }
+    if (rank == 0) {
+        // Every wave's bytes must fit the int counts and displacements of MPI_Iscatterv
+        size_t min_waves = store->data_size / (INT_MAX / 2) + 1;
+        if ((size_t)num_waves < min_waves) {
+            num_waves = (int)min_waves;
+        }
+        if (num_waves > store->num_lines) {
+            num_waves = store->num_lines > 0 ? store->num_lines : 1;
+        }
+    }
+    TRACE_CALL(TRACE_MAIN, "MPI_Bcast", MPI_Bcast(&num_waves, 1, MPI_INT, 0, MPI_COMM_WORLD));
+
+    if (rank == 0) {
+        layouts = (wave_layout_t *)calloc(num_waves, sizeof(wave_layout_t));
+        own_table = (int *)malloc((size_t)num_procs * num_waves * 2 * sizeof(int));
+        int* wave_bounds = (int *)malloc(((num_waves > num_procs ? num_waves : num_procs) + 1) * sizeof(int));
+        int* slice_bounds = (int *)malloc((num_procs + 1) * sizeof(int));
+        if (!layouts || !own_table || !wave_bounds || !slice_bounds) {
+            fprintf(stderr, "Memory allocation failed for the wave tables.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        partition_lines(store, num_waves, partition, wave_bounds);
+
+        for (int w = 0; w < num_waves; w++) {
+            wave_layout_t* layout = &layouts[w];
+            layout->first_line = wave_bounds[w];
+            layout->line_counts = (int *)malloc(num_procs * sizeof(int));
+            layout->line_displs = (int *)malloc(num_procs * sizeof(int));
+            layout->byte_counts = (int *)malloc(num_procs * sizeof(int));
+            layout->byte_displs = (int *)malloc(num_procs * sizeof(int));
+            layout->result_displs = (int *)malloc(num_procs * sizeof(int));
+            if (!layout->line_counts || !layout->line_displs || !layout->byte_counts || !layout->byte_displs || !layout->result_displs) {
+                fprintf(stderr, "Memory allocation failed for the wave tables.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+
+            line_store_t wave = *store; // This wave's lines, numbered from 0
+            wave.offsets = store->offsets + wave_bounds[w];
+            wave.num_lines = wave_bounds[w + 1] - wave_bounds[w];
+            partition_lines(&wave, num_procs, partition, slice_bounds);
+
+            for (int r = 0; r < num_procs; r++) {
+                int first = slice_bounds[r];
+                int count = slice_bounds[r + 1] - first;
+                layout->line_counts[r] = count;
+                layout->line_displs[r] = first;
+                layout->byte_counts[r] = (int)(wave.offsets[first + count] - wave.offsets[first]);
+                layout->byte_displs[r] = (int)(wave.offsets[first] - wave.offsets[0]);
+                layout->result_displs[r] = wave_bounds[w] + first;
+                own_table[(r * num_waves + w) * 2] = count;
+                own_table[(r * num_waves + w) * 2 + 1] = layout->byte_counts[r];
+            }
+        }
+        free(wave_bounds);
+        free(slice_bounds);
+    }
+
+    // Every process learns the size of its slice of every wave up front
+    int* own = (int *)malloc(num_waves * 2 * sizeof(int));
+    if (!own) {
+        fprintf(stderr, "Memory allocation failed for the wave sizes.\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    TRACE_CALL(TRACE_MAIN, "MPI_Scatter", MPI_Scatter(own_table, num_waves * 2, MPI_INT, own, num_waves * 2, MPI_INT, 0, MPI_COMM_WORLD));
+    for (int w = 0; w < num_waves; w++) {
+        if (own[2 * w] > own_max[0]) {
+            own_max[0] = own[2 * w];
+        }
+        if (own[2 * w + 1] > own_max[1]) {
+            own_max[1] = own[2 * w + 1];
+        }
+    }
+
+    wave_buffer_t buffers[2];
+    for (int b = 0; b < 2; b++) {
+        buffers[b].offsets = (uint64_t *)malloc(((size_t)own_max[0] + 1) * sizeof(uint64_t));
+        buffers[b].data = (char *)malloc(own_max[1] > 0 ? (size_t)own_max[1] : 1);
+        buffers[b].results = (int *)malloc((own_max[0] > 0 ? (size_t)own_max[0] : 1) * sizeof(int));
+        buffers[b].out = MPI_REQUEST_NULL;
+        if (!buffers[b].offsets || !buffers[b].data || !buffers[b].results) {
+            fprintf(stderr, "Memory allocation failed for the wave buffers.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    int64_t buffer_bytes = 2 * (((int64_t)own_max[0] + 1) * (int64_t)sizeof(uint64_t) + own_max[1] + (int64_t)own_max[0] * (int64_t)sizeof(int));
+    instrument_memory(MEMORY_MPI, buffer_bytes);
+
+    post_scatter(store, layouts ? &layouts[0] : NULL, &own[0], rank, &buffers[0]);
+    for (int w = 0; w < num_waves; w++) {
+        wave_buffer_t* buffer = &buffers[w & 1];
+        wave_buffer_t* next = &buffers[(w + 1) & 1];
+
+        // Send the next wave while this one is scanned (its buffers were freed by wave w - 1)
+        if (w + 1 < num_waves) {
+            post_scatter(store, layouts ? &layouts[w + 1] : NULL, &own[2 * (w + 1)], rank, next);
+        }
+        TRACE_CALL(TRACE_MAIN, "MPI_Waitall", MPI_Waitall(2, buffer->in, MPI_STATUSES_IGNORE));
+        TRACE_CALL(TRACE_MAIN, "MPI_Wait", MPI_Wait(&buffer->out, MPI_STATUS_IGNORE)); // Wave w - 2's results have left this buffer
+
+        // Rebase the offsets to the local bytes and close the last line
+        int count = own[2 * w];
+        uint64_t base = count > 0 ? buffer->offsets[0] : 0;
+        for (int i = 0; i < count; i++) {
+            buffer->offsets[i] -= base;
+        }
+        buffer->offsets[count] = (uint64_t)own[2 * w + 1];
+
+        line_store_t slice = { buffer->data, (size_t)own[2 * w + 1], buffer->offsets, count, 0 };
+        int64_t trace_start = trace_now();
+        for (int i = 0; i < count; i++) {
+            size_t length;
+            const char* line = line_store_line(&slice, i, &length);
+            buffer->results[i] = line_max(line, length);
+        }
+        trace_event(TRACE_MAIN, "wave", trace_start, "lines", (uint64_t)count);
+
+        // Send the results back while the next wave is scanned
+        MPI_Igatherv(buffer->results, count, MPI_INT, max_values,
+                     rank == 0 ? layouts[w].line_counts : NULL, rank == 0 ? layouts[w].result_displs : NULL,
+                     MPI_INT, 0, MPI_COMM_WORLD, &buffer->out);
+    }
+    TRACE_CALL(TRACE_MAIN, "MPI_Wait", MPI_Wait(&buffers[0].out, MPI_STATUS_IGNORE));
+    TRACE_CALL(TRACE_MAIN, "MPI_Wait", MPI_Wait(&buffers[1].out, MPI_STATUS_IGNORE));
+
+    for (int b = 0; b < 2; b++) {
+        free(buffers[b].offsets);
+        free(buffers[b].data);
+        free(buffers[b].results);
+    }
+    instrument_memory(MEMORY_MPI, -buffer_bytes);
+    free(own);
+    if (rank == 0) {
+        for (int w = 0; w < num_waves; w++) {
+            free(layouts[w].line_counts);
+            free(layouts[w].line_displs);
+            free(layouts[w].byte_counts);
+            free(layouts[w].byte_displs);
+            free(layouts[w].result_displs);
+        }
+        free(layouts);
+        free(own_table);
+    }
+}
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mpi.h>
+#include "report.h"
+#include "instrument.h"
+#include "trace.h"
+
+/*
+ * report_gather_write
+ * Gathers every process's thread records on the root with one MPI_Gatherv
+ * (processes may have different numbers of threads) and writes the report
+ * there. Every process must call it.
+ * @param path Report filename (used on the root only)
+ * @param program Name of the backend
+ * @param rank Rank of this process
+ * @param num_procs Number of processes
+ * @return int 0 on success, -1 on the root if the report could not be written
+ */
+int report_gather_write(const char* path, const char* program, int rank, int num_procs)
+{
+    int num_slots;
+    const thread_record_t* records = instrument_records(&num_slots);
+
+    int *rank_slots = NULL;
+    int *counts = NULL;
+    int *displs = NULL;
+    thread_record_t *all = NULL;
+    if (rank == 0) {
+        rank_slots = (int *)malloc(num_procs * sizeof(int));
+        counts = (int *)malloc(num_procs * sizeof(int));
+        displs = (int *)malloc(num_procs * sizeof(int));
+        if (!rank_slots || !counts || !displs) {
+            fprintf(stderr, "Memory allocation failed for the report.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    MPI_Gather(&num_slots, 1, MPI_INT, rank_slots, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        int total = 0;
+        for (int r = 0; r < num_procs; r++) {
+            counts[r] = rank_slots[r] * (int)sizeof(thread_record_t);
+            displs[r] = total * (int)sizeof(thread_record_t);
+            total += rank_slots[r];
+        }
+        all = (thread_record_t *)malloc((total > 0 ? (size_t)total : 1) * sizeof(thread_record_t));
+        if (!all) {
+            fprintf(stderr, "Memory allocation failed for the report.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    // The records are plain integers, so they travel as bytes between processes of the same build
+    MPI_Gatherv(records, num_slots * (int)sizeof(thread_record_t), MPI_BYTE,
+                all, counts, displs, MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    int status = 0;
+    if (rank == 0) {
+        status = instrument_write_json(path, program, all, num_procs, rank_slots);
+        free(all);
+        free(rank_slots);
+        free(counts);
+        free(displs);
+    }
+    return status;
+}
+
+/*
+ * trace_gather_write
+ * Formats every process's trace events against a common time base (the
+ * earliest event on any rank), gathers the text on the root and writes one
+ * timeline there with one process per rank. Every process must call it.
+ * @param path Trace filename (used on the root only)
+ * @param program Name of the backend
+ * @param rank Rank of this process
+ * @param num_procs Number of processes
+ * @return int 0 on success, -1 on the root if the trace could not be written
+ */
+int trace_gather_write(const char* path, const char* program, int rank, int num_procs)
+{
+    int64_t first = trace_first_ns();
+    int64_t base;
+    MPI_Allreduce(&first, &base, 1, MPI_INT64_T, MPI_MIN, MPI_COMM_WORLD);
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s rank %d", program, rank);
+    size_t length = 0;
+    char* text = trace_format_alloc(rank, name, base, &length);
+    if (!text || length > (size_t)INT32_MAX) {
+        fprintf(stderr, "Memory allocation failed for the trace.\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int local_length = (int)length;
+
+    int *counts = NULL;
+    int *displs = NULL;
+    char *all = NULL;
+    if (rank == 0) {
+        counts = (int *)malloc(num_procs * sizeof(int));
+        displs = (int *)malloc(num_procs * sizeof(int));
+        if (!counts || !displs) {
+            fprintf(stderr, "Memory allocation failed for the trace.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    MPI_Gather(&local_length, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    size_t total = 0;
+    if (rank == 0) {
+        // Each rank's text is followed by a comma (a newline after the last one), joining them into one array
+        for (int r = 0; r < num_procs; r++) {
+            if ((uint64_t)total + (uint64_t)counts[r] + 1 > (uint64_t)INT32_MAX) {
+                fprintf(stderr, "ERROR: The trace is too large to gather, trace fewer lines.\n");
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            displs[r] = (int)total;
+            total += (size_t)counts[r] + 1;
+        }
+        all = (char *)malloc(total);
+        if (!all) {
+            fprintf(stderr, "Memory allocation failed for the trace.\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    MPI_Gatherv(text, local_length, MPI_CHAR, all, counts, displs, MPI_CHAR, 0, MPI_COMM_WORLD);
+    free(text);
+
+    int status = 0;
+    if (rank == 0) {
+        for (int r = 0; r < num_procs; r++) {
+            all[displs[r] + counts[r]] = r + 1 < num_procs ? ',' : '\n';
+        }
+        status = trace_write_file(path, all, total);
+        free(all);
+        free(counts);
+        free(displs);
+    }
+    return status;
+}
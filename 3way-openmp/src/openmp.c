@@ -2,17 +2,28 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <unistd.h>
 #include <omp.h>
 #include <sys/time.h>
 #include <sys/resource.h>
-
-#define MAX_LINE_LENGTH 3000 // Max length of a single line
-
+#include "line_store.h"
+#include "fused_scan.h"
+#include "max_kernel.h"
+#include "options.h"
+#include "output.h"
+#include "results_file.h"
+#include "partition.h"
+#include "line_stats.h"
+#include "long_lines.h"
+#include "line_index.h"
+#include "instrument.h"
+#include "trace.h"
 
 // Structure to hold memory usage information
 typedef struct process_memory {
     uint32_t virtual_memory; // Virtual memory used by the process
     uint32_t physical_memory; // Physical memory used by the process
+    uint32_t peak_memory; // Most physical memory the process ever used (VmHWM)
 } process_memory_t;
 
 void get_process_memory(process_memory_t* processMem) 
@@ -26,19 +37,74 @@ void get_process_memory(process_memory_t* processMem)
         if (strncmp(line, "VmRSS:", 6) == 0) {
             sscanf(line + 6, "%u", &processMem->physical_memory);
         }
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            sscanf(line + 6, "%u", &processMem->peak_memory);
+        }
     }
     fclose(file);
 }
 
-int find_max(char* line) 
+/*
+ * print_results
+ * Writes "<line>: <max>" (plus any --stats columns) for every line: each
+ * thread formats its own slice of the results into a private buffer, then the
+ * buffers are written in order
+ * @param fd File descriptor to write to
+ * @param stats Per-line results
+ * @param total_lines Number of lines
+ * @param line_base File line number of the first result (--lines)
+ * @param threads_num Number of slices (one per thread)
+ * @return int 0 on success, -1 on failure
+ */
+int print_results(int fd, const stats_columns_t* stats, int total_lines, int line_base, int threads_num)
 {
-    int maxVal = line[0]; 
-    for (int j = 0; line[j] != '\0'; j++) {
-        if (line[j] > maxVal) {
-            maxVal = line[j];
+    struct iovec *iov = (struct iovec *)calloc(threads_num, sizeof(struct iovec));
+    if (!iov) {
+        return -1;
+    }
+
+    int status = 0;
+    #pragma omp parallel for schedule(static, 1)
+    for (int t = 0; t < threads_num; t++) {
+        int first = (int)((long)total_lines * t / threads_num);
+        int last = (int)((long)total_lines * (t + 1) / threads_num);
+        size_t length = 0;
+        phase_mark_t mark;
+        instrument_start(&mark);
+        int64_t trace_start = trace_now();
+        stats_columns_t slice = *stats; // Columns starting at this thread's first line
+        slice.max += first;
+        slice.min = slice.min ? slice.min + first : NULL;
+        slice.mean = slice.mean ? slice.mean + first : NULL;
+        iov[t].iov_base = stats_format_alloc(&slice, line_base + first, last - first, &length);
+        iov[t].iov_len = length;
+        instrument_memory(MEMORY_RESULTS, (int64_t)length);
+        instrument_stop(&mark, 1 + omp_get_thread_num(), PHASE_FORMAT, length);
+        trace_event(1 + omp_get_thread_num(), "format", trace_start, "lines", (uint64_t)(last - first));
+        if (!iov[t].iov_base) {
+            #pragma omp atomic write
+            status = -1;
+        }
+    }
+
+    if (status == 0) {
+        phase_mark_t mark;
+        uint64_t bytes = 0;
+        for (int t = 0; t < threads_num; t++) {
+            bytes += iov[t].iov_len;
         }
+        instrument_start(&mark);
+        int64_t trace_start = trace_now();
+        status = results_write(fd, iov, threads_num);
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_WRITE, bytes);
+        trace_event(TRACE_MAIN, "write", trace_start, "bytes", bytes);
     }
-    return maxVal;
+    for (int t = 0; t < threads_num; t++) {
+        instrument_memory(MEMORY_RESULTS, -(int64_t)iov[t].iov_len);
+        free(iov[t].iov_base);
+    }
+    free(iov);
+    return status;
 }
 
 /*
@@ -51,72 +117,271 @@ int find_max(char* line)
 int main(int argc, char *argv[]) {
     // Check for correct number of arguments
     if (argc < 4) {
-        printf("Usage: %s <filename> <max_lines> <num_threads>\n", argv[0]);
+        printf("Usage: %s <filename> <max_lines> <num_threads> [options]\n%s", argv[0], OPTIONS_USAGE);
+        exit(1);
+    }
+
+    run_options_t options;
+    if (parse_options(argc, argv, 4, &options) != 0 || max_kernel_select(options.kernel, options.semantics) != 0) {
+        printf("Usage: %s <filename> <max_lines> <num_threads> [options]\n%s", argv[0], OPTIONS_USAGE);
+        exit(1);
+    }
+
+    if (options.dist != DIST_BCAST) {
+        fprintf(stderr, "ERROR: --dist is only supported by the MPI program.\n");
+        exit(1);
+    }
+    if (options.waves != 0) {
+        fprintf(stderr, "ERROR: --waves is only supported by the MPI program.\n");
+        exit(1);
+    }
+    if (options.stream) {
+        fprintf(stderr, "ERROR: --stream is only supported by the Pthreads program.\n");
+        exit(1);
+    }
+    if (options.pin) {
+        fprintf(stderr, "ERROR: --pin is only supported by the Pthreads program.\n");
+        exit(1);
+    }
+    if (options.grain != 0) {
+        fprintf(stderr, "ERROR: --grain is only supported by the Pthreads and MPI programs.\n");
+        exit(1);
+    }
+    if (options.schedule == SCHEDULE_DYNAMIC) {
+        fprintf(stderr, "ERROR: --schedule dynamic is only supported by the MPI program.\n");
+        exit(1);
+    }
+    if (options.stats != STAT_MAX && (options.fused || options.format != FORMAT_TEXT)) {
+        fprintf(stderr, "ERROR: --stats needs the line store (no --fused) and text results.\n");
         exit(1);
     }
 
     char *filename = argv[1]; // Input filename from command line
     int max_lines = atoi(argv[2]); // Maximum number of lines to read from command line
     int threads_num = atoi(argv[3]); // Number of threads to use
+    if (options.long_lines > 0) {
+        line_store_set_max_length(0); // Keep lines whole, the long ones are split into tasks instead
+    }
+
+    // Results go to standard output unless --output names a file
+    int out_fd = results_open(options.output);
+    if (out_fd < 0) {
+        fprintf(stderr, "ERROR: Could not open output file.\n");
+        exit(1);
+    }
 
-    FILE *file = NULL;
     int total_lines = 0;
-    char **lines = NULL;
+    line_store_t store; // Packed lines of the input file
     int *max_values = NULL;
 
     struct timeval start_time, end_time; // Variables for timing
     struct rusage usage_start, usage_end; // Variables for resource usage
 
-    file = fopen(filename, "r"); // Open the file for reading
-    if (!file) {
-        fprintf(stderr, "ERROR: Could not open input file.\n");
+    if (options.report && instrument_init(threads_num + 1) != 0) {
+        fprintf(stderr, "Memory allocation failed for the report.\n");
+        exit(1);
+    }
+    if (options.counters) {
+        instrument_counters_init(); // Without counters the report keeps its timings (a warning says why)
+    }
+    if (options.trace && trace_init(threads_num + 1) != 0) {
+        fprintf(stderr, "Memory allocation failed for the trace.\n");
         exit(1);
     }
 
-    // Allocate memory for lines
-    lines = (char **)malloc(max_lines * sizeof(char *));
-    if (!lines) {
-        fprintf(stderr, "Memory allocation failed for lines.\n");
+    // Read the lines into one packed buffer, or map the file in place
+    int status;
+    phase_mark_t mark; // Start of the phase being timed for --report
+    instrument_start(&mark);
+    int64_t trace_start = trace_now(); // Start of the span being traced for --trace
+    if (options.fused) {
+        // Load the raw bytes only, the lines are found while scanning
+        status = options.use_mmap ? line_store_map_bytes(&store, filename, max_lines)
+                                  : line_store_read_bytes(&store, filename, max_lines);
+    } else {
+        // Lines from --lines on, found through the --index offsets when there is one
+        status = line_store_load(&store, filename, options.index, options.use_mmap,
+                                 options.line_first, options_line_count(&options, max_lines));
+    }
+    if (status != 0) {
+        fprintf(stderr, "ERROR: Could not open input file.\n");
         exit(1);
-    } 
-    for (int i = 0; i < max_lines; i++) {
-        lines[i] = (char *)malloc(MAX_LINE_LENGTH * sizeof(char));
-        if (!lines[i]) {
-            fprintf(stderr, "Memory allocation failed for lines[%d].\n", i);
+    }
+    instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, store.data_size);
+    trace_event(TRACE_MAIN, "read", trace_start, "bytes", store.data_size);
+    instrument_memory(MEMORY_STORE, (int64_t)line_store_bytes(&store));
+    total_lines = store.num_lines;
+    fused_scan_select(max_kernel_name());
+
+    // Allocate memory for max_values (fused mode allocates it once the line count is known)
+    if (!options.fused) {
+        max_values = (int *)malloc(total_lines * sizeof(int));
+        if (!max_values) {
+            fprintf(stderr, "Memory allocation failed for max_values.\n");
             exit(1);
         }
     }
 
-    char *buffer = malloc(MAX_LINE_LENGTH);
-    total_lines = 0;
-
-    // Read lines from file
-    while (fgets(buffer, MAX_LINE_LENGTH, file) && total_lines < max_lines) {
-        buffer[strcspn(buffer, "\n")] = 0; // Remove newline
-        lines[total_lines] = strdup(buffer); // Duplicate line
-        total_lines++; // Increment totalLines
-    }
-    fclose(file); // Close the file
-
-    // Allocate memory for max_values
-    max_values = (int *)malloc(total_lines * sizeof(int));
-    if (!max_values) {
-        fprintf(stderr, "Memory allocation failed for max_values.\n");
+    // Extra statistics come from the same scan as the max values, the histogram from per-thread bins
+    stats_columns_t stats;
+    byte_histogram_t *hists = NULL;
+    if (stats_columns_alloc(&stats, options.stats, max_values, total_lines) != 0
+        || ((options.stats & STAT_HIST) && !(hists = (byte_histogram_t *)calloc(threads_num, sizeof(byte_histogram_t))))) {
+        fprintf(stderr, "Memory allocation failed for the statistics.\n");
         exit(1);
     }
+    if (!options.fused) {
+        instrument_memory(MEMORY_RESULTS, (int64_t)stats_columns_bytes(&stats, total_lines));
+    }
 
     // Start timing and resource usage tracking
     gettimeofday(&start_time, NULL);
     getrusage(RUSAGE_SELF, &usage_start);
 
+    // Lines above the threshold are left out of the line loops and cut into pieces
+    long_lines_t long_plan = { NULL, NULL, 0, 0 };
+    size_t long_line = options.long_lines > 0 ? options.long_lines : SIZE_MAX;
+    if (options.long_lines > 0 && long_lines_plan(&store, 0, total_lines, options.long_lines, &long_plan) != 0) {
+        fprintf(stderr, "Memory allocation failed for the long line pieces.\n");
+        exit(1);
+    }
+
     // Parrallelize Max Lines
     omp_set_num_threads(threads_num);
-    #pragma omp parallel for shared(lines) 
-    for (int i = 0; i < total_lines; i++){
-        max_values[i] = find_max(lines[i]);
-        // printf("Thread: %d\n", omp_get_thread_num());
+    if (options.fused) {
+        // Give each thread a byte range that starts on a line boundary
+        size_t *bounds = (size_t *)malloc((threads_num + 1) * sizeof(size_t));
+        line_results_t *parts = (line_results_t *)calloc(threads_num, sizeof(line_results_t));
+        if (!bounds || !parts) {
+            fprintf(stderr, "Memory allocation failed for the byte ranges.\n");
+            exit(1);
+        }
+        fused_split(store.data, fused_prefix_size(store.data_size, max_lines), threads_num, bounds);
+
+        #pragma omp parallel for schedule(static, 1)
+        for (int t = 0; t < threads_num; t++) {
+            phase_mark_t range_mark;
+            instrument_start(&range_mark);
+            int64_t range_start = trace_now();
+            if (fused_scan(store.data + bounds[t], bounds[t + 1] - bounds[t], max_lines, &parts[t]) != 0) {
+                fprintf(stderr, "Memory allocation failed for range %d results.\n", t);
+                exit(1);
+            }
+            instrument_stop(&range_mark, 1 + omp_get_thread_num(), PHASE_COMPUTE, bounds[t + 1] - bounds[t]);
+            trace_event(1 + omp_get_thread_num(), "fused scan", range_start, "bytes", bounds[t + 1] - bounds[t]);
+        }
+
+        // Join the per-range results in file order
+        instrument_start(&mark);
+        trace_start = trace_now();
+        total_lines = line_results_join(parts, threads_num, max_lines, &max_values);
+        if (total_lines < 0) {
+            fprintf(stderr, "Memory allocation failed for max_values.\n");
+            exit(1);
+        }
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_GATHER, (uint64_t)total_lines * sizeof(int));
+        trace_event(TRACE_MAIN, "join", trace_start, "lines", (uint64_t)total_lines);
+        instrument_memory(MEMORY_RESULTS, (int64_t)total_lines * (int64_t)sizeof(int));
+        for (int t = 0; t < threads_num; t++) {
+            line_results_free(&parts[t]);
+        }
+        free(parts);
+        free(bounds);
+        stats.max = max_values;
+    } else if (options.stats != STAT_MAX) {
+        // One range of lines per thread, so each thread counts into its own histogram bins
+        int *bounds = (int *)malloc((threads_num + 1) * sizeof(int));
+        if (!bounds) {
+            fprintf(stderr, "Memory allocation failed for the line ranges.\n");
+            exit(1);
+        }
+        partition_lines(&store, threads_num, options.partition, bounds);
+
+        #pragma omp parallel for schedule(static, 1) shared(store, stats)
+        for (int t = 0; t < threads_num; t++) {
+            phase_mark_t range_mark;
+            instrument_start(&range_mark);
+            int64_t range_start = trace_now();
+            stats_scan_lines(&store, bounds[t], bounds[t + 1], &stats, 0, hists ? &hists[t] : NULL);
+            instrument_stop(&range_mark, 1 + omp_get_thread_num(), PHASE_COMPUTE,
+                            store.offsets[bounds[t + 1]] - store.offsets[bounds[t]]);
+            trace_event(1 + omp_get_thread_num(), "range", range_start, "lines", (uint64_t)(bounds[t + 1] - bounds[t]));
+        }
+        free(bounds);
+    } else if (options.partition == PARTITION_BYTES) {
+        // Custom schedule: one range of lines per thread, cut at equal byte counts
+        int *bounds = (int *)malloc((threads_num + 1) * sizeof(int));
+        if (!bounds) {
+            fprintf(stderr, "Memory allocation failed for the line ranges.\n");
+            exit(1);
+        }
+        partition_lines(&store, threads_num, PARTITION_BYTES, bounds);
+
+        #pragma omp parallel for schedule(static, 1) shared(store)
+        for (int t = 0; t < threads_num; t++) {
+            phase_mark_t range_mark;
+            instrument_start(&range_mark);
+            int64_t range_start = trace_now();
+            for (int i = bounds[t]; i < bounds[t + 1]; i++) {
+                size_t length;
+                const char *line = line_store_line(&store, i, &length);
+                if (length <= long_line) {
+                    max_values[i] = line_max(line, length);
+                }
+            }
+            instrument_stop(&range_mark, 1 + omp_get_thread_num(), PHASE_COMPUTE,
+                            store.offsets[bounds[t + 1]] - store.offsets[bounds[t]]);
+            trace_event(1 + omp_get_thread_num(), "range", range_start, "lines", (uint64_t)(bounds[t + 1] - bounds[t]));
+        }
+        free(bounds);
+    } else {
+        #pragma omp parallel shared(store)
+        {
+            // Each thread times its own share of the loop for --report
+            phase_mark_t loop_mark;
+            uint64_t bytes = 0;
+            uint64_t lines = 0;
+            instrument_start(&loop_mark);
+            int64_t loop_start = trace_now();
+            #pragma omp for nowait
+            for (int i = 0; i < total_lines; i++){
+                size_t length;
+                lines++;
+                const char *line = line_store_line(&store, i, &length);
+                if (length <= long_line) {
+                    max_values[i] = line_max(line, length);
+                    bytes += length; // Long lines are counted by their pieces' tasks
+                }
+                // printf("Thread: %d\n", omp_get_thread_num());
+            }
+            instrument_stop(&loop_mark, 1 + omp_get_thread_num(), PHASE_COMPUTE, bytes);
+            trace_event(1 + omp_get_thread_num(), "range", loop_start, "lines", lines);
+        }
     }
 
+    if (long_plan.num_chunks > 0) {
+        // One task per piece of every long line, then the pieces are combined per line
+        #pragma omp parallel shared(long_plan)
+        #pragma omp single
+        for (int c = 0; c < long_plan.num_chunks; c++) {
+            #pragma omp task firstprivate(c) shared(long_plan)
+            {
+                phase_mark_t task_mark;
+                instrument_start(&task_mark);
+                int64_t task_start = trace_now();
+                long_lines_scan(&long_plan, c, c + 1);
+                instrument_stop(&task_mark, 1 + omp_get_thread_num(), PHASE_COMPUTE, long_plan.chunks[c].length);
+                trace_event(1 + omp_get_thread_num(), "long line piece", task_start, "bytes", long_plan.chunks[c].length);
+            }
+        }
+        instrument_start(&mark);
+        trace_start = trace_now();
+        long_lines_combine(&long_plan, max_values, 0);
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_GATHER, (uint64_t)long_plan.num_chunks * sizeof(int));
+        trace_event(TRACE_MAIN, "combine", trace_start, "pieces", (uint64_t)long_plan.num_chunks);
+    }
+    long_lines_free(&long_plan);
+
 
     // Stop timing and resource usage tracking
     gettimeofday(&end_time, NULL);
@@ -156,9 +421,46 @@ int main(int argc, char *argv[]) {
     process_memory_t myMem;
     get_process_memory(&myMem);
 
-    // Print results
-    for (int i = 0; i < total_lines; i++) {
-        printf("%d: %d\n", i, max_values[i]);
+    // Print results (binary formats are a header and one value per line or per run, encoded and written in one step)
+    if (options.format == FORMAT_TEXT) {
+        status = print_results(out_fd, &stats, total_lines, options.line_first, threads_num);
+    } else {
+        instrument_start(&mark);
+        trace_start = trace_now();
+        status = results_file_write(out_fd, max_values, total_lines, options.format == FORMAT_RLE);
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_WRITE, (uint64_t)total_lines * sizeof(int));
+        trace_event(TRACE_MAIN, "write", trace_start, "lines", (uint64_t)total_lines);
+    }
+    if (status == 0 && hists) {
+        // Merge the private bins only now that every thread is done with them
+        uint64_t histogram[HIST_BINS] = { 0 };
+        for (int t = 0; t < threads_num; t++) {
+            histogram_merge(histogram, &hists[t]);
+        }
+        status = stats_write_histogram(out_fd, histogram);
+    }
+    if (status != 0) {
+        fprintf(stderr, "ERROR: Could not write the results.\n");
+        exit(1);
+    }
+    if (options.report) {
+        int slots;
+        const thread_record_t *records = instrument_records(&slots);
+        if (instrument_write_json(options.report, "openmp", records, 1, &slots) != 0) {
+            fprintf(stderr, "ERROR: Could not write the report.\n");
+            exit(1);
+        }
+        instrument_free();
+    }
+    if (options.trace) {
+        size_t trace_length;
+        char *trace_text = trace_format_alloc(0, "openmp", trace_first_ns(), &trace_length);
+        if (!trace_text || trace_write_file(options.trace, trace_text, trace_length) != 0) {
+            fprintf(stderr, "ERROR: Could not write the trace.\n");
+            exit(1);
+        }
+        free(trace_text);
+        trace_free();
     }
 
     // Output performance metrics
@@ -168,14 +470,17 @@ int main(int argc, char *argv[]) {
     printf("System CPU time used: %ld seconds, %ld microseconds\n", system_seconds, system_microseconds);
     printf("Virtual memory used: %u KB\n", myMem.virtual_memory);
     printf("Physical memory used: %u KB\n", myMem.physical_memory);
+    printf("Peak physical memory used: %u KB\n", myMem.peak_memory);
     printf("Total threads used: %d\n", threads_num); // Total number of threads used
     printf("\n");
 
     // Free allocated memory
-    for (int i = 0; i < total_lines; i++) {
-        free(lines[i]);
+    line_store_free(&store);
+    if (options.output) {
+        close(out_fd); // Close the results file
     }
-    free(lines);
+    stats_columns_free(&stats);
+    free(hists);
     free(max_values);
 
     return 0;
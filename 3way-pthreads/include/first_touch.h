@@ -0,0 +1,34 @@
+#ifndef FIRST_TOUCH_H__
+#define FIRST_TOUCH_H__
+
+#include <stddef.h>
+#include "line_store.h"
+#include "thread_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FIRST_TOUCH_NOT_REGULAR 1 // first_touch_read status for inputs that cannot be read at offsets
+
+// Structure to hold one worker's share of a first-touch read
+typedef struct read_slice {
+    int fd; // Input file descriptor
+    char* arena; // Start of the shared arena
+    size_t start; // First byte of this worker's slice
+    size_t end; // End of this worker's slice
+    int status; // 0 once the slice is read, -1 on a short read
+} read_slice_t;
+
+// Function prototype to read a file's raw bytes with every pool worker reading (and first-touching) its own slice
+int first_touch_read(thread_pool_t* pool, line_store_t* store, const char* filename, int max_lines);
+
+// Function prototypes to allocate and free memory whose pages are placed by the first thread to write them
+void* first_touch_alloc(size_t size);
+void first_touch_free(void* ptr, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
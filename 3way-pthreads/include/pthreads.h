@@ -1,6 +1,12 @@
 #ifndef PTHREADS_H__
 #define PTHREADS_H__
 
+#include "line_store.h"
+#include "fused_scan.h"
+#include "scheduler.h"
+#include "line_stats.h"
+#include "long_lines.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -10,19 +16,41 @@ typedef struct thread_data {
     int id; // Identifier for each thread
     int start_line; // Starting line index for this thread to process
     int end_line; // Ending line index for this thread to process
-    char** lines; // Pointer to the array of lines (shared among threads)
+    const line_store_t* store; // Pointer to the line store (shared among threads)
     int* max_values; // Array to store maximum ASCII values found by each thread
+    scheduler_t* sched; // Work-stealing scheduler handing out line chunks (steal schedule)
+    stats_columns_t* stats; // Per-line results when --stats adds more than max, else NULL
+    byte_histogram_t* hist; // This thread's private histogram bins (--stats hist)
+    size_t long_line; // Lines longer than this are left to the long-line pieces
+    long_lines_t* long_plan; // Pieces of the long lines, claimed by whichever thread is free (--long-lines)
+    size_t start_byte; // Starting byte offset for this thread (fused mode)
+    size_t end_byte; // Ending byte offset for this thread (fused mode)
+    int max_lines; // Maximum number of lines to process (fused mode)
+    line_results_t results; // Max values of the lines in this thread's byte range (fused mode)
+    char* out; // Formatted results of this thread's slice of lines
+    int line_base; // File line number of line 0 of the store (--lines)
+    size_t out_length; // Number of bytes in out
 } thread_data_t;
 
 // Structure to hold memory usage information
 typedef struct process_memory {
     uint32_t virtual_memory; // Virtual memory used by the process
     uint32_t physical_memory; // Physical memory used by the process
+    uint32_t peak_memory; // Most physical memory the process ever used (VmHWM)
 } process_memory_t;
 
 // Function prototype for the thread function to find maximum ASCII values
 void* find_max(void* args);
 
+// Function prototype for the thread function that takes line chunks from the work-stealing scheduler
+void* find_max_stealing(void* args);
+
+// Function prototype for the thread function that splits and scans a byte range in one pass
+void* find_max_fused(void* args);
+
+// Function prototype for the thread function that formats a slice of the results
+void* format_results(void* args);
+
 // Function prototype to retrieve process memory usage
 void get_process_memory(process_memory_t* process_memory);
 
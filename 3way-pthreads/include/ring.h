@@ -0,0 +1,51 @@
+#ifndef RING_H__
+#define RING_H__
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One slot of the ring; sequence tells producers and consumers whose turn it is
+typedef struct ring_cell {
+    atomic_size_t sequence; // Slot state, compared against the head/tail position
+    void* item; // Stored pointer
+} ring_cell_t;
+
+#define RING_SPINS 128 // Failed tries before a blocking operation sleeps
+
+// Threads asleep on one side of a ring, woken through a futex on epoch
+typedef struct ring_waiters {
+    atomic_uint epoch; // Bumped whenever the other side makes progress while someone waits
+    atomic_uint count; // Threads registered to sleep on epoch
+} ring_waiters_t;
+
+// Structure to hold a bounded lock-free multi-producer multi-consumer queue of pointers
+typedef struct ring {
+    ring_cell_t* cells; // Power-of-two array of slots
+    size_t mask; // Capacity - 1
+    _Alignas(64) atomic_size_t head; // Next position to push (own cache line)
+    _Alignas(64) atomic_size_t tail; // Next position to pop (own cache line)
+    _Alignas(64) ring_waiters_t poppers; // Waiting for an item (own cache line)
+    _Alignas(64) ring_waiters_t pushers; // Waiting for room (own cache line)
+} ring_t;
+
+// Function prototypes to create and destroy a ring holding at least capacity items
+int ring_init(ring_t* ring, size_t capacity);
+void ring_destroy(ring_t* ring);
+
+// Function prototypes for the non-blocking operations, 0 on success and -1 if full/empty
+int ring_try_push(ring_t* ring, void* item);
+int ring_try_pop(ring_t* ring, void** item);
+
+// Function prototypes for the operations that spin briefly, then sleep until they succeed
+void ring_push(ring_t* ring, void* item);
+void* ring_pop(ring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
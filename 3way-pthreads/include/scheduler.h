@@ -0,0 +1,39 @@
+#ifndef SCHEDULER_H__
+#define SCHEDULER_H__
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include "options.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Structure to hold one thread's deque of chunk indices [head, tail), packed as tail << 32 | head
+typedef struct chunk_deque {
+    _Alignas(64) atomic_uint_fast64_t range; // Owner takes from head, thieves take from tail
+} chunk_deque_t;
+
+// Structure to hold the work-stealing scheduler shared by the worker threads
+typedef struct scheduler {
+    chunk_deque_t* deques; // One deque per thread
+    int num_threads; // Number of threads (and deques)
+    int num_chunks; // Number of chunks
+    int grain; // Lines per chunk
+    int total_lines; // Number of lines to process
+} scheduler_t;
+
+// Function prototype to split total_lines into chunks of grain lines dealt out to num_threads deques
+int scheduler_init(scheduler_t* sched, int total_lines, int num_threads, int grain);
+
+// Function prototype to get the next chunk for thread id, stealing when its own deque is empty
+int scheduler_next(scheduler_t* sched, int id, int* start_line, int* end_line);
+
+// Function prototype to release the deques
+void scheduler_destroy(scheduler_t* sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
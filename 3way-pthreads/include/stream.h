@@ -0,0 +1,19 @@
+#ifndef STREAM_H__
+#define STREAM_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_BLOCK_SIZE (1 << 20) // Bytes of input per pipeline block
+
+// Function prototype to run the reader -> find_max workers -> ordered writer pipeline
+int stream_run(const char* filename, int max_lines, int num_workers, size_t budget_bytes, int out_fd, int* lines_written);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef THREAD_POOL_H__
+#define THREAD_POOL_H__
+
+#include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Function type run by every pool worker, with that worker's argument
+typedef void* (*pool_task_t)(void* args);
+
+struct thread_pool;
+
+// Structure to hold what one worker needs to find its pool and its slot
+typedef struct pool_worker {
+    struct thread_pool* pool; // Pool this worker belongs to
+    int id; // Index of this worker, and of its argument
+    int cpu; // CPU the worker is pinned to, -1 if not pinned
+} pool_worker_t;
+
+// Structure to hold a set of long-lived worker threads that run one task at a time
+typedef struct thread_pool {
+    pthread_t* threads; // Worker thread identifiers
+    pool_worker_t* workers; // Per-worker slot
+    int num_threads; // Number of workers that were started
+    pthread_mutex_t lock; // Protects everything below
+    pthread_cond_t work_ready; // Signalled when a new task is posted or the pool stops
+    pthread_cond_t work_done; // Signalled when the last worker finishes a task
+    unsigned long generation; // Incremented for every posted task
+    int remaining; // Workers still running the current task
+    int stop; // Set to make the workers exit
+    pool_task_t task; // Current task
+    char* args; // First worker's argument
+    size_t stride; // Bytes between consecutive workers' arguments
+} thread_pool_t;
+
+// Function prototype to count the CPUs this process may run on
+int thread_pool_cpu_count(void);
+
+// Function prototype to start num_threads workers (one per allowed CPU if not positive), optionally pinned
+int thread_pool_init(thread_pool_t* pool, int num_threads, int pin);
+
+// Function prototype to run task on every worker, worker i getting args + i * stride, and wait for all of them
+void thread_pool_run(thread_pool_t* pool, pool_task_t task, void* args, size_t stride);
+
+// Function prototype to stop and join the workers
+void thread_pool_destroy(thread_pool_t* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
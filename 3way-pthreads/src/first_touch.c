@@ -0,0 +1,137 @@
+#define _GNU_SOURCE // MAP_ANONYMOUS is hidden by the pthreads build's _XOPEN_SOURCE=500
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "first_touch.h"
+#include "fused_scan.h"
+
+/*
+ * read_slice
+ * Pool task that reads one worker's byte range of the file into the arena
+ * @param args Pointer to read_slice_t
+ */
+static void *read_slice(void *args)
+{
+    read_slice_t *slice = (read_slice_t *)args;
+    size_t pos = slice->start;
+
+    slice->status = 0;
+    while (pos < slice->end) {
+        ssize_t got = pread(slice->fd, slice->arena + pos, slice->end - pos, (off_t)pos);
+        if (got <= 0) {
+            slice->status = -1;
+            break;
+        }
+        pos += (size_t)got;
+    }
+    return NULL;
+}
+
+/*
+ * first_touch_alloc
+ * Maps fresh anonymous memory. None of its pages exist until they are
+ * written, so on a NUMA machine each page is placed on the node of the
+ * thread that writes it first (unlike malloc, which may hand back heap
+ * pages the main thread already touched).
+ * @param size Number of bytes
+ * @return void* Pointer to the memory, NULL on failure
+ */
+void *first_touch_alloc(size_t size)
+{
+    void *ptr = mmap(NULL, size > 0 ? size : 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return ptr == MAP_FAILED ? NULL : ptr;
+}
+
+/*
+ * first_touch_free
+ * Unmaps memory from first_touch_alloc
+ * @param ptr Pointer to the memory
+ * @param size Number of bytes passed to first_touch_alloc
+ */
+void first_touch_free(void *ptr, size_t size)
+{
+    if (ptr) {
+        munmap(ptr, size > 0 ? size : 1);
+    }
+}
+
+/*
+ * first_touch_read
+ * Reads enough of a file to hold max_lines lines (all of it when lines are
+ * kept whole) into a first-touch arena.
+ * The arena is cut into page-aligned slices at equal byte counts, the same
+ * way fused_split and the byte partitioner cut work, and every pool worker
+ * reads its own slice so those pages land on its NUMA node.
+ * @param pool Pointer to the (pinned) thread pool
+ * @param store Pointer to the line store to fill (num_lines stays 0)
+ * @param filename Input filename
+ * @param max_lines Maximum number of lines that will be used
+ * @return int 0 on success, -1 on failure, FIRST_TOUCH_NOT_REGULAR (nothing
+ *             read) when the input is a pipe or another file that cannot be read at offsets
+ */
+int first_touch_read(thread_pool_t *pool, line_store_t *store, const char *filename, int max_lines)
+{
+    memset(store, 0, sizeof(*store));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        return FIRST_TOUCH_NOT_REGULAR;
+    }
+
+    // Lines kept whole (--long-lines) have no length bound, so the whole file may be needed
+    size_t size = line_store_max_length() == 0 ? (size_t)st.st_size : fused_prefix_size((size_t)st.st_size, max_lines);
+    if (size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    char *arena = (char *)first_touch_alloc(size);
+    read_slice_t *slices = (read_slice_t *)malloc(pool->num_threads * sizeof(read_slice_t));
+    if (!arena || !slices) {
+        first_touch_free(arena, size);
+        free(slices);
+        close(fd);
+        return -1;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    for (int i = 0; i < pool->num_threads; i++) {
+        slices[i].fd = fd;
+        slices[i].arena = arena;
+        slices[i].start = i == 0 ? 0 : (size / pool->num_threads * i) & ~(page - 1);
+        slices[i].end = i == pool->num_threads - 1 ? size : (size / pool->num_threads * (i + 1)) & ~(page - 1);
+    }
+    thread_pool_run(pool, read_slice, slices, sizeof(read_slice_t));
+    close(fd);
+
+    int status = 0;
+    for (int i = 0; i < pool->num_threads; i++) {
+        if (slices[i].status != 0) {
+            status = -1;
+        }
+    }
+    free(slices);
+    if (status != 0) {
+        first_touch_free(arena, size);
+        return -1;
+    }
+
+    store->data = arena;
+    store->data_size = size;
+    store->mapped = 1; // line_store_free unmaps it
+    return 0;
+}
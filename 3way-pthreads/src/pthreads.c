@@ -3,19 +3,34 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include "pthreads.h"
-
-#define MAX_LINE_LENGTH 3000 // Max length of a single line
-#define MAX_THREADS 40 // Absolute max number of threads
+#include "line_store.h"
+#include "fused_scan.h"
+#include "max_kernel.h"
+#include "options.h"
+#include "stream.h"
+#include "scheduler.h"
+#include "partition.h"
+#include "thread_pool.h"
+#include "first_touch.h"
+#include "output.h"
+#include "results_file.h"
+#include "line_stats.h"
+#include "long_lines.h"
+#include "line_index.h"
+#include "instrument.h"
+#include "trace.h"
 
 // Global variables
-pthread_t threads[MAX_THREADS]; // Thread identifiers
-thread_data_t threadData[MAX_THREADS]; // Thread data
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER; // Mutex for thread synchronization
 int active_threads = 0; // Counter for threads
 
+// Function prototype to scan one thread's current range of lines
+static void scan_lines(thread_data_t* data);
+
 /*
  * main 
  * Entry point of the program
@@ -27,37 +42,157 @@ int main(int argc, char *argv[])
 {
     // Check for correct number of arguments
     if (argc < 4) {
-        printf("Usage: %s <filename> <max_lines> <num_threads>\n", argv[0]);
+        printf("Usage: %s <filename> <max_lines> <num_threads> [options]\n%s", argv[0], OPTIONS_USAGE);
+        exit(1);
+    }
+
+    run_options_t options;
+    if (parse_options(argc, argv, 4, &options) != 0 || max_kernel_select(options.kernel, options.semantics) != 0) {
+        printf("Usage: %s <filename> <max_lines> <num_threads> [options]\n%s", argv[0], OPTIONS_USAGE);
+        exit(1);
+    }
+
+    if (options.dist != DIST_BCAST) {
+        fprintf(stderr, "ERROR: --dist is only supported by the MPI program.\n");
+        exit(1);
+    }
+    if (options.waves != 0) {
+        fprintf(stderr, "ERROR: --waves is only supported by the MPI program.\n");
+        exit(1);
+    }
+    if (options.stream && options.format != FORMAT_TEXT) {
+        fprintf(stderr, "ERROR: --stream writes text results only.\n");
+        exit(1);
+    }
+    if (options.schedule == SCHEDULE_DYNAMIC) {
+        fprintf(stderr, "ERROR: --schedule dynamic is only supported by the MPI program.\n");
+        exit(1);
+    }
+    if (options.stats != STAT_MAX && (options.stream || options.fused || options.format != FORMAT_TEXT)) {
+        fprintf(stderr, "ERROR: --stats needs the line store (no --stream or --fused) and text results.\n");
         exit(1);
     }
 
     char *filename = argv[1]; // Input filename
     int max_lines = atoi(argv[2]); // Maximum lines to read
+    if (options.long_lines > 0) {
+        line_store_set_max_length(0); // Keep lines whole, the long ones are split for the threads instead
+    }
     int num_threads = atoi(argv[3]); // Number of threads to use
 
-    if (num_threads > MAX_THREADS) num_threads = MAX_THREADS; // Cap the threads at MAX_THREADS
+    if (num_threads <= 0) {
+        num_threads = thread_pool_cpu_count(); // Size from the CPUs this process may use
+    }
+    fused_scan_select(max_kernel_name());
 
-    FILE *file = fopen(filename, "r"); // Open file for reading
-    if (!file) {
+    // Start the workers once, they are reused for loading and for every compute phase
+    thread_pool_t pool;
+    if (!options.stream) {
+        if (thread_pool_init(&pool, num_threads, options.pin) != 0) {
+            fprintf(stderr, "ERROR: Could not start the worker threads.\n");
+            exit(1);
+        }
+        num_threads = pool.num_threads;
+    }
+    thread_data_t *threadData = (thread_data_t *)calloc(num_threads, sizeof(thread_data_t));
+    if (!threadData) {
+        fprintf(stderr, "Memory allocation failed for the thread data.\n");
+        exit(1);
+    }
+    if (options.report && instrument_init(num_threads + 1) != 0) {
+        fprintf(stderr, "Memory allocation failed for the report.\n");
+        exit(1);
+    }
+    if (options.counters) {
+        instrument_counters_init(); // Without counters the report keeps its timings (a warning says why)
+    }
+    // One trace ring per worker and one for main (which reads the blocks with --stream), plus the --stream writer
+    if (options.trace && trace_init(num_threads + (options.stream ? 2 : 1)) != 0) {
+        fprintf(stderr, "Memory allocation failed for the trace.\n");
+        exit(1);
+    }
+
+    // Pinned workers read their own slice of the input so its pages land on their NUMA node
+    // (not with --index or --lines, which read only the lines they are asked for)
+    int first_touch = options.pin && !options.stream && !options.use_mmap && strcmp(filename, "-") != 0
+                      && !options.index && options.line_first == 0 && options.line_last < 0;
+
+    // Results go to standard output unless --output names a file
+    int out_fd = results_open(options.output);
+    if (out_fd < 0) {
+        fprintf(stderr, "ERROR: Could not open output file.\n");
+        exit(1);
+    }
+
+    line_store_t store; // Packed lines of the input file
+    int status;
+    phase_mark_t mark; // Start of the phase being timed for --report
+    instrument_start(&mark);
+    int64_t trace_start = trace_now(); // Start of the span being traced for --trace
+    if (options.stream) {
+        // The pipeline reads the input itself, one block at a time
+        memset(&store, 0, sizeof(store));
+        status = 0;
+    } else if (first_touch) {
+        status = first_touch_read(&pool, &store, filename, max_lines);
+        if (status == FIRST_TOUCH_NOT_REGULAR) {
+            // A pipe cannot be split among the workers, so it is read the usual way
+            status = options.fused ? line_store_read_bytes(&store, filename, max_lines)
+                                   : line_store_load(&store, filename, NULL, 0, 0, max_lines);
+        } else if (status == 0 && !options.fused) {
+            status = line_store_index(&store, max_lines);
+        }
+    } else if (options.fused) {
+        // Load the raw bytes only, the lines are found while scanning
+        status = options.use_mmap ? line_store_map_bytes(&store, filename, max_lines)
+                                  : line_store_read_bytes(&store, filename, max_lines);
+    } else {
+        // Lines from --lines on, found through the --index offsets when there is one
+        status = line_store_load(&store, filename, options.index, options.use_mmap,
+                                 options.line_first, options_line_count(&options, max_lines));
+    }
+    if (status != 0) {
         fprintf(stderr, "ERROR: Could not open input file.\n");
         exit(1);
     }
+    if (!options.stream) {
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_READ, store.data_size);
+        trace_event(TRACE_MAIN, "read", trace_start, "bytes", store.data_size);
+        instrument_memory(MEMORY_STORE, (int64_t)line_store_bytes(&store));
+    }
 
-    // Allocate memory for lines and maxValues
-    char **lines = (char **)malloc(max_lines * sizeof(char *));
-    int *maxValues = (int *)malloc(max_lines * sizeof(int));
-    char buffer[MAX_LINE_LENGTH]; // Buffer to store line
-    int totalLines = 0; // Total number of lines read
+    int totalLines = store.num_lines; // Total number of lines read
 
-    // Read lines from file
-    while (fgets(buffer, MAX_LINE_LENGTH, file) && totalLines < max_lines) {
-        buffer[strcspn(buffer, "\n")] = 0; // Remove newline
-        lines[totalLines] = strdup(buffer); // Duplicate line
-        totalLines++; // Increment totalLines
+    // Allocate memory for maxValues (fused mode allocates it once the line count is known)
+    int *maxValues = NULL;
+    size_t maxValuesSize = (size_t)totalLines * sizeof(int);
+    if (!options.fused && !options.stream) {
+        // Pinned workers first-touch their own slice of the results as they write them
+        maxValues = first_touch ? (int *)first_touch_alloc(maxValuesSize) : (int *)malloc(maxValuesSize);
     }
-    fclose(file); // Close file
 
-    int linesPerThread = totalLines / num_threads; // Lines per thread
+    // Extra statistics come from the same scan as the max values, the histogram from per-thread bins
+    stats_columns_t stats;
+    if (stats_columns_alloc(&stats, options.stats, maxValues, totalLines) != 0) {
+        fprintf(stderr, "Memory allocation failed for the statistics.\n");
+        exit(1);
+    }
+    if (!options.fused && !options.stream) {
+        instrument_memory(MEMORY_RESULTS, (int64_t)stats_columns_bytes(&stats, totalLines));
+    }
+    int use_stats = options.stats != STAT_MAX;
+    byte_histogram_t *hists = NULL;
+    if (options.stats & STAT_HIST) {
+        hists = (byte_histogram_t *)calloc(num_threads, sizeof(byte_histogram_t));
+        if (!hists) {
+            fprintf(stderr, "Memory allocation failed for the histogram.\n");
+            exit(1);
+        }
+    }
+
+    int stealing = !options.stream && !options.fused && options.schedule == SCHEDULE_STEAL
+                   && options.partition == PARTITION_LINES; // A byte partition asks for fixed ranges
+    scheduler_t sched; // Chunk deques for the work-stealing schedule
 
     // Start performance measurments
     struct timeval start_time, end_time;
@@ -66,34 +201,128 @@ int main(int argc, char *argv[])
     struct rusage usage_start;
     getrusage(RUSAGE_SELF, &usage_start);
 
-    for (int i = 0; i < num_threads; i++) {
-        // Set thread data
-        threadData[i].id = i;
-        threadData[i].start_line = i * linesPerThread;
-        threadData[i].end_line = (i + 1) * linesPerThread;
-        if (i == num_threads - 1) {
-            threadData[i].end_line = totalLines; // Last thread takes remainder
+    // Lines above the threshold are cut into pieces that every thread takes from once its own lines are done
+    long_lines_t long_plan = { NULL, NULL, 0, 0 };
+    size_t long_line = options.long_lines > 0 ? options.long_lines : SIZE_MAX;
+    if (options.long_lines > 0 && long_lines_plan(&store, 0, totalLines, options.long_lines, &long_plan) != 0) {
+        fprintf(stderr, "Memory allocation failed for the long line pieces.\n");
+        exit(1);
+    }
+
+    if (options.stream) {
+        // Results are printed by the pipeline's writer stage as they become ready (timed as one compute phase)
+        instrument_start(&mark);
+        int linesWritten = 0;
+        if (stream_run(filename, max_lines, num_threads, (size_t)options.budget_mb << 20, out_fd, &linesWritten) != 0) {
+            fprintf(stderr, "ERROR: Could not open input file.\n");
+            exit(1);
+        }
+        active_threads = num_threads;
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_COMPUTE, 0);
+    } else if (options.fused) {
+        // Give each thread a byte range that starts on a line boundary
+        size_t *bounds = (size_t *)malloc((num_threads + 1) * sizeof(size_t));
+        if (!bounds) {
+            fprintf(stderr, "Memory allocation failed for the byte ranges.\n");
+            exit(1);
+        }
+        fused_split(store.data, fused_prefix_size(store.data_size, max_lines), num_threads, bounds);
+
+        for (int i = 0; i < num_threads; i++) {
+            // Set thread data
+            memset(&threadData[i], 0, sizeof(threadData[i]));
+            threadData[i].id = i;
+            threadData[i].store = &store;
+            threadData[i].start_byte = bounds[i];
+            threadData[i].end_byte = bounds[i + 1];
+            threadData[i].max_lines = max_lines;
+        }
+        free(bounds);
+        thread_pool_run(&pool, find_max_fused, threadData, sizeof(thread_data_t));
+        active_threads = num_threads;
+    } else if (stealing) {
+        // Deal out chunks of lines to per-thread deques, idle threads steal from busy ones
+        if (scheduler_init(&sched, totalLines, num_threads, options.grain) != 0) {
+            fprintf(stderr, "Memory allocation failed for the scheduler.\n");
+            exit(1);
+        }
+
+        for (int i = 0; i < num_threads; i++) {
+            // Set thread data
+            threadData[i].id = i;
+            threadData[i].store = &store;
+            threadData[i].max_values = maxValues;
+            threadData[i].sched = &sched;
+            threadData[i].stats = use_stats ? &stats : NULL;
+            threadData[i].hist = hists ? &hists[i] : NULL;
+            threadData[i].long_line = long_line;
+            threadData[i].long_plan = options.long_lines > 0 ? &long_plan : NULL;
         }
-        threadData[i].lines = lines;
-        threadData[i].max_values = maxValues;
+        thread_pool_run(&pool, find_max_stealing, threadData, sizeof(thread_data_t));
+        active_threads = num_threads;
+    } else {
+        // Cut one fixed range per thread, by line count or by bytes
+        int *bounds = (int *)malloc((num_threads + 1) * sizeof(int));
+        if (!bounds) {
+            fprintf(stderr, "Memory allocation failed for the line ranges.\n");
+            exit(1);
+        }
+        partition_lines(&store, num_threads, options.partition, bounds);
 
-        // Create thread
-        if (pthread_create(&threads[i], NULL, find_max, (void *)&threadData[i]) == 0) {
-            active_threads++; // Increment thread count
+        for (int i = 0; i < num_threads; i++) {
+            // Set thread data
+            threadData[i].id = i;
+            threadData[i].start_line = bounds[i];
+            threadData[i].end_line = bounds[i + 1];
+            threadData[i].store = &store;
+            threadData[i].max_values = maxValues;
+            threadData[i].stats = use_stats ? &stats : NULL;
+            threadData[i].hist = hists ? &hists[i] : NULL;
+            threadData[i].long_line = long_line;
+            threadData[i].long_plan = options.long_lines > 0 ? &long_plan : NULL;
         }
+        free(bounds);
+        thread_pool_run(&pool, find_max, threadData, sizeof(thread_data_t));
+        active_threads = num_threads;
     }
 
-    // Join threads
-    for (int i = 0; i < active_threads; i++) {
-        pthread_join(threads[i], NULL);
+    if (stealing) {
+        scheduler_destroy(&sched);
+    }
+    instrument_start(&mark);
+    trace_start = trace_now();
+    if (options.long_lines > 0) {
+        long_lines_combine(&long_plan, maxValues, 0);
+        long_lines_free(&long_plan);
     }
 
-    // Print results
-    for (int i = 0; i < totalLines; i++) {
-        printf("%d: %d\n", i, maxValues[i]);
+    if (options.fused) {
+        // Join the per-thread results in file order
+        line_results_t *parts = (line_results_t *)malloc(active_threads * sizeof(line_results_t));
+        if (!parts) {
+            fprintf(stderr, "Memory allocation failed for maxValues.\n");
+            exit(1);
+        }
+        for (int i = 0; i < active_threads; i++) {
+            parts[i] = threadData[i].results;
+        }
+        totalLines = line_results_join(parts, active_threads, max_lines, &maxValues);
+        if (totalLines < 0) {
+            fprintf(stderr, "Memory allocation failed for maxValues.\n");
+            exit(1);
+        }
+        for (int i = 0; i < active_threads; i++) {
+            line_results_free(&threadData[i].results);
+        }
+        free(parts);
+        instrument_memory(MEMORY_RESULTS, (int64_t)totalLines * (int64_t)sizeof(int));
+    }
+    if (options.long_lines > 0 || options.fused) {
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_GATHER, (uint64_t)totalLines * sizeof(int));
+        trace_event(TRACE_MAIN, options.fused ? "join" : "combine", trace_start, "lines", (uint64_t)totalLines);
     }
 
-    // End performance measurments
+    // End performance measurments (the results are written afterwards, as in the other programs)
     gettimeofday(&end_time, NULL);
     long seconds = end_time.tv_sec - start_time.tv_sec;
     long micros = (seconds * 1000000 + end_time.tv_usec) - start_time.tv_usec;
@@ -101,6 +330,89 @@ int main(int argc, char *argv[])
     struct rusage usage_end;
     getrusage(RUSAGE_SELF, &usage_end);
 
+    if (options.format != FORMAT_TEXT) {
+        // Binary results: a header and one value per line (or per run), encoded and written in one step
+        instrument_start(&mark);
+        trace_start = trace_now();
+        if (results_file_write(out_fd, maxValues, totalLines, options.format == FORMAT_RLE) != 0) {
+            fprintf(stderr, "ERROR: Could not write the results.\n");
+            exit(1);
+        }
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_WRITE, (uint64_t)totalLines * sizeof(int));
+        trace_event(TRACE_MAIN, "write", trace_start, "lines", (uint64_t)totalLines);
+    } else if (!options.stream) {
+        // Every thread formats its own slice of the results, then the slices are written in order
+        struct iovec *iov = (struct iovec *)malloc(num_threads * sizeof(struct iovec));
+        if (!iov) {
+            fprintf(stderr, "Memory allocation failed for the output buffers.\n");
+            exit(1);
+        }
+        for (int i = 0; i < num_threads; i++) {
+            threadData[i].start_line = (int)((long)totalLines * i / num_threads);
+            threadData[i].end_line = (int)((long)totalLines * (i + 1) / num_threads);
+            threadData[i].max_values = maxValues;
+            threadData[i].stats = &stats;
+            threadData[i].line_base = options.line_first;
+        }
+        thread_pool_run(&pool, format_results, threadData, sizeof(thread_data_t));
+        instrument_start(&mark);
+        trace_start = trace_now();
+        uint64_t outBytes = 0;
+        for (int i = 0; i < num_threads; i++) {
+            if (!threadData[i].out) {
+                fprintf(stderr, "Memory allocation failed for the output buffers.\n");
+                exit(1);
+            }
+            iov[i].iov_base = threadData[i].out;
+            iov[i].iov_len = threadData[i].out_length;
+            outBytes += threadData[i].out_length;
+        }
+        if (results_write(out_fd, iov, num_threads) != 0) {
+            fprintf(stderr, "ERROR: Could not write the results.\n");
+            exit(1);
+        }
+        instrument_stop(&mark, INSTRUMENT_MAIN, PHASE_WRITE, outBytes);
+        trace_event(TRACE_MAIN, "write", trace_start, "bytes", outBytes);
+        instrument_memory(MEMORY_RESULTS, -(int64_t)outBytes);
+        for (int i = 0; i < num_threads; i++) {
+            free(threadData[i].out);
+        }
+        free(iov);
+    }
+
+    if (hists) {
+        // Merge the private bins only now that every thread is done with them
+        uint64_t histogram[HIST_BINS] = { 0 };
+        for (int i = 0; i < num_threads; i++) {
+            histogram_merge(histogram, &hists[i]);
+        }
+        if (stats_write_histogram(out_fd, histogram) != 0) {
+            fprintf(stderr, "ERROR: Could not write the results.\n");
+            exit(1);
+        }
+        free(hists);
+    }
+
+    if (options.report) {
+        int slots;
+        const thread_record_t *records = instrument_records(&slots);
+        if (instrument_write_json(options.report, "pthreads", records, 1, &slots) != 0) {
+            fprintf(stderr, "ERROR: Could not write the report.\n");
+            exit(1);
+        }
+        instrument_free();
+    }
+    if (options.trace) {
+        size_t traceLength;
+        char *traceText = trace_format_alloc(0, "pthreads", trace_first_ns(), &traceLength);
+        if (!traceText || trace_write_file(options.trace, traceText, traceLength) != 0) {
+            fprintf(stderr, "ERROR: Could not write the trace.\n");
+            exit(1);
+        }
+        free(traceText);
+        trace_free();
+    }
+
     process_memory_t myMem;
     get_process_memory(&myMem);
 
@@ -131,45 +443,159 @@ int main(int argc, char *argv[])
     printf("System CPU time used: %ld seconds, %ld microseconds\n", system_seconds, system_microseconds); // The amount of CPU time spent running system (kernel) code 
     printf("Virtual memory used: %u KB\n", myMem.virtual_memory); // The amount of virtual memory used by the process
     printf("Physical memory used: %u KB\n", myMem.physical_memory); // The amount of RAM used by the process
+    printf("Peak physical memory used: %u KB\n", myMem.peak_memory); // The most RAM the process held at any point
     printf("Total threads used: %d\n", active_threads); // Total number of threads used
     printf("\n");
 
     // Cleanup
-    for (int i = 0; i < totalLines; i++) {
-        free(lines[i]); // Free line memory
+    if (!options.stream) {
+        thread_pool_destroy(&pool); // Stop the workers
+    }
+    line_store_free(&store); // Free the line store
+    if (first_touch && !options.fused) {
+        first_touch_free(maxValues, maxValuesSize); // Unmap maxValues array
+    } else {
+        free(maxValues); // Free maxValues array
+    }
+    stats_columns_free(&stats); // Free the min and mean columns
+    free(threadData); // Free thread data
+    if (options.output) {
+        close(out_fd); // Close the results file
     }
-    free(lines); // Free lines array
-    free(maxValues); // Free maxValues array
     
     return 0;
 }
 
 /*
  * find_max 
- * Finds maximum value in line
+ * Finds maximum value in line, then helps with the long-line pieces
  * @param args Pointer to thread_data_t
  */
 void *find_max(void *args) 
 {
     thread_data_t *data = (thread_data_t *)args;
+    phase_mark_t mark;
+
+    instrument_start(&mark);
+    int64_t trace_start = trace_now();
+    scan_lines(data);
+    trace_event(1 + data->id, "range", trace_start, "lines", (uint64_t)(data->end_line - data->start_line));
+    if (data->long_plan) {
+        trace_start = trace_now();
+        long_lines_claim(data->long_plan);
+        trace_event(1 + data->id, "long lines", trace_start, NULL, 0);
+    }
+    instrument_stop(&mark, 1 + data->id, PHASE_COMPUTE,
+                    data->store->offsets[data->end_line] - data->store->offsets[data->start_line]);
+
+    return NULL;
+}
+
+/*
+ * scan_lines 
+ * Finds the maximum values of the lines in [start_line, end_line), leaving
+ * out the lines longer than long_line
+ * @param data Pointer to thread_data_t
+ */
+static void scan_lines(thread_data_t* data)
+{
+    if (data->stats) {
+        // Max plus the extra statistics, all from one read of each line
+        stats_scan_lines(data->store, data->start_line, data->end_line, data->stats, 0, data->hist);
+        return;
+    }
 
     for (int i = data->start_line; i < data->end_line; i++) {
-        char *line = data->lines[i];
-        int maxVal = 0;
-        for (int j = 0; line[j] != '\0'; j++) {
-            if (line[j] > maxVal) {
-                maxVal = line[j];
-            }
+        size_t length;
+        const char *line = line_store_line(data->store, i, &length);
+        if (length > data->long_line) {
+            continue; // Scanned in pieces by long_lines_claim
         }
-        data->max_values[i] = maxVal;
+        data->max_values[i] = line_max(line, length);
     }
+}
+
+/*
+ * format_results 
+ * Formats the results of this thread's slice of lines into its own buffer
+ * @param args Pointer to thread_data_t
+ */
+void *format_results(void *args) 
+{
+    thread_data_t *data = (thread_data_t *)args;
+    int count = data->end_line - data->start_line;
+    phase_mark_t mark;
+
+    instrument_start(&mark);
+    int64_t trace_start = trace_now();
+    stats_columns_t slice = *data->stats; // Columns starting at this thread's first line
+    slice.max = data->max_values + data->start_line;
+    slice.min = slice.min ? slice.min + data->start_line : NULL;
+    slice.mean = slice.mean ? slice.mean + data->start_line : NULL;
+
+    data->out = stats_format_alloc(&slice, data->line_base + data->start_line, count, &data->out_length);
+    instrument_memory(MEMORY_RESULTS, data->out ? (int64_t)data->out_length : 0);
+    instrument_stop(&mark, 1 + data->id, PHASE_FORMAT, data->out ? data->out_length : 0);
+    trace_event(1 + data->id, "format", trace_start, "lines", (uint64_t)count);
+
+    return NULL;
+}
+
+/*
+ * find_max_stealing 
+ * Finds maximum values chunk by chunk until the scheduler runs out of work,
+ * then helps with the long-line pieces
+ * @param args Pointer to thread_data_t
+ */
+void *find_max_stealing(void *args) 
+{
+    thread_data_t *data = (thread_data_t *)args;
+    phase_mark_t mark;
+    uint64_t bytes = 0;
+
+    instrument_start(&mark);
+    while (scheduler_next(data->sched, data->id, &data->start_line, &data->end_line)) {
+        int64_t trace_start = trace_now();
+        scan_lines(data);
+        trace_event(1 + data->id, "chunk", trace_start, "lines", (uint64_t)(data->end_line - data->start_line));
+        bytes += data->store->offsets[data->end_line] - data->store->offsets[data->start_line];
+    }
+    if (data->long_plan) {
+        int64_t trace_start = trace_now();
+        long_lines_claim(data->long_plan);
+        trace_event(1 + data->id, "long lines", trace_start, NULL, 0);
+    }
+    instrument_stop(&mark, 1 + data->id, PHASE_COMPUTE, bytes);
+
+    return NULL;
+}
+
+/*
+ * find_max_fused 
+ * Finds line boundaries and maximum values in a byte range in one pass
+ * @param args Pointer to thread_data_t
+ */
+void *find_max_fused(void *args) 
+{
+    thread_data_t *data = (thread_data_t *)args;
+    phase_mark_t mark;
+
+    instrument_start(&mark);
+    int64_t trace_start = trace_now();
+    if (fused_scan(data->store->data + data->start_byte, data->end_byte - data->start_byte,
+                   data->max_lines, &data->results) != 0) {
+        fprintf(stderr, "Memory allocation failed for thread %d results.\n", data->id);
+        exit(1);
+    }
+    instrument_stop(&mark, 1 + data->id, PHASE_COMPUTE, data->end_byte - data->start_byte);
+    trace_event(1 + data->id, "fused scan", trace_start, "bytes", data->end_byte - data->start_byte);
 
     return NULL;
 }
 
 /*
  * get_process_memory
- * Finds the amount of virtual and physical memory used during the system process
+ * Finds the amount of virtual and physical memory used during the system process, and the peak physical memory
  * @param processMem Pointer to the process_memory_t structure
  * 
  * Referenced: /homes/dan/625/checkmem.c
@@ -185,6 +611,9 @@ void get_process_memory(process_memory_t* processMem)
         if (strncmp(line, "VmRSS:", 6) == 0) {
             sscanf(line + 6, "%u", &processMem->physical_memory);
         }
+        if (strncmp(line, "VmHWM:", 6) == 0) {
+            sscanf(line + 6, "%u", &processMem->peak_memory);
+        }
     }
     fclose(file);
 }
\ No newline at end of file
@@ -0,0 +1,180 @@
+#define _GNU_SOURCE // syscall is hidden by the pthreads build's _XOPEN_SOURCE=500
+
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "ring.h"
+
+/*
+ * ring_notify
+ * Wakes a thread sleeping on one side of the ring after the other side
+ * made progress. The fence orders the caller's publish before the read of
+ * count, and a sleeper registers in count before it last checks the ring,
+ * so either the caller sees the sleeper or the sleeper sees the publish.
+ * Costs a fence and a load while nobody sleeps.
+ * @param waiters Side to wake
+ */
+static void ring_notify(ring_waiters_t* waiters)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&waiters->count, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&waiters->epoch, 1);
+        syscall(SYS_futex, &waiters->epoch, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/*
+ * ring_init
+ * Creates a ring with room for at least capacity items
+ * @param ring Pointer to the ring
+ * @param capacity Minimum number of items, rounded up to a power of two
+ * @return int 0 on success, -1 on allocation failure
+ */
+int ring_init(ring_t* ring, size_t capacity)
+{
+    size_t size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+
+    ring->cells = (ring_cell_t *)malloc(size * sizeof(ring_cell_t));
+    if (!ring->cells) {
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&ring->cells[i].sequence, i);
+        ring->cells[i].item = NULL;
+    }
+    ring->mask = size - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->poppers.epoch, 0);
+    atomic_init(&ring->poppers.count, 0);
+    atomic_init(&ring->pushers.epoch, 0);
+    atomic_init(&ring->pushers.count, 0);
+    return 0;
+}
+
+/*
+ * ring_destroy
+ * Frees the ring's slots
+ * @param ring Pointer to the ring
+ */
+void ring_destroy(ring_t* ring)
+{
+    free(ring->cells);
+    ring->cells = NULL;
+}
+
+/*
+ * ring_try_push
+ * Pushes an item if there is room. A producer claims a slot by advancing
+ * head with a compare-and-swap, then publishes it through the slot's sequence.
+ * @param ring Pointer to the ring
+ * @param item Pointer to store
+ * @return int 0 on success, -1 if the ring is full
+ */
+int ring_try_push(ring_t* ring, void* item)
+{
+    size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    for (;;) {
+        ring_cell_t* cell = &ring->cells[pos & ring->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        long diff = (long)seq - (long)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->item = item;
+                atomic_store_explicit(&cell->sequence, pos + 1, memory_order_release);
+                ring_notify(&ring->poppers);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1; // Slot still holds an item from the previous lap
+        } else {
+            pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        }
+    }
+}
+
+/*
+ * ring_try_pop
+ * Pops an item if one is available
+ * @param ring Pointer to the ring
+ * @param item Set to the popped pointer
+ * @return int 0 on success, -1 if the ring is empty
+ */
+int ring_try_pop(ring_t* ring, void** item)
+{
+    size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    for (;;) {
+        ring_cell_t* cell = &ring->cells[pos & ring->mask];
+        size_t seq = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        long diff = (long)seq - (long)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring->tail, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *item = cell->item;
+                atomic_store_explicit(&cell->sequence, pos + ring->mask + 1, memory_order_release);
+                ring_notify(&ring->pushers);
+                return 0;
+            }
+        } else if (diff < 0) {
+            return -1; // Nothing published in this slot yet
+        } else {
+            pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        }
+    }
+}
+
+/*
+ * ring_push
+ * Pushes an item, sleeping while the ring stays full
+ * @param ring Pointer to the ring
+ * @param item Pointer to store
+ */
+void ring_push(ring_t* ring, void* item)
+{
+    for (int spin = 0; spin < RING_SPINS; spin++) {
+        if (ring_try_push(ring, item) == 0) {
+            return;
+        }
+    }
+    atomic_fetch_add(&ring->pushers.count, 1);
+    for (;;) {
+        unsigned epoch = atomic_load(&ring->pushers.epoch);
+        if (ring_try_push(ring, item) == 0) {
+            break;
+        }
+        syscall(SYS_futex, &ring->pushers.epoch, FUTEX_WAIT_PRIVATE, epoch, NULL, NULL, 0); // Returns at once if a pop bumped epoch
+    }
+    atomic_fetch_sub(&ring->pushers.count, 1);
+}
+
+/*
+ * ring_pop
+ * Pops an item, sleeping while the ring stays empty
+ * @param ring Pointer to the ring
+ * @return void* Popped pointer
+ */
+void* ring_pop(ring_t* ring)
+{
+    void* item;
+    for (int spin = 0; spin < RING_SPINS; spin++) {
+        if (ring_try_pop(ring, &item) == 0) {
+            return item;
+        }
+    }
+    atomic_fetch_add(&ring->poppers.count, 1);
+    for (;;) {
+        unsigned epoch = atomic_load(&ring->poppers.epoch);
+        if (ring_try_pop(ring, &item) == 0) {
+            break;
+        }
+        syscall(SYS_futex, &ring->poppers.epoch, FUTEX_WAIT_PRIVATE, epoch, NULL, NULL, 0); // Returns at once if a push bumped epoch
+    }
+    atomic_fetch_sub(&ring->poppers.count, 1);
+    return item;
+}
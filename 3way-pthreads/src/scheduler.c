@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include "scheduler.h"
+
+#define PACK(head, tail) (((uint64_t)(tail) << 32) | (uint64_t)(head))
+#define HEAD(range) ((uint32_t)((range) & 0xffffffffu))
+#define TAIL(range) ((uint32_t)((range) >> 32))
+
+/*
+ * scheduler_init
+ * Splits the lines into chunks of grain lines and gives each thread a
+ * contiguous run of them, so threads start on neighbouring data
+ * @param sched Pointer to the scheduler
+ * @param total_lines Number of lines to process
+ * @param num_threads Number of worker threads
+ * @param grain Lines per chunk (DEFAULT_GRAIN if not positive)
+ * @return int 0 on success, -1 on allocation failure
+ */
+int scheduler_init(scheduler_t* sched, int total_lines, int num_threads, int grain)
+{
+    sched->grain = grain > 0 ? grain : DEFAULT_GRAIN;
+    sched->total_lines = total_lines;
+    sched->num_threads = num_threads;
+    sched->num_chunks = (int)(((long)total_lines + sched->grain - 1) / sched->grain);
+
+    sched->deques = (chunk_deque_t *)aligned_alloc(64, num_threads * sizeof(chunk_deque_t));
+    if (!sched->deques) {
+        return -1;
+    }
+
+    int per_thread = sched->num_chunks / num_threads;
+    int remainder = sched->num_chunks % num_threads;
+    uint32_t head = 0;
+    for (int i = 0; i < num_threads; i++) {
+        uint32_t tail = head + (uint32_t)per_thread + (i < remainder ? 1 : 0);
+        atomic_init(&sched->deques[i].range, PACK(head, tail));
+        head = tail;
+    }
+    return 0;
+}
+
+/*
+ * chunk_lines
+ * Converts a chunk index to its line range
+ * @param sched Pointer to the scheduler
+ * @param chunk Chunk index
+ * @param start_line Set to the first line of the chunk
+ * @param end_line Set to one past the last line of the chunk
+ */
+static void chunk_lines(const scheduler_t* sched, uint32_t chunk, int* start_line, int* end_line)
+{
+    long start = (long)chunk * sched->grain;
+    long end = start + sched->grain;
+    *start_line = (int)start;
+    *end_line = end < sched->total_lines ? (int)end : sched->total_lines;
+}
+
+/*
+ * scheduler_next
+ * Takes the next chunk from the front of this thread's deque. When it is
+ * empty, steals the back half of another thread's deque (one chunk is
+ * returned, the rest become this thread's deque). No chunks are added after
+ * scheduler_init, so a full pass over empty deques means the work is done.
+ * @param sched Pointer to the scheduler
+ * @param id Index of the calling thread
+ * @param start_line Set to the first line of the chunk
+ * @param end_line Set to one past the last line of the chunk
+ * @return int 1 if a chunk was returned, 0 if there is no work left
+ */
+int scheduler_next(scheduler_t* sched, int id, int* start_line, int* end_line)
+{
+    chunk_deque_t* own = &sched->deques[id];
+    uint64_t range = atomic_load(&own->range);
+
+    // Pop from the front of the own deque
+    while (HEAD(range) < TAIL(range)) {
+        if (atomic_compare_exchange_weak(&own->range, &range, PACK(HEAD(range) + 1, TAIL(range)))) {
+            chunk_lines(sched, HEAD(range), start_line, end_line);
+            return 1;
+        }
+    }
+
+    // Steal the back half of a victim's deque
+    for (int k = 1; k < sched->num_threads; k++) {
+        chunk_deque_t* victim = &sched->deques[(id + k) % sched->num_threads];
+        uint64_t victim_range = atomic_load(&victim->range);
+        while (HEAD(victim_range) < TAIL(victim_range)) {
+            uint32_t head = HEAD(victim_range);
+            uint32_t tail = TAIL(victim_range);
+            uint32_t mid = tail - (tail - head + 1) / 2; // Take at least one chunk
+            if (atomic_compare_exchange_weak(&victim->range, &victim_range, PACK(head, mid))) {
+                // Own deque is empty and every chunk index is handed out once, so a plain store is safe
+                atomic_store(&own->range, PACK(mid + 1, tail));
+                chunk_lines(sched, mid, start_line, end_line);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/*
+ * scheduler_destroy
+ * Releases the deques
+ * @param sched Pointer to the scheduler
+ */
+void scheduler_destroy(scheduler_t* sched)
+{
+    free(sched->deques);
+    sched->deques = NULL;
+}
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "stream.h"
+#include "ring.h"
+#include "line_store.h"
+#include "fused_scan.h"
+#include "output.h"
+#include "trace.h"
+#include "instrument.h"
+
+#define WRITER_BATCH 4096 // Results formatted per write by the writer stage
+
+// Structure to hold one fixed-size block of input and the max values of its lines
+typedef struct stream_block {
+    char* data; // STREAM_BLOCK_SIZE bytes, starting on a line boundary
+    size_t size; // Bytes in use, always ending on a line boundary
+    long seq; // Position of the block in the input
+    line_results_t results; // Max values of the block's lines
+} stream_block_t;
+
+// Structure to hold the state shared by the pipeline stages
+typedef struct stream {
+    ring_t free_blocks; // Blocks the reader can fill
+    ring_t work; // Filled blocks waiting for a worker (NULL tells a worker to exit)
+    ring_t done; // Scanned blocks waiting for the writer, in any order
+    stream_block_t* blocks; // All blocks
+    int num_blocks; // Number of blocks
+    int max_lines; // Stop after writing this many lines
+    atomic_long total_blocks; // Number of blocks the reader produced, -1 until it finishes
+    atomic_int stop; // Set by the writer once max_lines lines are written
+    int lines_written; // Lines written so far (writer only)
+    int out_fd; // Where the writer writes the results
+    int num_workers; // Number of worker threads, the writer traces into slot 1 + num_workers
+    atomic_int next_slot; // Trace slot handed to the next worker that starts
+} stream_t;
+
+/*
+ * stream_worker
+ * Pops filled blocks, finds their lines and max values, and hands them to the writer
+ * @param args Pointer to stream_t
+ */
+static void* stream_worker(void* args)
+{
+    stream_t* stream = (stream_t *)args;
+    stream_block_t* block;
+    int slot = 1 + atomic_fetch_add(&stream->next_slot, 1);
+
+    while ((block = (stream_block_t *)ring_pop(&stream->work)) != NULL) {
+        int64_t trace_start = trace_now();
+        block->results.count = 0;
+        if (fused_scan(block->data, block->size, INT_MAX, &block->results) != 0) {
+            fprintf(stderr, "Memory allocation failed for block results.\n");
+            exit(1);
+        }
+        trace_event(slot, "block", trace_start, "bytes", block->size);
+        ring_push(&stream->done, block);
+    }
+    return NULL;
+}
+
+/*
+ * stream_writer
+ * Prints the results of each block in input order and recycles the block.
+ * Blocks finish out of order, so they wait in a slot indexed by seq until
+ * every earlier block has been printed.
+ * @param args Pointer to stream_t
+ */
+static void* stream_writer(void* args)
+{
+    stream_t* stream = (stream_t *)args;
+    stream_block_t** pending = (stream_block_t **)calloc(stream->num_blocks, sizeof(stream_block_t *));
+    char* text = (char *)malloc(WRITER_BATCH * RESULT_LINE_MAX); // Formatted results of one batch
+    if (!pending || !text) {
+        fprintf(stderr, "Memory allocation failed for the writer.\n");
+        exit(1);
+    }
+    long next = 0; // Sequence number of the next block to print
+
+    for (;;) {
+        long total = atomic_load(&stream->total_blocks);
+        if (total >= 0 && next == total) {
+            break;
+        }
+
+        stream_block_t* block = (stream_block_t *)ring_pop(&stream->done);
+        if (!block) {
+            continue; // The reader's wakeup once total_blocks is known
+        }
+        pending[block->seq % stream->num_blocks] = block; // At most num_blocks are in flight
+
+        stream_block_t* ready;
+        while ((ready = pending[next % stream->num_blocks]) != NULL && ready->seq == next) {
+            pending[next % stream->num_blocks] = NULL;
+            int count = ready->results.count;
+            if (count > stream->max_lines - stream->lines_written) {
+                count = stream->max_lines - stream->lines_written;
+            }
+            for (int i = 0; i < count; i += WRITER_BATCH) {
+                int batch = count - i < WRITER_BATCH ? count - i : WRITER_BATCH;
+                int64_t trace_start = trace_now();
+                struct iovec iov = { text, results_format(text, ready->results.values + i, stream->lines_written, batch) };
+                if (results_write(stream->out_fd, &iov, 1) != 0) {
+                    fprintf(stderr, "ERROR: Could not write the results.\n");
+                    exit(1);
+                }
+                trace_event(1 + stream->num_workers, "write", trace_start, "lines", (uint64_t)batch);
+                stream->lines_written += batch;
+            }
+            if (stream->lines_written >= stream->max_lines) {
+                atomic_store(&stream->stop, 1); // Tell the reader it can stop
+            }
+            ring_push(&stream->free_blocks, ready);
+            next++;
+        }
+    }
+
+    free(pending);
+    free(text);
+    return NULL;
+}
+
+/*
+ * fill_block
+ * Reads from fd until the block is full or the input ends
+ * @param fd Input file descriptor
+ * @param block Pointer to the block, whose first block->size bytes are already set
+ * @return int 1 at end of input, 0 otherwise
+ */
+static int fill_block(int fd, stream_block_t* block)
+{
+    while (block->size < STREAM_BLOCK_SIZE) {
+        ssize_t got = read(fd, block->data + block->size, STREAM_BLOCK_SIZE - block->size);
+        if (got <= 0) {
+            return 1; // End of input (or a read error, which ends it the same way)
+        }
+        block->size += (size_t)got;
+    }
+    return 0;
+}
+
+/*
+ * block_cut
+ * Finds the last line boundary in a full block. Cuts after the last newline,
+ * then after as many MAX_LINE_LENGTH - 1 byte pieces of the following line as
+ * fit, so the bytes carried into the next block are always a short line start.
+ * @param block Pointer to a block that starts on a line boundary
+ * @return size_t Number of bytes to keep in the block
+ */
+static size_t block_cut(const stream_block_t* block)
+{
+    size_t line_start = 0;
+    for (size_t j = block->size; j > 0; j--) {
+        if (block->data[j - 1] == '\n') {
+            line_start = j;
+            break;
+        }
+    }
+    return line_start + (block->size - line_start) / (MAX_LINE_LENGTH - 1) * (MAX_LINE_LENGTH - 1);
+}
+
+/*
+ * stream_run
+ * Processes the input in fixed-size blocks with bounded memory: the calling
+ * thread reads blocks, num_workers threads scan them, and a writer thread
+ * prints the results in order as soon as they are ready. The stages pass
+ * blocks through bounded lock-free rings, so memory stays at the budget no
+ * matter how large the input is. "-" reads standard input.
+ * With --trace the reader traces into TRACE_MAIN, worker t into 1 + t and
+ * the writer into 1 + num_workers.
+ * @param filename Input filename, or "-" for standard input
+ * @param max_lines Maximum number of lines to print
+ * @param num_workers Number of find_max worker threads
+ * @param budget_bytes Memory budget for the input blocks
+ * @param out_fd File descriptor the results are written to
+ * @param lines_written Set to the number of lines printed
+ * @return int 0 on success, -1 on failure
+ */
+int stream_run(const char* filename, int max_lines, int num_workers, size_t budget_bytes, int out_fd, int* lines_written)
+{
+    int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    stream_t stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.num_blocks = (int)(budget_bytes / STREAM_BLOCK_SIZE);
+    if (stream.num_blocks < 2) {
+        stream.num_blocks = 2; // The reader holds one block while the rest are in flight
+    }
+    stream.max_lines = max_lines;
+    stream.out_fd = out_fd;
+    stream.num_workers = num_workers;
+    atomic_init(&stream.next_slot, 0);
+    atomic_init(&stream.total_blocks, -1);
+    atomic_init(&stream.stop, 0);
+
+    stream.blocks = (stream_block_t *)calloc(stream.num_blocks, sizeof(stream_block_t));
+    if (!stream.blocks
+        || ring_init(&stream.free_blocks, stream.num_blocks) != 0
+        || ring_init(&stream.work, stream.num_blocks + num_workers) != 0
+        || ring_init(&stream.done, stream.num_blocks + 1) != 0) {
+        return -1;
+    }
+    for (int i = 0; i < stream.num_blocks; i++) {
+        stream.blocks[i].data = (char *)malloc(STREAM_BLOCK_SIZE);
+        if (!stream.blocks[i].data) {
+            return -1;
+        }
+        ring_push(&stream.free_blocks, &stream.blocks[i]);
+    }
+    instrument_memory(MEMORY_STORE, (int64_t)stream.num_blocks * STREAM_BLOCK_SIZE);
+
+    pthread_t* workers = (pthread_t *)malloc(num_workers * sizeof(pthread_t));
+    pthread_t writer;
+    if (!workers) {
+        return -1;
+    }
+    for (int i = 0; i < num_workers; i++) {
+        pthread_create(&workers[i], NULL, stream_worker, &stream);
+    }
+    trace_name(1 + num_workers, "writer");
+    pthread_create(&writer, NULL, stream_writer, &stream);
+
+    // Reader stage: fill blocks, cut them on line boundaries, carry the rest forward
+    char carry[MAX_LINE_LENGTH]; // Start of the line cut off the previous block
+    size_t carry_size = 0;
+    long seq = 0;
+    int end_of_input = 0;
+
+    while (!end_of_input && !atomic_load(&stream.stop)) {
+        stream_block_t* block = (stream_block_t *)ring_pop(&stream.free_blocks);
+        memcpy(block->data, carry, carry_size);
+        block->size = carry_size;
+        int64_t trace_start = trace_now();
+        end_of_input = fill_block(fd, block);
+        trace_event(TRACE_MAIN, "read", trace_start, "bytes", block->size - carry_size);
+
+        size_t keep = end_of_input ? block->size : block_cut(block);
+        carry_size = block->size - keep;
+        memcpy(carry, block->data + keep, carry_size);
+        block->size = keep;
+
+        if (block->size == 0) {
+            ring_push(&stream.free_blocks, block); // Nothing left to scan
+            continue;
+        }
+        block->seq = seq++;
+        ring_push(&stream.work, block);
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+
+    // No more blocks: tell the writer how many to expect and the workers to exit
+    atomic_store(&stream.total_blocks, seq);
+    ring_push(&stream.done, NULL); // The writer may be asleep on done with every block printed
+    for (int i = 0; i < num_workers; i++) {
+        ring_push(&stream.work, NULL);
+    }
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_join(writer, NULL);
+
+    *lines_written = stream.lines_written;
+
+    for (int i = 0; i < stream.num_blocks; i++) {
+        free(stream.blocks[i].data);
+        line_results_free(&stream.blocks[i].results);
+    }
+    free(stream.blocks);
+    instrument_memory(MEMORY_STORE, -(int64_t)stream.num_blocks * STREAM_BLOCK_SIZE);
+    free(workers);
+    ring_destroy(&stream.free_blocks);
+    ring_destroy(&stream.work);
+    ring_destroy(&stream.done);
+    return 0;
+}
@@ -0,0 +1,174 @@
+#define _GNU_SOURCE // CPU_SET and sched_setaffinity are hidden by the pthreads build's _XOPEN_SOURCE=500
+
+#include <stdlib.h>
+#include <sched.h>
+#include "thread_pool.h"
+
+/*
+ * thread_pool_cpu_count
+ * Counts the CPUs in this process's affinity mask, which can be fewer than
+ * the CPUs online when running under taskset, cgroups or a batch scheduler
+ * @return int Number of allowed CPUs (at least 1)
+ */
+int thread_pool_cpu_count(void)
+{
+    cpu_set_t mask;
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0) {
+        return 1;
+    }
+    int count = CPU_COUNT(&mask);
+    return count > 0 ? count : 1;
+}
+
+/*
+ * pool_thread
+ * Worker loop: pins itself if asked, then runs each posted task once
+ * @param args Pointer to the worker's pool_worker_t
+ */
+static void *pool_thread(void *args)
+{
+    pool_worker_t *worker = (pool_worker_t *)args;
+    thread_pool_t *pool = worker->pool;
+    unsigned long seen = 0; // Last generation this worker ran
+
+    if (worker->cpu >= 0) {
+        // Pin before touching any data, so first-touch pages land on this CPU's node
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        CPU_SET(worker->cpu, &mask);
+        sched_setaffinity(0, sizeof(mask), &mask); // 0 is the calling thread
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        pool_task_t task = pool->task;
+        void *task_args = pool->args + (size_t)worker->id * pool->stride;
+        pthread_mutex_unlock(&pool->lock);
+
+        task(task_args);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->remaining == 0) {
+            pthread_cond_signal(&pool->work_done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*
+ * thread_pool_init
+ * Starts the workers. With pin set, worker i is bound to the i-th CPU of the
+ * affinity mask (wrapping around when there are more workers than CPUs).
+ * @param pool Pointer to the pool
+ * @param num_threads Number of workers, or 0 for one per allowed CPU
+ * @param pin Nonzero to pin each worker to one CPU
+ * @return int 0 on success, -1 if no worker could be started
+ */
+int thread_pool_init(thread_pool_t *pool, int num_threads, int pin)
+{
+    if (num_threads <= 0) {
+        num_threads = thread_pool_cpu_count();
+    }
+
+    pool->threads = (pthread_t *)malloc(num_threads * sizeof(pthread_t));
+    pool->workers = (pool_worker_t *)malloc(num_threads * sizeof(pool_worker_t));
+    if (!pool->threads || !pool->workers) {
+        free(pool->threads);
+        free(pool->workers);
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+    pool->generation = 0;
+    pool->remaining = 0;
+    pool->stop = 0;
+    pool->task = NULL;
+    pool->args = NULL;
+    pool->stride = 0;
+    pool->num_threads = 0;
+
+    // List the allowed CPUs in order
+    cpu_set_t mask;
+    int cpus[CPU_SETSIZE];
+    int num_cpus = 0;
+    if (pin && sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &mask)) {
+                cpus[num_cpus++] = c;
+            }
+        }
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        pool->workers[i].cpu = num_cpus > 0 ? cpus[i % num_cpus] : -1;
+        if (pthread_create(&pool->threads[i], NULL, pool_thread, &pool->workers[i]) != 0) {
+            break; // Run with the workers that did start
+        }
+        pool->num_threads++;
+    }
+
+    if (pool->num_threads == 0) {
+        thread_pool_destroy(pool);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * thread_pool_run
+ * Posts a task to every worker and waits until all of them have finished it
+ * @param pool Pointer to the pool
+ * @param task Function each worker runs
+ * @param args Argument of worker 0
+ * @param stride Bytes between consecutive workers' arguments
+ */
+void thread_pool_run(thread_pool_t *pool, pool_task_t task, void *args, size_t stride)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->args = (char *)args;
+    pool->stride = stride;
+    pool->remaining = pool->num_threads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work_ready);
+    while (pool->remaining > 0) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * thread_pool_destroy
+ * Stops the workers, joins them and releases the pool
+ * @param pool Pointer to the pool
+ */
+void thread_pool_destroy(thread_pool_t *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool->workers);
+    pool->threads = NULL;
+    pool->workers = NULL;
+    pool->num_threads = 0;
+}
@@ -0,0 +1,39 @@
+#ifndef FUSED_SCAN_H__
+#define FUSED_SCAN_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Structure to hold the per-line max values found in one byte range
+typedef struct line_results {
+    int* values; // Max value of each line, in file order
+    int count; // Number of lines found
+    int capacity; // Number of values allocated
+} line_results_t;
+
+// Function prototype to pick the fused implementation matching a max kernel name
+void fused_scan_select(const char* kernel_name);
+
+// Function prototype to split lines and compute their max values in one pass
+int fused_scan(const char* data, size_t size, int max_lines, line_results_t* results);
+
+// Function prototype to bound the bytes that can hold the first max_lines lines
+size_t fused_prefix_size(size_t size, int max_lines);
+
+// Function prototype to cut a buffer into byte ranges that start on line boundaries
+void fused_split(const char* data, size_t size, int num_parts, size_t* bounds);
+
+// Function prototype to join the per-range results in order, keeping at most max_lines values
+int line_results_join(line_results_t* parts, int num_parts, int max_lines, int** values);
+
+// Function prototype to release one range's results
+void line_results_free(line_results_t* results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
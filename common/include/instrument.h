@@ -0,0 +1,113 @@
+#ifndef INSTRUMENT_H__
+#define INSTRUMENT_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INSTRUMENT_MAIN 0 // Slot of the thread that runs main(), worker t records into slot 1 + t
+#define MEMORY_SAMPLE_US 2000 // How often the sampler thread reads the resident set size
+#define MEMORY_SAMPLES (1 << 16) // Samples kept, older ones are overwritten (about two minutes)
+
+// Phases every program is timed in, the same names in every backend
+typedef enum phase {
+    PHASE_READ = 0, // Loading the input (file reads, mapping, indexing)
+    PHASE_DISTRIBUTE, // Getting lines to the ranks (broadcast, scatter, shared copy)
+    PHASE_COMPUTE, // Scanning lines for their max values
+    PHASE_GATHER, // Bringing results together (joins, reduces, MPI gathers)
+    PHASE_FORMAT, // Turning results into text or binary
+    PHASE_WRITE, // Writing the results out
+    NUM_PHASES,
+} phase_t;
+
+// Hardware counters read around every phase with --counters
+typedef enum counter {
+    COUNTER_CYCLES = 0, // CPU cycles
+    COUNTER_INSTRUCTIONS, // Instructions retired
+    COUNTER_LLC_MISSES, // Last-level cache misses
+    COUNTER_BRANCH_MISSES, // Mispredicted branches
+    NUM_COUNTERS,
+} counter_t;
+
+// What the tracked allocations hold
+typedef enum memory_kind {
+    MEMORY_STORE = 0, // Line stores: input bytes and line offsets
+    MEMORY_RESULTS, // Max values, --stats columns and formatted text
+    MEMORY_MPI, // Buffers that only exist to send or receive (local results, waves, windows)
+    NUM_MEMORY_KINDS,
+} memory_kind_t;
+
+// Memory of one process, kept in the record of slot INSTRUMENT_MAIN
+typedef struct memory_record {
+    char host[64]; // Node the process ran on
+    uint64_t vm_hwm_kb; // Peak resident set size (VmHWM) when the report was written
+    uint64_t vm_peak_kb; // Peak virtual memory size (VmPeak)
+    uint64_t sampled_peak_kb; // Largest resident set size the sampler saw
+    uint64_t samples; // Number of samples taken
+    int64_t peak_bytes[NUM_MEMORY_KINDS]; // Most bytes each kind held at once
+} memory_record_t;
+
+// Totals of one phase on one thread
+typedef struct phase_totals {
+    int64_t first_start_ns; // Wall clock (CLOCK_REALTIME) of the first start, 0 if the phase never ran
+    int64_t last_end_ns; // Wall clock of the last stop
+    int64_t wall_ns; // Wall time summed over every start/stop pair
+    int64_t user_ns; // RUSAGE_THREAD user CPU time
+    int64_t sys_ns; // RUSAGE_THREAD system CPU time
+    uint64_t bytes; // Bytes the phase handled
+    uint64_t calls; // Number of start/stop pairs
+    uint64_t counters[NUM_COUNTERS]; // Hardware counts, user space only (--counters)
+    uint64_t peak_rss_kb; // Largest resident set size of the process sampled during the phase
+} phase_totals_t;
+
+// Every phase of one thread, on its own cache lines so threads never share one
+typedef struct thread_record {
+    phase_totals_t phases[NUM_PHASES];
+    uint32_t counters_valid; // Bit c set when counter c was counted on this thread
+    memory_record_t memory; // Process memory (slot INSTRUMENT_MAIN only)
+} __attribute__((aligned(64))) thread_record_t;
+
+// Clocks taken when a phase starts
+typedef struct phase_mark {
+    int64_t wall_ns;
+    int64_t user_ns;
+    int64_t sys_ns;
+    uint64_t counters[NUM_COUNTERS]; // Running hardware counts, when counters_valid is nonzero
+    uint32_t counters_valid; // Bit c set when counters[c] was read
+} phase_mark_t;
+
+// Function prototype to start recording into num_slots thread records (nothing is recorded before this)
+int instrument_init(int num_slots);
+
+// Function prototype to add hardware counters to every phase, -1 (with a warning) if the system has none
+int instrument_counters_init(void);
+
+// Function prototype to check whether recording was started
+int instrument_enabled(void);
+
+// Function prototype to take the clocks at the start of a phase on the calling thread
+void instrument_start(phase_mark_t* mark);
+
+// Function prototype to add the time since mark and bytes to the calling thread's slot
+void instrument_stop(const phase_mark_t* mark, int slot, phase_t phase, uint64_t bytes);
+
+// Function prototype to add (or with a negative count, take away) bytes held by tracked allocations
+void instrument_memory(memory_kind_t kind, int64_t bytes);
+
+// Function prototype to get the records and their count
+const thread_record_t* instrument_records(int* num_slots);
+
+// Function prototype to write the records of every rank as a JSON report
+int instrument_write_json(const char* path, const char* program, const thread_record_t* records,
+                          int num_ranks, const int* rank_slots);
+
+// Function prototype to stop recording and free the records
+void instrument_free(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
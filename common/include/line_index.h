@@ -0,0 +1,58 @@
+#ifndef LINE_INDEX_H__
+#define LINE_INDEX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "line_store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LINE_INDEX_MAGIC "LIDX" // First four bytes of a line index file
+#define LINE_INDEX_VERSION 1 // Layout version
+#define LINE_INDEX_SUFFIX ".idx" // Default sidecar name is the input name plus this
+
+// Header at the start of a line index file. It is followed by num_lines + 1
+// uint64_t offsets, line i spanning [offsets[i], offsets[i + 1]) of the input,
+// which is exactly the offsets array line_store_index builds.
+typedef struct line_index_header {
+    char magic[4]; // LINE_INDEX_MAGIC
+    uint32_t version; // LINE_INDEX_VERSION
+    uint64_t split_length; // Length lines were cut at (0 for whole lines, as with --long-lines)
+    uint64_t file_size; // Size of the input when it was indexed
+    int64_t file_mtime_sec; // Modification time of the input when it was indexed
+    int64_t file_mtime_nsec;
+    uint64_t num_lines; // Number of lines in the input
+    uint64_t reserved[2]; // Pads the header to 64 bytes
+} line_index_header_t;
+
+// Structure to hold an open, memory-mapped line index
+typedef struct line_index {
+    const unsigned char* map; // Whole file
+    size_t size; // Bytes in the file
+    const line_index_header_t* header; // Header at the start of the map
+    const uint64_t* offsets; // num_lines + 1 line offsets
+    int num_lines; // Number of lines indexed
+} line_index_t;
+
+// Function prototype to index every line of a file and write the offsets to index_path
+int line_index_build(const char* filename, const char* index_path);
+
+// Function prototype to map an index and check it still matches the input and the current line cut
+int line_index_open(line_index_t* index, const char* index_path, const char* filename);
+
+// Function prototype to unmap an index
+void line_index_close(line_index_t* index);
+
+// Function prototype to load lines [first, first + count) of a file, reading only their bytes
+int line_index_load(line_store_t* store, const char* filename, const line_index_t* index, int use_mmap, int first, int count);
+
+// Function prototype to load lines [first, first + count), through the index at index_path when it is not NULL
+int line_store_load(line_store_t* store, const char* filename, const char* index_path, int use_mmap, int first, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
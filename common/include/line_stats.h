@@ -0,0 +1,66 @@
+#ifndef LINE_STATS_H__
+#define LINE_STATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "line_store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Statistics that can be selected with --stats (max is always computed)
+#define STAT_MAX 0x1 // Maximum signed char value of each line, floored at 0
+#define STAT_MIN 0x2 // Minimum signed char value of each line
+#define STAT_MEAN 0x4 // Mean signed char value of each line
+#define STAT_HIST 0x8 // Count of every byte value over all lines
+#define STAT_ALL 0xf
+
+#define HIST_BINS 256 // One bin per byte value
+#define HIST_LANES 4 // Sub-histograms, so repeated bytes do not wait on each other's increments
+
+#define STATS_LINE_MAX 64 // Longest "<index>: <max> <min> <mean>\n" line
+
+// Per-line results, one array per selected statistic (NULL when not selected)
+typedef struct stats_columns {
+    unsigned mask; // STAT_* bits that were computed
+    int* max; // Maximum of each line
+    int* min; // Minimum of each line (STAT_MIN)
+    double* mean; // Mean of each line (STAT_MEAN)
+} stats_columns_t;
+
+// Private byte counts of one thread, merged with histogram_merge when all threads are done
+typedef struct byte_histogram {
+    uint64_t bins[HIST_LANES][HIST_BINS];
+} byte_histogram_t;
+
+// Function prototype to parse a comma list of max, min, mean and hist into STAT_* bits
+int stats_parse(const char* list, unsigned* mask);
+
+// Function prototype to allocate the min and mean columns the mask selects (max is supplied by the caller)
+int stats_columns_alloc(stats_columns_t* cols, unsigned mask, int* max_values, int count);
+
+// Function prototype to get the bytes of the columns for count lines (max column included)
+size_t stats_columns_bytes(const stats_columns_t* cols, int count);
+
+// Function prototype to free the columns allocated by stats_columns_alloc
+void stats_columns_free(stats_columns_t* cols);
+
+// Function prototype to compute the selected statistics of lines [first, last) in one pass, storing line i at index i - out_first
+void stats_scan_lines(const line_store_t* store, int first, int last, stats_columns_t* cols, int out_first, byte_histogram_t* hist);
+
+// Function prototype to add a thread's private bins into a total
+void histogram_merge(uint64_t* total, const byte_histogram_t* hist);
+
+// Function prototype to format results as "<index>: <max> [<min>] [<mean>]\n" lines into a new buffer
+char* stats_format_alloc(const stats_columns_t* cols, int first_index, int count, size_t* length);
+
+// Function prototype to write the nonzero histogram bins as "<byte>: <count>\n" lines after a header
+int stats_write_histogram(int fd, const uint64_t* total);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
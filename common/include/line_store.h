@@ -0,0 +1,70 @@
+#ifndef LINE_STORE_H__
+#define LINE_STORE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAX_LINE_LENGTH 3000 // Max length of a single line
+
+// Structure to hold the lines of an input file as views into one byte buffer
+typedef struct line_store {
+    const char* data; // Line bytes (packed heap arena or read-only file mapping)
+    size_t data_size; // Number of bytes in data
+    uint64_t* offsets; // num_lines + 1 offsets, line i spans [offsets[i], offsets[i + 1]) (NULL if not indexed)
+    int num_lines; // Number of lines in the store
+    int mapped; // Nonzero when data is an mmap of the input file
+} line_store_t;
+
+// Function prototype to read up to max_lines lines of a file into one packed buffer
+int line_store_read(line_store_t* store, const char* filename, int max_lines);
+
+// Function prototype to map a file and index up to max_lines lines
+int line_store_map(line_store_t* store, const char* filename, int max_lines);
+
+// Function prototypes to load the raw bytes without building the offsets array
+int line_store_read_bytes(line_store_t* store, const char* filename, int max_lines);
+int line_store_map_bytes(line_store_t* store, const char* filename, int max_lines);
+
+// Function prototype to build the offsets array for bytes already in store->data
+int line_store_index(line_store_t* store, int max_lines);
+
+// Function prototype to set the length after which lines are cut (0 keeps them whole)
+void line_store_set_max_length(size_t max_length);
+
+// Function prototype to get the length after which lines are cut (0 when they are kept whole)
+size_t line_store_max_length(void);
+
+// Function prototype to get the bytes the store holds (data and offsets)
+size_t line_store_bytes(const line_store_t* store);
+
+// Function prototype to release the store
+void line_store_free(line_store_t* store);
+
+/*
+ * line_store_line
+ * Returns a view of line i without its trailing newline
+ * @param store Pointer to the line store
+ * @param i Line index
+ * @param length Set to the number of bytes in the line
+ * @return const char* Pointer to the first byte of the line
+ */
+static inline const char* line_store_line(const line_store_t* store, int i, size_t* length)
+{
+    uint64_t start = store->offsets[i];
+    uint64_t end = store->offsets[i + 1];
+    if (end > start && store->data[end - 1] == '\n') {
+        end--; // Drop the newline
+    }
+    *length = (size_t)(end - start);
+    return store->data + start;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
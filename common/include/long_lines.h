@@ -0,0 +1,45 @@
+#ifndef LONG_LINES_H__
+#define LONG_LINES_H__
+
+#include <stddef.h>
+#include "line_store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One piece of a line longer than the --long-lines threshold
+typedef struct line_chunk {
+    int line; // Index of the line the piece belongs to
+    const char* data; // First byte of the piece
+    size_t length; // Number of bytes in the piece
+} line_chunk_t;
+
+// Pieces of all the long lines in a range, scanned in parallel and then combined per line
+typedef struct long_lines {
+    line_chunk_t* chunks; // Pieces in line order
+    int* values; // Max value of each piece
+    int num_chunks; // Number of pieces
+    int next; // Next piece to claim with long_lines_claim
+} long_lines_t;
+
+// Function prototype to cut the lines of [first, last) longer than threshold into pieces of about threshold bytes
+int long_lines_plan(const line_store_t* store, int first, int last, size_t threshold, long_lines_t* plan);
+
+// Function prototype to compute the max value of pieces [first, last)
+void long_lines_scan(long_lines_t* plan, int first, int last);
+
+// Function prototype to scan pieces claimed one at a time until none are left (safe to call from every thread)
+void long_lines_claim(long_lines_t* plan);
+
+// Function prototype to store each long line's max value, line i at index i - out_first
+void long_lines_combine(const long_lines_t* plan, int* max_values, int out_first);
+
+// Function prototype to release the pieces
+void long_lines_free(long_lines_t* plan);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
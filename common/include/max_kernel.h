@@ -0,0 +1,43 @@
+#ifndef MAX_KERNEL_H__
+#define MAX_KERNEL_H__
+
+#include <stddef.h>
+#include "options.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Signature shared by the scalar and vector implementations
+typedef int (*max_kernel_fn)(const char* line, size_t length);
+
+// Implementation picked by max_kernel_select (scalar until then)
+extern max_kernel_fn max_kernel_impl;
+
+// Function prototype to pick an implementation by name (or the best one the CPU supports for NULL/"auto") and semantics
+int max_kernel_select(const char* name, semantics_t semantics);
+
+// Function prototype to get the name of the selected implementation
+const char* max_kernel_name(void);
+
+// Function prototype to get what the selected implementation takes the max over
+semantics_t max_kernel_semantics(void);
+
+/*
+ * line_max
+ * Finds the maximum value in a line under the selected semantics: by default
+ * the maximum signed char value, or 0 if every byte is negative
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum value
+ */
+static inline int line_max(const char* line, size_t length)
+{
+    return max_kernel_impl(line, length);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef OPTIONS_H__
+#define OPTIONS_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEFAULT_GRAIN 256 // Default number of lines per scheduling chunk
+
+// Usage text for the optional flags shared by all three programs
+#define OPTIONS_USAGE \
+    "Options:\n" \
+    "  --mmap              Map the input file read-only instead of copying each line\n" \
+    "  --kernel <name>     Max kernel: auto, scalar, sse2, ssse3, avx2 or avx512 (default auto)\n" \
+    "  --semantics <name>  What the max is taken over: signed bytes (default), unsigned bytes or UTF-8 code points\n" \
+    "  --fused             Find line boundaries and max values in one pass over byte ranges\n" \
+    "  --schedule <name>   Line scheduling: steal (Pthreads default), static (default elsewhere) or dynamic (MPI)\n" \
+    "  --grain <lines>     (Pthreads, MPI) Lines per scheduling chunk (default 256)\n" \
+    "  --output <file>     Write the results to a file instead of standard output\n" \
+    "  --format <name>     Results format: text (default), binary or rle (see tools/read_results)\n" \
+    "  --stats <list>      Statistics computed in the same pass as max: min, mean, hist or all (text format)\n" \
+    "  --partition <name>  Split lines by count: lines (default), or by equal byte counts: bytes\n" \
+    "  --long-lines <bytes> Keep lines whole and scan lines longer than <bytes> in parallel pieces of that size\n" \
+    "  --index <file>      Take the line offsets from an index made by tools/build_index instead of scanning for them\n" \
+    "  --lines <a>:<b>     Process only lines [a, b) of the file (either end may be left out), numbered as in the file\n" \
+    "  --report <file>     Write per-phase, per-thread (and per-rank) timings and byte counts as JSON\n" \
+    "  --counters          Add cycles, instructions, LLC and branch misses (perf_event_open) to every --report phase\n" \
+    "  --trace <file>      Write a Chrome trace-event timeline of every thread (and rank) for Perfetto or chrome://tracing\n" \
+    "  --pin               (Pthreads) Pin threads to CPUs and have each first-touch its share of the input\n" \
+    "  --stream            (Pthreads) Pipeline the input in fixed-size blocks with bounded memory\n" \
+    "  --budget <MiB>      (Pthreads) Memory budget for --stream blocks (default 64)\n" \
+    "  --dist <mode>       (MPI) How ranks get their lines: bcast (default), mpiio, scatter, shared or pipeline\n" \
+    "  --waves <n>         (MPI) Waves the input is sent in with --dist pipeline (default 8)\n"
+
+// How the MPI program gets the input lines to each rank
+typedef enum dist_mode {
+    DIST_BCAST = 0, // Rank 0 reads the file and broadcasts it
+    DIST_MPIIO, // Every rank reads its own byte range with MPI-IO
+    DIST_SCATTER, // Rank 0 reads the file and scatters each rank only its lines
+    DIST_SHARED, // One rank per node reads the file into memory shared by the node's ranks
+    DIST_PIPELINE, // Rank 0 reads the file and scatters it in waves that overlap with the scan
+} dist_mode_t;
+
+// How lines are handed to threads or ranks
+typedef enum schedule_mode {
+    SCHEDULE_STEAL = 0, // (Pthreads) Chunks of lines in per-thread deques with work stealing
+    SCHEDULE_STATIC, // One fixed range of lines per thread or rank
+    SCHEDULE_DYNAMIC, // (MPI) Ranks take chunks from a shared counter with MPI_Fetch_and_op
+} schedule_mode_t;
+
+// How a set of lines is cut into one contiguous range per worker
+typedef enum partition_mode {
+    PARTITION_LINES = 0, // Equal numbers of lines
+    PARTITION_BYTES, // Equal numbers of bytes, from a prefix sum of line lengths
+} partition_mode_t;
+
+// What a line's max value is taken over
+typedef enum semantics {
+    SEMANTICS_SIGNED = 0, // Signed char values, floored at 0 (non-ASCII bytes never count)
+    SEMANTICS_UNSIGNED, // Unsigned byte values
+    SEMANTICS_CODEPOINT, // Unicode code points of the UTF-8 decoded line (U+FFFD for invalid sequences)
+} semantics_t;
+
+// How the results are written
+typedef enum output_format {
+    FORMAT_TEXT = 0, // One "<line>: <max>" text line per input line
+    FORMAT_BINARY, // Binary header plus one value per line (results_file.h)
+    FORMAT_RLE, // Binary header plus run-length encoded values
+} output_format_t;
+
+// Structure to hold the optional command-line flags
+typedef struct run_options {
+    int use_mmap; // Map the input file instead of reading it line by line
+    const char* kernel; // Name of the max kernel, NULL to pick from CPUID
+    semantics_t semantics; // What the max is taken over
+    const char* output; // File the results are written to, NULL for standard output
+    output_format_t format; // Results format
+    unsigned stats; // STAT_* bits from line_stats.h, STAT_MAX unless --stats adds more
+    int fused; // Split lines and compute max values in one pass over raw byte ranges
+    dist_mode_t dist; // MPI input distribution mode
+    int waves; // Number of waves for --dist pipeline (0 for the default)
+    schedule_mode_t schedule; // Line scheduling policy
+    int grain; // Lines per scheduling chunk (0 for DEFAULT_GRAIN)
+    partition_mode_t partition; // How static line ranges are cut
+    size_t long_lines; // Threshold above which a line is split into parallel pieces (0 keeps the 2999-byte line cut)
+    const char* index; // Line index file from tools/build_index, NULL to find the lines by scanning
+    int line_first; // First line of the file to process (--lines)
+    int line_last; // One past the last line to process, -1 for the end of the file
+    const char* report; // JSON instrumentation report file, NULL for none
+    const char* trace; // Chrome trace-event timeline file, NULL for none
+    int counters; // Read hardware counters around every --report phase
+    int pin; // Pin worker threads to CPUs and place their data by first touch
+    int stream; // Run the bounded-memory reader/worker/writer pipeline
+    int budget_mb; // Memory budget for the pipeline blocks, in MiB
+} run_options_t;
+
+// Function prototype to parse the flags that follow the positional arguments
+int parse_options(int argc, char* argv[], int first, run_options_t* options);
+
+// Function prototype to get how many lines to load from line_first on, given the max_lines argument
+int options_line_count(const run_options_t* options, int max_lines);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef OUTPUT_H__
+#define OUTPUT_H__
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RESULT_LINE_MAX 25 // Longest "<index>: <value>\n" line: two 11-character ints, ": " and '\n'
+
+// Function prototype to format count results as "<index>: <value>\n" lines, numbering from first_index
+size_t results_format(char* out, const int* values, int first_index, int count);
+
+// Function prototype to format results into a new buffer sized for them
+char* results_format_alloc(const int* values, int first_index, int count, size_t* length);
+
+// Function prototype to write a list of buffers in order, retrying partial writes
+int results_write(int fd, struct iovec* iov, int count);
+
+// Function prototype to open the results file, or return standard output when path is NULL
+int results_open(const char* path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
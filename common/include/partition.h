@@ -0,0 +1,18 @@
+#ifndef PARTITION_H__
+#define PARTITION_H__
+
+#include "line_store.h"
+#include "options.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Function prototype to cut a store's lines into contiguous ranges, one per part
+void partition_lines(const line_store_t* store, int num_parts, partition_mode_t mode, int* bounds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef RESULTS_FILE_H__
+#define RESULTS_FILE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RESULTS_MAGIC "MAXR" // First four bytes of a binary results file
+#define RESULTS_VERSION 1 // Layout version
+#define RESULTS_RLE 1 // Header flag: values are stored as runs
+
+// Header at the start of a binary results file. It is followed by either
+// count values of width bytes each, or (with RESULTS_RLE) num_runs uint64_t
+// exclusive run ends and then num_runs values of width bytes each.
+typedef struct results_header {
+    char magic[4]; // RESULTS_MAGIC
+    uint32_t version; // RESULTS_VERSION
+    uint32_t flags; // RESULTS_RLE or 0
+    uint32_t width; // Bytes per value: 1 (uint8_t) when every value fits, else 4 (int32_t)
+    uint64_t count; // Number of lines
+    uint64_t num_runs; // Number of runs (0 without RESULTS_RLE)
+} results_header_t;
+
+// Structure to hold an open, memory-mapped results file
+typedef struct results_file {
+    const unsigned char* map; // Whole file
+    size_t size; // Bytes in the file
+    const results_header_t* header; // Header at the start of the map
+    const uint64_t* run_ends; // Exclusive end line of each run (RLE files only)
+    const unsigned char* values; // Per-line or per-run values
+} results_file_t;
+
+// Function prototype to write the results as a binary file, run-length encoded if rle is set
+int results_file_write(int fd, const int* values, int count, int rle);
+
+// Function prototype to map a binary results file and check its header
+int results_file_open(results_file_t* file, const char* path);
+
+// Function prototype to look up one line's value
+int results_file_get(const results_file_t* file, uint64_t index);
+
+// Function prototype to copy the values of lines [first, first + count) into out
+void results_file_range(const results_file_t* file, uint64_t first, uint64_t count, int* out);
+
+// Function prototype to unmap the file
+void results_file_close(results_file_t* file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
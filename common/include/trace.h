@@ -0,0 +1,59 @@
+#ifndef TRACE_H__
+#define TRACE_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_MAIN 0 // Slot of the thread that runs main(), worker t records into slot 1 + t
+#define TRACE_CAPACITY (1 << 17) // Events kept per thread, older ones are overwritten once it is full
+
+// One timed span on one thread
+typedef struct trace_event {
+    int64_t start_ns; // Wall clock (CLOCK_REALTIME) at the start
+    int64_t end_ns; // Wall clock at the end
+    const char* name; // Static string naming the span
+    const char* arg_name; // Static string naming arg, NULL for none
+    uint64_t arg; // Lines, bytes or chunk count of the span
+} trace_event_t;
+
+// Runs a statement (such as an MPI call) and records it as one span on a slot
+#define TRACE_CALL(slot, name, statement) \
+    do { \
+        int64_t trace_start_ = trace_now(); \
+        statement; \
+        trace_event((slot), (name), trace_start_, NULL, 0); \
+    } while (0)
+
+// Function prototype to start tracing into num_slots per-thread rings (nothing is recorded before this)
+int trace_init(int num_slots);
+
+// Function prototype to name a slot's thread in the viewer (slots are "main" and "worker t" otherwise)
+void trace_name(int slot, const char* name);
+
+// Function prototype to read the wall clock, 0 without a system call while tracing is off
+int64_t trace_now(void);
+
+// Function prototype to record a span from start_ns until now on the calling thread's slot
+void trace_event(int slot, const char* name, int64_t start_ns, const char* arg_name, uint64_t arg);
+
+// Function prototype to get the earliest start still in any ring (INT64_MAX if there is none)
+int64_t trace_first_ns(void);
+
+// Function prototype to format this process's events as comma-separated Chrome trace events
+char* trace_format_alloc(int pid, const char* process_name, int64_t base_ns, size_t* length);
+
+// Function prototype to write formatted events as a trace file that Perfetto and chrome://tracing open
+int trace_write_file(const char* path, const char* events, size_t length);
+
+// Function prototype to stop tracing and free the rings
+void trace_free(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fused_scan.h"
+#include "line_store.h"
+#include "max_kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FUSED_SCAN_X86 1
+#endif
+
+// Structure to hold the state of the line being scanned
+typedef struct scan_state {
+    size_t line_start; // Offset of the first byte of the current line
+    int max; // Max value seen so far in the current line
+} scan_state_t;
+
+typedef int (*fused_scan_fn)(const char* data, size_t size, int max_lines, line_results_t* results);
+
+/*
+ * results_push
+ * Appends one line's max value, growing the array when it is full
+ * @param results Pointer to the results
+ * @param value Max value of the line
+ * @return int 0 on success, -1 on allocation failure
+ */
+static int results_push(line_results_t* results, int value)
+{
+    if (results->count == results->capacity) {
+        int capacity = results->capacity ? results->capacity * 2 : 4096;
+        int* grown = (int *)realloc(results->values, (size_t)capacity * sizeof(int));
+        if (!grown) {
+            return -1;
+        }
+        results->values = grown;
+        results->capacity = capacity;
+    }
+    results->values[results->count++] = value;
+    return 0;
+}
+
+/*
+ * scan_bytes
+ * Scalar state machine over [from, to). Splits lines at newlines and after
+ * MAX_LINE_LENGTH - 1 bytes, the same way line_store_index does.
+ * @param data Pointer to the range
+ * @param from First byte to scan
+ * @param to One past the last byte to scan
+ * @param state Pointer to the current line state
+ * @param max_lines Stop after this many lines
+ * @param results Pointer to the results
+ * @return int 0 on success, -1 on allocation failure
+ */
+static int scan_bytes(const char* data, size_t from, size_t to, scan_state_t* state, int max_lines, line_results_t* results)
+{
+    for (size_t j = from; j < to && results->count < max_lines; j++) {
+        char c = data[j];
+        if (c == '\n') {
+            if (results_push(results, state->max) != 0) {
+                return -1;
+            }
+            state->max = 0;
+            state->line_start = j + 1;
+            continue;
+        }
+        if (c > state->max) {
+            state->max = c;
+        }
+        if (j + 1 - state->line_start == MAX_LINE_LENGTH - 1) {
+            // fgets would have filled its buffer here
+            if (results_push(results, state->max) != 0) {
+                return -1;
+            }
+            state->max = 0;
+            state->line_start = j + 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * fused_scan_scalar
+ * Byte-by-byte fused scan
+ * @param data Pointer to a range that starts on a line boundary
+ * @param size Number of bytes in the range
+ * @param max_lines Stop after this many lines
+ * @param results Pointer to the results to append to
+ * @return int 0 on success, -1 on allocation failure
+ */
+static int fused_scan_scalar(const char* data, size_t size, int max_lines, line_results_t* results)
+{
+    scan_state_t state = { 0, 0 };
+    if (scan_bytes(data, 0, size, &state, max_lines, results) != 0) {
+        return -1;
+    }
+    if (state.line_start < size && results->count < max_lines) {
+        return results_push(results, state.max); // Last line has no newline
+    }
+    return 0;
+}
+
+/*
+ * fused_scan_lines
+ * Fused scan for the unsigned and code point semantics: finds each line end
+ * with memchr and hands the whole line to line_max, so a multi-byte sequence
+ * is never split between two vector blocks
+ * @param data Pointer to a range that starts on a line boundary
+ * @param size Number of bytes in the range
+ * @param max_lines Stop after this many lines
+ * @param results Pointer to the results to append to
+ * @return int 0 on success, -1 on allocation failure
+ */
+static int fused_scan_lines(const char* data, size_t size, int max_lines, line_results_t* results)
+{
+    size_t start = 0;
+    while (start < size && results->count < max_lines) {
+        size_t limit = size - start < MAX_LINE_LENGTH - 1 ? size - start : MAX_LINE_LENGTH - 1;
+        const char* newline = memchr(data + start, '\n', limit);
+        size_t length = newline ? (size_t)(newline - (data + start)) : limit; // Split like fgets
+
+        if (results_push(results, line_max(data + start, length)) != 0) {
+            return -1;
+        }
+        start += length + (newline ? 1 : 0);
+    }
+    return 0;
+}
+
+#ifdef FUSED_SCAN_X86
+
+/*
+ * reduce_max_256
+ * Reduces 32 signed bytes to their maximum
+ * @param v Vector to reduce
+ * @return int Maximum lane value
+ */
+__attribute__((target("avx2")))
+static inline int reduce_max_256(__m256i v)
+{
+    __m128i h = _mm_max_epi8(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    h = _mm_max_epi8(h, _mm_srli_si128(h, 8));
+    h = _mm_max_epi8(h, _mm_srli_si128(h, 4));
+    h = _mm_max_epi8(h, _mm_srli_si128(h, 2));
+    h = _mm_max_epi8(h, _mm_srli_si128(h, 1));
+    return (signed char)(_mm_cvtsi128_si32(h) & 0xff);
+}
+
+/*
+ * fused_scan_avx2
+ * AVX2 fused scan, 32 bytes per step. Blocks without a newline are folded
+ * into a running max; blocks with newlines are masked lane by lane so every
+ * byte is still loaded only once. Blocks where a MAX_LINE_LENGTH split could
+ * land go through the scalar state machine.
+ * @param data Pointer to a range that starts on a line boundary
+ * @param size Number of bytes in the range
+ * @param max_lines Stop after this many lines
+ * @param results Pointer to the results to append to
+ * @return int 0 on success, -1 on allocation failure
+ */
+__attribute__((target("avx2,bmi")))
+static int fused_scan_avx2(const char* data, size_t size, int max_lines, line_results_t* results)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i lane = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+                                          16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    scan_state_t state = { 0, 0 };
+    __m256i acc = _mm256_setzero_si256(); // Running max of the current line (vector part)
+    size_t j = 0;
+
+    while (j + 32 <= size && results->count < max_lines) {
+        if (j + 32 >= state.line_start + MAX_LINE_LENGTH - 1) {
+            // A split could fall inside this block
+            int folded = reduce_max_256(acc);
+            state.max = folded > state.max ? folded : state.max;
+            acc = _mm256_setzero_si256();
+            if (scan_bytes(data, j, j + 32, &state, max_lines, results) != 0) {
+                return -1;
+            }
+            j += 32;
+            continue;
+        }
+
+        __m256i block = _mm256_loadu_si256((const __m256i *)(data + j));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+        int from = 0; // First lane of the current line in this block
+
+        while (mask && results->count < max_lines) {
+            int pos = (int)_tzcnt_u32(mask);
+            // Lanes [from, pos) finish the current line
+            __m256i in = _mm256_and_si256(_mm256_cmpgt_epi8(lane, _mm256_set1_epi8((char)(from - 1))),
+                                          _mm256_cmpgt_epi8(_mm256_set1_epi8((char)pos), lane));
+            int value = reduce_max_256(_mm256_max_epi8(acc, _mm256_and_si256(block, in)));
+            if (results_push(results, value > state.max ? value : state.max) != 0) {
+                return -1;
+            }
+            acc = _mm256_setzero_si256();
+            state.max = 0;
+            state.line_start = j + (size_t)pos + 1;
+            from = pos + 1;
+            mask &= mask - 1;
+        }
+
+        // Lanes [from, 32) start the next line
+        if (from < 32) {
+            __m256i in = _mm256_cmpgt_epi8(lane, _mm256_set1_epi8((char)(from - 1)));
+            acc = _mm256_max_epi8(acc, _mm256_and_si256(block, in));
+        }
+        j += 32;
+    }
+
+    int folded = reduce_max_256(acc);
+    state.max = folded > state.max ? folded : state.max;
+    if (scan_bytes(data, j, size, &state, max_lines, results) != 0) {
+        return -1;
+    }
+    if (state.line_start < size && results->count < max_lines) {
+        return results_push(results, state.max); // Last line has no newline
+    }
+    return 0;
+}
+
+#endif
+
+static fused_scan_fn fused_scan_impl = fused_scan_scalar;
+
+/*
+ * fused_scan_select
+ * Picks the fused implementation matching the selected max kernel, so
+ * --kernel and --semantics control both paths. Call after max_kernel_select.
+ * @param kernel_name Name returned by max_kernel_name
+ */
+void fused_scan_select(const char* kernel_name)
+{
+    fused_scan_impl = fused_scan_scalar;
+    if (max_kernel_semantics() != SEMANTICS_SIGNED) {
+        fused_scan_impl = fused_scan_lines; // The byte-at-a-time paths only know signed bytes
+        return;
+    }
+#ifdef FUSED_SCAN_X86
+    if (strcmp(kernel_name, "avx2") == 0 || strcmp(kernel_name, "avx512") == 0) {
+        fused_scan_impl = fused_scan_avx2; // AVX-512 machines reuse the AVX2 path
+    }
+#endif
+}
+
+/*
+ * fused_scan
+ * Walks a byte range once, finding line boundaries and each line's max
+ * value in the same pass, and appends the values to results
+ * @param data Pointer to a range that starts on a line boundary
+ * @param size Number of bytes in the range
+ * @param max_lines Stop after this many lines
+ * @param results Pointer to the results to append to
+ * @return int 0 on success, -1 on allocation failure
+ */
+int fused_scan(const char* data, size_t size, int max_lines, line_results_t* results)
+{
+    return fused_scan_impl(data, size, max_lines, results);
+}
+
+/*
+ * fused_prefix_size
+ * Bounds the bytes that can hold the first max_lines lines. No line is longer
+ * than MAX_LINE_LENGTH - 1 bytes, so a mapped file never has to be scanned
+ * further than that for a short run.
+ * @param size Number of bytes available
+ * @param max_lines Maximum number of lines wanted
+ * @return size_t Number of bytes to scan
+ */
+size_t fused_prefix_size(size_t size, int max_lines)
+{
+    unsigned long long bound = (unsigned long long)max_lines * (MAX_LINE_LENGTH - 1);
+    return bound < size ? (size_t)bound : size;
+}
+
+/*
+ * fused_split
+ * Cuts a buffer into num_parts byte ranges of about equal size, moving each
+ * cut forward to just past a newline so every range starts a line
+ * @param data Pointer to the buffer
+ * @param size Number of bytes in the buffer
+ * @param num_parts Number of ranges
+ * @param bounds Array of num_parts + 1 offsets, range t is [bounds[t], bounds[t + 1])
+ */
+void fused_split(const char* data, size_t size, int num_parts, size_t* bounds)
+{
+    bounds[0] = 0;
+    for (int t = 1; t < num_parts; t++) {
+        size_t cut = (size_t)((unsigned long long)size * (unsigned long long)t / (unsigned long long)num_parts);
+        if (cut <= bounds[t - 1]) {
+            cut = bounds[t - 1];
+        } else {
+            const char* newline = memchr(data + cut - 1, '\n', size - (cut - 1));
+            cut = newline ? (size_t)(newline - data) + 1 : size;
+        }
+        bounds[t] = cut;
+    }
+    bounds[num_parts] = size;
+}
+
+/*
+ * line_results_join
+ * Copies the per-range results into one array in range order
+ * @param parts Array of per-range results
+ * @param num_parts Number of ranges
+ * @param max_lines Maximum number of values to keep
+ * @param values Set to a new array holding the joined values
+ * @return int Number of values, or -1 on allocation failure
+ */
+int line_results_join(line_results_t* parts, int num_parts, int max_lines, int** values)
+{
+    int total = 0;
+    for (int t = 0; t < num_parts && total < max_lines; t++) {
+        total += parts[t].count;
+    }
+    if (total > max_lines) {
+        total = max_lines;
+    }
+
+    *values = (int *)malloc((total > 0 ? total : 1) * sizeof(int));
+    if (!*values) {
+        return -1;
+    }
+
+    int copied = 0;
+    for (int t = 0; t < num_parts && copied < total; t++) {
+        int n = parts[t].count < total - copied ? parts[t].count : total - copied;
+        memcpy(*values + copied, parts[t].values, (size_t)n * sizeof(int));
+        copied += n;
+    }
+    return total;
+}
+
+/*
+ * line_results_free
+ * Releases one range's results
+ * @param results Pointer to the results
+ */
+void line_results_free(line_results_t* results)
+{
+    free(results->values);
+    memset(results, 0, sizeof(*results));
+}
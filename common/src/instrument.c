@@ -0,0 +1,703 @@
+#define _GNU_SOURCE // RUSAGE_THREAD and syscall
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "instrument.h"
+
+#define MAX_COUNTER_GROUPS 1024 // Threads that can open a counter group in one run
+
+static thread_record_t* records = NULL; // One record per slot, NULL while recording is off
+static int num_records = 0;
+
+static int counters_on = 0; // Set by instrument_counters_init
+static char counters_error[128] = "off"; // Why the counters are missing, for the report
+static int group_fds[MAX_COUNTER_GROUPS][NUM_COUNTERS]; // Every counter opened, closed by instrument_free
+static int num_groups = 0;
+
+// The calling thread's counter group, opened on its first instrument_start
+static __thread int group_index = -1; // Index into group_fds, -1 before the first try
+static __thread int group_size = 0; // Counters in the group, 0 if none could be opened
+static __thread uint32_t group_valid = 0; // Bit c set when counter c is in the group
+
+// perf_event_open configs of the counters, indexed by counter_t
+static const uint64_t counter_configs[NUM_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+static pthread_t sampler; // Background thread sampling the resident set size
+static int sampler_running = 0; // Set while the sampler thread exists
+static int sampler_stop = 0; // Tells the sampler to exit
+static int64_t sample_ns[MEMORY_SAMPLES]; // Wall clock of each sample
+static uint64_t sample_kb[MEMORY_SAMPLES]; // Resident set size of each sample
+static uint64_t num_samples = 0; // Samples ever taken, published after the sample is written
+static uint64_t samples_peak_kb = 0; // Largest sample ever taken
+static int64_t memory_bytes[NUM_MEMORY_KINDS]; // Bytes each kind holds now
+static int64_t memory_peak[NUM_MEMORY_KINDS]; // Most bytes each kind held at once
+
+// Names of the memory kinds in the report, indexed by memory_kind_t
+static const char* const memory_names[NUM_MEMORY_KINDS] = {
+    "store_bytes", "results_bytes", "mpi_bytes",
+};
+
+// Names of the counters in the report, indexed by counter_t
+static const char* const counter_names[NUM_COUNTERS] = {
+    "cycles", "instructions", "llc_misses", "branch_misses",
+};
+
+// Names of the phases in the report, indexed by phase_t
+static const char* const phase_names[NUM_PHASES] = {
+    "read", "distribute", "compute", "gather", "format", "write",
+};
+
+/*
+ * now_ns
+ * Reads the wall clock the phases are timed with
+ * @return int64_t Nanoseconds since the epoch
+ */
+static int64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * sample_memory
+ * Reads the resident set size from /proc/self/statm every MEMORY_SAMPLE_US
+ * until told to stop, so phases can see the peak they reached and not just
+ * what was left at their end
+ * @param args Unused
+ */
+static void* sample_memory(void* args)
+{
+    (void)args;
+    int fd = open("/proc/self/statm", O_RDONLY);
+    uint64_t page_kb = (uint64_t)sysconf(_SC_PAGESIZE) / 1024;
+    struct timespec interval = { 0, MEMORY_SAMPLE_US * 1000L };
+
+    while (fd >= 0 && !__atomic_load_n(&sampler_stop, __ATOMIC_RELAXED)) {
+        char text[128];
+        ssize_t got = pread(fd, text, sizeof(text) - 1, 0);
+        unsigned long long size_pages, resident_pages;
+        if (got > 0) {
+            text[got] = '\0';
+            if (sscanf(text, "%llu %llu", &size_pages, &resident_pages) == 2) {
+                uint64_t n = num_samples;
+                sample_ns[n & (MEMORY_SAMPLES - 1)] = now_ns();
+                sample_kb[n & (MEMORY_SAMPLES - 1)] = (uint64_t)resident_pages * page_kb;
+                if (sample_kb[n & (MEMORY_SAMPLES - 1)] > samples_peak_kb) {
+                    __atomic_store_n(&samples_peak_kb, sample_kb[n & (MEMORY_SAMPLES - 1)], __ATOMIC_RELAXED);
+                }
+                __atomic_store_n(&num_samples, n + 1, __ATOMIC_RELEASE);
+            }
+        }
+        nanosleep(&interval, NULL);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return NULL;
+}
+
+/*
+ * sampled_peak_kb
+ * Finds the largest resident set size sampled between two times, counting
+ * the last sample before the start as what the span started with
+ * @param start_ns Start of the span
+ * @param end_ns End of the span
+ * @return uint64_t Peak in KB, 0 if there are no samples
+ */
+static uint64_t sampled_peak_kb(int64_t start_ns, int64_t end_ns)
+{
+    uint64_t count = __atomic_load_n(&num_samples, __ATOMIC_ACQUIRE);
+    uint64_t oldest = count > MEMORY_SAMPLES ? count - MEMORY_SAMPLES : 0;
+    uint64_t peak = 0;
+    for (uint64_t n = count; n > oldest; n--) {
+        int64_t at = sample_ns[(n - 1) & (MEMORY_SAMPLES - 1)];
+        uint64_t kb = sample_kb[(n - 1) & (MEMORY_SAMPLES - 1)];
+        if (at <= end_ns && kb > peak) {
+            peak = kb;
+        }
+        if (at < start_ns) {
+            break;
+        }
+    }
+    return peak;
+}
+
+/*
+ * instrument_init
+ * Starts recording, and the thread that samples memory. Slot INSTRUMENT_MAIN
+ * is the main thread, slot 1 + t worker t, so a program with n workers asks
+ * for n + 1 slots.
+ * @param num_slots Number of thread records
+ * @return int 0 on success, -1 on allocation failure
+ */
+int instrument_init(int num_slots)
+{
+    records = (thread_record_t *)aligned_alloc(64, (size_t)num_slots * sizeof(thread_record_t));
+    if (!records) {
+        return -1;
+    }
+    memset(records, 0, (size_t)num_slots * sizeof(thread_record_t));
+    num_records = num_slots;
+
+    // Without the sampler the phases simply carry no memory peaks
+    sampler_stop = 0;
+    sampler_running = pthread_create(&sampler, NULL, sample_memory, NULL) == 0;
+    return 0;
+}
+
+/*
+ * instrument_memory
+ * Adds bytes to (or takes them from) what a kind of allocation holds, and
+ * keeps the most it ever held. Any thread may call it.
+ * @param kind What the bytes are
+ * @param bytes Bytes allocated, negative when freed
+ */
+void instrument_memory(memory_kind_t kind, int64_t bytes)
+{
+    if (!records) {
+        return;
+    }
+    int64_t held = __atomic_add_fetch(&memory_bytes[kind], bytes, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&memory_peak[kind], __ATOMIC_RELAXED);
+    while (held > peak && !__atomic_compare_exchange_n(&memory_peak[kind], &peak, held, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/*
+ * open_counter
+ * Opens one user-space hardware counter on the calling thread, on any CPU
+ * @param config PERF_COUNT_HW_* event
+ * @param group_fd Leader of the group to join, -1 to lead a new group
+ * @return int File descriptor, -1 on failure (errno is set)
+ */
+static int open_counter(uint64_t config, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1; // Allowed at perf_event_paranoid 2, and the scan runs in user space anyway
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/*
+ * open_group
+ * Opens the calling thread's counter group, led by the cycle counter. A
+ * counter the CPU lacks is left out of the group and reported as null.
+ * @return int 0 if at least the cycle counter opened, -1 otherwise (errno is set)
+ */
+static int open_group(void)
+{
+    int index = __atomic_fetch_add(&num_groups, 1, __ATOMIC_RELAXED);
+    if (index >= MAX_COUNTER_GROUPS) {
+        errno = EMFILE;
+        return -1;
+    }
+    group_index = index;
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        group_fds[index][c] = -1;
+    }
+
+    int leader = open_counter(counter_configs[COUNTER_CYCLES], -1);
+    if (leader < 0) {
+        return -1;
+    }
+    group_fds[index][COUNTER_CYCLES] = leader;
+    group_valid = 1u << COUNTER_CYCLES;
+    group_size = 1;
+    for (int c = COUNTER_CYCLES + 1; c < NUM_COUNTERS; c++) {
+        int fd = open_counter(counter_configs[c], leader);
+        if (fd >= 0) {
+            group_fds[index][c] = fd;
+            group_valid |= 1u << c;
+            group_size++;
+        }
+    }
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return 0;
+}
+
+/*
+ * read_counters
+ * Reads the calling thread's counter group into a mark, opening the group
+ * on the thread's first call. Counts are scaled up when the kernel had to
+ * share the counters with other groups.
+ * @param mark Set to the running counts and the counters that were read
+ */
+static void read_counters(phase_mark_t* mark)
+{
+    mark->counters_valid = 0;
+    if (group_index < 0 && open_group() != 0) {
+        group_size = 0;
+    }
+    if (group_size == 0) {
+        return;
+    }
+
+    uint64_t values[3 + NUM_COUNTERS]; // nr, time enabled, time running, then one count per member
+    ssize_t expected = (ssize_t)((3 + group_size) * sizeof(uint64_t));
+    if (read(group_fds[group_index][COUNTER_CYCLES], values, sizeof(values)) != expected) {
+        return;
+    }
+    double scale = values[2] > 0 && values[2] < values[1] ? (double)values[1] / (double)values[2] : 1.0;
+    int member = 0;
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        if (group_valid & (1u << c)) {
+            mark->counters[c] = (uint64_t)((double)values[3 + member++] * scale);
+        }
+    }
+    mark->counters_valid = group_valid;
+}
+
+/*
+ * instrument_counters_init
+ * Adds cycles, instructions, last-level cache misses and branch misses to
+ * every phase. Each thread opens its own perf_event_open group on its first
+ * instrument_start. Without hardware counters (a virtual machine without a
+ * PMU, or perf_event_paranoid above 2 in a container) a warning is printed
+ * and the report carries timings only.
+ * @return int 0 if the calling thread could open its counters, -1 otherwise
+ */
+int instrument_counters_init(void)
+{
+    counters_on = 1;
+    phase_mark_t probe;
+    read_counters(&probe);
+    if (probe.counters_valid == 0) {
+        int error = errno;
+        counters_on = 0;
+        FILE* file = fopen("/proc/sys/kernel/perf_event_paranoid", "r");
+        int paranoid = 0;
+        if (!file || fscanf(file, "%d", &paranoid) != 1) {
+            paranoid = -99;
+        }
+        if (file) {
+            fclose(file);
+        }
+        snprintf(counters_error, sizeof(counters_error), "unavailable: %s (perf_event_paranoid %d)", strerror(error), paranoid);
+        fprintf(stderr, "WARNING: Hardware counters are %s, the report has timings only.\n", counters_error);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * instrument_enabled
+ * Tells whether instrument_init was called, so callers can skip work that only feeds the report
+ * @return int Nonzero when recording
+ */
+int instrument_enabled(void)
+{
+    return records != NULL;
+}
+
+/*
+ * instrument_start
+ * Takes the wall clock and the calling thread's CPU times. Does nothing
+ * (no system calls) while recording is off.
+ * @param mark Set to the clocks
+ */
+void instrument_start(phase_mark_t* mark)
+{
+    if (!records) {
+        return;
+    }
+    struct timespec now;
+    struct rusage usage;
+    clock_gettime(CLOCK_REALTIME, &now);
+    getrusage(RUSAGE_THREAD, &usage);
+    mark->wall_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    mark->user_ns = (int64_t)usage.ru_utime.tv_sec * 1000000000 + (int64_t)usage.ru_utime.tv_usec * 1000;
+    mark->sys_ns = (int64_t)usage.ru_stime.tv_sec * 1000000000 + (int64_t)usage.ru_stime.tv_usec * 1000;
+    mark->counters_valid = 0;
+    if (counters_on) {
+        read_counters(mark);
+    }
+}
+
+/*
+ * instrument_stop
+ * Adds the wall and CPU time since instrument_start, and the bytes handled,
+ * to one phase of a slot. Only the thread that owns the slot may call it.
+ * @param mark Clocks from instrument_start on the same thread
+ * @param slot Thread slot to add to (ignored if out of range)
+ * @param phase Phase the time belongs to
+ * @param bytes Bytes handled since the start
+ */
+void instrument_stop(const phase_mark_t* mark, int slot, phase_t phase, uint64_t bytes)
+{
+    if (!records || slot < 0 || slot >= num_records) {
+        return;
+    }
+    phase_mark_t end;
+    instrument_start(&end);
+
+    phase_totals_t* totals = &records[slot].phases[phase];
+    if (totals->calls == 0) {
+        totals->first_start_ns = mark->wall_ns;
+    }
+    totals->last_end_ns = end.wall_ns;
+    totals->wall_ns += end.wall_ns - mark->wall_ns;
+    totals->user_ns += end.user_ns - mark->user_ns;
+    totals->sys_ns += end.sys_ns - mark->sys_ns;
+    totals->bytes += bytes;
+    totals->calls++;
+
+    uint32_t valid = mark->counters_valid & end.counters_valid;
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        if (valid & (1u << c)) {
+            totals->counters[c] += end.counters[c] - mark->counters[c];
+        }
+    }
+    records[slot].counters_valid |= valid;
+
+    uint64_t peak_kb = sampled_peak_kb(mark->wall_ns, end.wall_ns);
+    if (peak_kb > totals->peak_rss_kb) {
+        totals->peak_rss_kb = peak_kb;
+    }
+}
+
+/*
+ * instrument_records
+ * Returns this process's records, for the MPI programs to gather, after
+ * bringing the memory record of slot INSTRUMENT_MAIN up to date: the host,
+ * VmHWM and VmPeak from /proc/self/status, the sampled peak and the most
+ * bytes each kind of tracked allocation held
+ * @param num_slots Set to the number of records
+ * @return const thread_record_t* The records (NULL while recording is off)
+ */
+const thread_record_t* instrument_records(int* num_slots)
+{
+    *num_slots = num_records;
+    if (!records) {
+        return NULL;
+    }
+
+    memory_record_t* memory = &records[INSTRUMENT_MAIN].memory;
+    if (gethostname(memory->host, sizeof(memory->host)) != 0) {
+        snprintf(memory->host, sizeof(memory->host), "unknown");
+    }
+    memory->host[sizeof(memory->host) - 1] = '\0';
+    FILE* file = fopen("/proc/self/status", "r");
+    char line[128];
+    while (file && fgets(line, sizeof(line), file) != NULL) {
+        unsigned long long kb;
+        if (sscanf(line, "VmHWM: %llu", &kb) == 1) {
+            memory->vm_hwm_kb = kb;
+        } else if (sscanf(line, "VmPeak: %llu", &kb) == 1) {
+            memory->vm_peak_kb = kb;
+        }
+    }
+    if (file) {
+        fclose(file);
+    }
+    memory->samples = __atomic_load_n(&num_samples, __ATOMIC_ACQUIRE);
+    memory->sampled_peak_kb = __atomic_load_n(&samples_peak_kb, __ATOMIC_RELAXED);
+    for (int k = 0; k < NUM_MEMORY_KINDS; k++) {
+        memory->peak_bytes[k] = __atomic_load_n(&memory_peak[k], __ATOMIC_RELAXED);
+    }
+    return records;
+}
+
+/*
+ * write_ratio
+ * Writes ", "name": numerator / denominator", or null when either count is
+ * missing or the denominator is 0
+ * @param file Open report
+ * @param name Field name
+ * @param numerator Numerator
+ * @param denominator Denominator
+ * @param known Whether both counts were counted
+ */
+static void write_ratio(FILE* file, const char* name, double numerator, double denominator, int known)
+{
+    if (known && denominator > 0) {
+        fprintf(file, ", \"%s\": %.4f", name, numerator / denominator);
+    } else {
+        fprintf(file, ", \"%s\": null", name);
+    }
+}
+
+/*
+ * write_totals
+ * Writes one phase's totals as the fields of a JSON object, leaving the
+ * object open for the caller to add to and close. With hardware counters
+ * the counts follow, with IPC, bytes per cycle and misses per KB handled;
+ * a counter the CPU lacks is null.
+ * @param file Open report
+ * @param totals Totals to write
+ * @param base_ns Wall clock the start and end times are measured from
+ * @param valid Bit c set when counter c was counted (0 writes no counters)
+ */
+static void write_totals(FILE* file, const phase_totals_t* totals, int64_t base_ns, uint32_t valid)
+{
+    fprintf(file, "{\"start_us\": %.3f, \"end_us\": %.3f, \"wall_us\": %.3f, \"user_us\": %.3f, \"sys_us\": %.3f, "
+                  "\"bytes\": %llu, \"calls\": %llu",
+            (totals->first_start_ns - base_ns) / 1e3, (totals->last_end_ns - base_ns) / 1e3, totals->wall_ns / 1e3,
+            totals->user_ns / 1e3, totals->sys_ns / 1e3, (unsigned long long)totals->bytes, (unsigned long long)totals->calls);
+    fprintf(file, ", \"peak_rss_kb\": %llu", (unsigned long long)totals->peak_rss_kb);
+    if (valid == 0) {
+        return;
+    }
+
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+        if (valid & (1u << c)) {
+            fprintf(file, ", \"%s\": %llu", counter_names[c], (unsigned long long)totals->counters[c]);
+        } else {
+            fprintf(file, ", \"%s\": null", counter_names[c]);
+        }
+    }
+    const uint64_t* counts = totals->counters;
+    double kb = totals->bytes / 1024.0;
+    write_ratio(file, "ipc", (double)counts[COUNTER_INSTRUCTIONS], (double)counts[COUNTER_CYCLES],
+                (valid & (1u << COUNTER_INSTRUCTIONS)) && (valid & (1u << COUNTER_CYCLES)));
+    write_ratio(file, "bytes_per_cycle", (double)totals->bytes, (double)counts[COUNTER_CYCLES], valid & (1u << COUNTER_CYCLES));
+    write_ratio(file, "llc_misses_per_kb", (double)counts[COUNTER_LLC_MISSES], kb, valid & (1u << COUNTER_LLC_MISSES));
+    write_ratio(file, "branch_misses_per_kb", (double)counts[COUNTER_BRANCH_MISSES], kb, valid & (1u << COUNTER_BRANCH_MISSES));
+}
+
+/*
+ * write_memory
+ * Writes one process's memory record as a JSON object
+ * @param file Open report
+ * @param memory Record to write
+ */
+static void write_memory(FILE* file, const memory_record_t* memory)
+{
+    fprintf(file, "{\"host\": \"%s\", \"vm_hwm_kb\": %llu, \"vm_peak_kb\": %llu, \"sampled_peak_kb\": %llu, \"samples\": %llu",
+            memory->host, (unsigned long long)memory->vm_hwm_kb, (unsigned long long)memory->vm_peak_kb,
+            (unsigned long long)memory->sampled_peak_kb, (unsigned long long)memory->samples);
+    for (int k = 0; k < NUM_MEMORY_KINDS; k++) {
+        fprintf(file, ", \"%s\": %lld", memory_names[k], (long long)memory->peak_bytes[k]);
+    }
+    fprintf(file, "}");
+}
+
+/*
+ * write_nodes
+ * Writes the memory of every node: the ranks on it and the sums of their
+ * peaks. Ranks rarely peak at the same moment, so the sums are an upper
+ * bound on what the node needed, which is what a per-node limit such as
+ * SLURM's --mem has to cover.
+ * @param file Open report
+ * @param all Records of every rank, rank after rank
+ * @param num_ranks Number of ranks
+ * @param rank_slots Number of records of each rank
+ */
+static void write_nodes(FILE* file, const thread_record_t* all, int num_ranks, const int* rank_slots)
+{
+    const thread_record_t** mains = (const thread_record_t **)malloc((size_t)num_ranks * sizeof(*mains));
+    int* node_of = (int *)malloc((size_t)num_ranks * sizeof(int));
+    if (!mains || !node_of) {
+        free(mains);
+        free(node_of);
+        return;
+    }
+    const thread_record_t* record = all;
+    for (int r = 0; r < num_ranks; r++) {
+        mains[r] = record;
+        node_of[r] = -1;
+        record += rank_slots[r];
+    }
+
+    fprintf(file, ",\n  \"nodes\": [");
+    int num_nodes = 0;
+    for (int r = 0; r < num_ranks; r++) {
+        if (node_of[r] >= 0) {
+            continue;
+        }
+        uint64_t hwm = 0, sampled = 0;
+        uint64_t phase_peaks[NUM_PHASES] = { 0 };
+        fprintf(file, "%s\n    {\"host\": \"%s\", \"ranks\": [", num_nodes > 0 ? "," : "", mains[r]->memory.host);
+        int count = 0;
+        for (int q = r; q < num_ranks; q++) {
+            if (strcmp(mains[q]->memory.host, mains[r]->memory.host) != 0) {
+                continue;
+            }
+            node_of[q] = num_nodes;
+            fprintf(file, "%s%d", count++ > 0 ? ", " : "", q);
+            hwm += mains[q]->memory.vm_hwm_kb;
+            sampled += mains[q]->memory.sampled_peak_kb;
+            for (int p = 0; p < NUM_PHASES; p++) {
+                uint64_t rank_peak = 0; // Every thread samples the same process, so take the largest
+                for (int s = 0; s < rank_slots[q]; s++) {
+                    if (mains[q][s].phases[p].peak_rss_kb > rank_peak) {
+                        rank_peak = mains[q][s].phases[p].peak_rss_kb;
+                    }
+                }
+                phase_peaks[p] += rank_peak;
+            }
+        }
+        fprintf(file, "], \"vm_hwm_kb\": %llu, \"sampled_peak_kb\": %llu, \"phase_peak_rss_kb\": {",
+                (unsigned long long)hwm, (unsigned long long)sampled);
+        int first = 1;
+        for (int p = 0; p < NUM_PHASES; p++) {
+            if (phase_peaks[p] > 0) {
+                fprintf(file, "%s\"%s\": %llu", first ? "" : ", ", phase_names[p], (unsigned long long)phase_peaks[p]);
+                first = 0;
+            }
+        }
+        fprintf(file, "}}");
+        num_nodes++;
+    }
+    fprintf(file, "\n  ]");
+    free(mains);
+    free(node_of);
+}
+
+/*
+ * instrument_write_json
+ * Writes a report with a summary per phase (span from the first start to
+ * the last stop on any thread, CPU time and bytes summed over threads, and
+ * throughput over the span) followed by every rank's memory and per-thread
+ * totals, and the memory of every node. Times are in microseconds from the
+ * earliest start in the report.
+ * @param path Report filename
+ * @param program Name of the backend
+ * @param all Records of every rank, rank after rank
+ * @param num_ranks Number of ranks (1 for the threaded programs)
+ * @param rank_slots Number of records of each rank
+ * @return int 0 on success, -1 on a write error
+ */
+int instrument_write_json(const char* path, const char* program, const thread_record_t* all,
+                          int num_ranks, const int* rank_slots)
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+
+    int total_slots = 0;
+    for (int r = 0; r < num_ranks; r++) {
+        total_slots += rank_slots[r];
+    }
+
+    // Phase spans across every thread of every rank
+    phase_totals_t summary[NUM_PHASES];
+    memset(summary, 0, sizeof(summary));
+    int64_t base_ns = 0;
+    uint32_t summary_valid = 0; // Counters counted on any thread
+    for (int s = 0; s < total_slots; s++) {
+        summary_valid |= all[s].counters_valid;
+        for (int p = 0; p < NUM_PHASES; p++) {
+            const phase_totals_t* totals = &all[s].phases[p];
+            if (totals->calls == 0) {
+                continue;
+            }
+            phase_totals_t* sum = &summary[p];
+            if (sum->calls == 0 || totals->first_start_ns < sum->first_start_ns) {
+                sum->first_start_ns = totals->first_start_ns;
+            }
+            if (totals->last_end_ns > sum->last_end_ns) {
+                sum->last_end_ns = totals->last_end_ns;
+            }
+            sum->user_ns += totals->user_ns;
+            sum->sys_ns += totals->sys_ns;
+            sum->bytes += totals->bytes;
+            sum->calls += totals->calls;
+            for (int c = 0; c < NUM_COUNTERS; c++) {
+                sum->counters[c] += totals->counters[c];
+            }
+            if (totals->peak_rss_kb > sum->peak_rss_kb) {
+                sum->peak_rss_kb = totals->peak_rss_kb; // The most any one process reached
+            }
+            if (base_ns == 0 || totals->first_start_ns < base_ns) {
+                base_ns = totals->first_start_ns;
+            }
+        }
+    }
+
+    int64_t end_ns = base_ns;
+    fprintf(file, "{\n  \"program\": \"%s\",\n  \"counters\": \"%s\",\n  \"phases\": {", program,
+            counters_on ? "cycles instructions llc_misses branch_misses (user space)" : counters_error);
+    int first = 1;
+    for (int p = 0; p < NUM_PHASES; p++) {
+        phase_totals_t* sum = &summary[p];
+        if (sum->calls == 0) {
+            continue;
+        }
+        sum->wall_ns = sum->last_end_ns - sum->first_start_ns; // Span, not a sum over threads
+        if (sum->last_end_ns > end_ns) {
+            end_ns = sum->last_end_ns;
+        }
+        fprintf(file, "%s\n    \"%s\": ", first ? "" : ",", phase_names[p]);
+        write_totals(file, sum, base_ns, summary_valid);
+        fprintf(file, ", \"gb_per_s\": %.3f}", sum->wall_ns > 0 ? (double)sum->bytes / (double)sum->wall_ns : 0.0);
+        first = 0;
+    }
+    fprintf(file, "\n  },\n  \"total_us\": %.3f,\n  \"ranks\": [", (end_ns - base_ns) / 1e3);
+
+    const thread_record_t* record = all;
+    for (int r = 0; r < num_ranks; r++) {
+        fprintf(file, "%s\n    {\"rank\": %d, \"memory\": ", r > 0 ? "," : "", r);
+        write_memory(file, &record->memory);
+        fprintf(file, ", \"threads\": [");
+        for (int s = 0; s < rank_slots[r]; s++, record++) {
+            if (s == INSTRUMENT_MAIN) {
+                fprintf(file, "\n      {\"thread\": \"main\", \"phases\": {");
+            } else {
+                fprintf(file, ",\n      {\"thread\": %d, \"phases\": {", s - 1);
+            }
+            first = 1;
+            for (int p = 0; p < NUM_PHASES; p++) {
+                if (record->phases[p].calls == 0) {
+                    continue;
+                }
+                fprintf(file, "%s\n        \"%s\": ", first ? "" : ",", phase_names[p]);
+                write_totals(file, &record->phases[p], base_ns, record->counters_valid);
+                fprintf(file, "}");
+                first = 0;
+            }
+            fprintf(file, "}}");
+        }
+        fprintf(file, "\n    ]}");
+    }
+    fprintf(file, "\n  ]");
+    write_nodes(file, all, num_ranks, rank_slots);
+    fprintf(file, "\n}\n");
+
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+/*
+ * instrument_free
+ * Stops recording, closes every thread's counters and frees the records
+ */
+void instrument_free(void)
+{
+    if (sampler_running) {
+        __atomic_store_n(&sampler_stop, 1, __ATOMIC_RELAXED);
+        pthread_join(sampler, NULL);
+        sampler_running = 0;
+    }
+    int opened = num_groups < MAX_COUNTER_GROUPS ? num_groups : MAX_COUNTER_GROUPS;
+    for (int g = 0; g < opened; g++) {
+        for (int c = 0; c < NUM_COUNTERS; c++) {
+            if (group_fds[g][c] >= 0) {
+                close(group_fds[g][c]);
+            }
+        }
+    }
+    num_groups = 0;
+    counters_on = 0;
+    free(records);
+    records = NULL;
+    num_records = 0;
+}
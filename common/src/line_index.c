@@ -0,0 +1,252 @@
+#define _GNU_SOURCE // st_mtim and pread are hidden by the pthreads build's _XOPEN_SOURCE=500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "line_index.h"
+
+/*
+ * line_index_build
+ * Indexes every line of a file, cut the same way the programs will cut them
+ * (see line_store_set_max_length), and writes the header and offsets
+ * @param filename Input filename
+ * @param index_path Index file to create
+ * @return int 0 on success, -1 on failure
+ */
+int line_index_build(const char* filename, const char* index_path)
+{
+    struct stat st;
+    if (stat(filename, &st) != 0) {
+        return -1;
+    }
+
+    line_store_t store;
+    if (line_store_map(&store, filename, INT_MAX) != 0) {
+        return -1;
+    }
+
+    line_index_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LINE_INDEX_MAGIC, 4);
+    header.version = LINE_INDEX_VERSION;
+    header.split_length = line_store_max_length();
+    header.file_size = (uint64_t)st.st_size;
+    header.file_mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    header.file_mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+    header.num_lines = (uint64_t)store.num_lines;
+
+    FILE* file = fopen(index_path, "wb");
+    int status = file ? 0 : -1;
+    if (file) {
+        size_t count = (size_t)store.num_lines + 1;
+        if (fwrite(&header, sizeof(header), 1, file) != 1 || fwrite(store.offsets, sizeof(uint64_t), count, file) != count) {
+            status = -1;
+        }
+        if (fclose(file) != 0) {
+            status = -1;
+        }
+    }
+    line_store_free(&store);
+    return status;
+}
+
+/*
+ * line_index_open
+ * Maps a line index and checks that it was built for this input as it is
+ * now (same size and modification time) and with the line cut this run uses
+ * @param index Index to fill
+ * @param index_path Index filename
+ * @param filename Input the index must describe
+ * @return int 0 on success, -1 if the index is unreadable or stale (an error is printed)
+ */
+int line_index_open(line_index_t* index, const char* index_path, const char* filename)
+{
+    memset(index, 0, sizeof(*index));
+
+    int fd = open(index_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(line_index_header_t) + sizeof(uint64_t)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        fprintf(stderr, "ERROR: %s is not a readable line index.\n", index_path);
+        return -1;
+    }
+
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "ERROR: %s is not a readable line index.\n", index_path);
+        return -1;
+    }
+    index->map = (const unsigned char *)map;
+    index->size = (size_t)st.st_size;
+    index->header = (const line_index_header_t *)map;
+    index->offsets = (const uint64_t *)(index->map + sizeof(line_index_header_t));
+
+    const line_index_header_t* header = index->header;
+    if (memcmp(header->magic, LINE_INDEX_MAGIC, 4) != 0 || header->version != LINE_INDEX_VERSION
+        || header->num_lines > INT_MAX
+        || index->size != sizeof(line_index_header_t) + (header->num_lines + 1) * sizeof(uint64_t)) {
+        fprintf(stderr, "ERROR: %s is not a readable line index.\n", index_path);
+        line_index_close(index);
+        return -1;
+    }
+    index->num_lines = (int)header->num_lines;
+
+    struct stat input;
+    if (stat(filename, &input) != 0 || (uint64_t)input.st_size != header->file_size
+        || (int64_t)input.st_mtim.tv_sec != header->file_mtime_sec || (int64_t)input.st_mtim.tv_nsec != header->file_mtime_nsec) {
+        fprintf(stderr, "ERROR: %s does not match %s as it is now, rebuild it with build_index.\n", index_path, filename);
+        line_index_close(index);
+        return -1;
+    }
+    if (header->split_length != line_store_max_length()) {
+        fprintf(stderr, "ERROR: %s was built %s, rebuild it to match this run.\n", index_path,
+                header->split_length == 0 ? "with whole lines (--long-lines)" : "with the 2999-byte line cut (without --long-lines)");
+        line_index_close(index);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * line_index_close
+ * Unmaps a line index
+ * @param index Index to close
+ */
+void line_index_close(line_index_t* index)
+{
+    if (index->map) {
+        munmap((void *)index->map, index->size);
+    }
+    memset(index, 0, sizeof(*index));
+}
+
+/*
+ * line_index_load
+ * Loads lines [first, first + count) of a file without scanning anything
+ * before them. With an index the offsets are copied out of it and only the
+ * range's bytes are read (or the file is mapped and only they are touched);
+ * without one the lines up to first + count are indexed and the first ones
+ * dropped. Either way line 0 of the store is line first of the file.
+ * @param store Pointer to the line store to fill
+ * @param filename Input filename ("-" only without an index)
+ * @param index Open index of the input, or NULL
+ * @param use_mmap Map the file instead of reading it
+ * @param first First line to load
+ * @param count Maximum number of lines to load (fewer past the end of the file)
+ * @return int 0 on success, -1 on failure
+ */
+int line_index_load(line_store_t* store, const char* filename, const line_index_t* index, int use_mmap, int first, int count)
+{
+    if (!index) {
+        int limit = count > INT_MAX - first ? INT_MAX : first + count;
+        int status = use_mmap ? line_store_map(store, filename, limit) : line_store_read(store, filename, limit);
+        if (status != 0) {
+            return -1;
+        }
+        int skip = first < store->num_lines ? first : store->num_lines;
+        if (skip > 0) {
+            store->num_lines -= skip;
+            memmove(store->offsets, store->offsets + skip, ((size_t)store->num_lines + 1) * sizeof(uint64_t));
+        }
+        return 0;
+    }
+
+    memset(store, 0, sizeof(*store));
+    if (count < 0) {
+        count = 0;
+    }
+    if (first > index->num_lines) {
+        first = index->num_lines;
+    }
+    if (count > index->num_lines - first) {
+        count = index->num_lines - first;
+    }
+    const uint64_t* offsets = index->offsets + first;
+    uint64_t start = offsets[0];
+    uint64_t end = offsets[count];
+
+    store->offsets = (uint64_t *)malloc(((size_t)count + 1) * sizeof(uint64_t));
+    if (!store->offsets) {
+        return -1;
+    }
+
+    if (use_mmap) {
+        // Pages outside the range are never touched, so they are never read
+        uint64_t* own = store->offsets;
+        if (line_store_map_bytes(store, filename, first + count) != 0) {
+            free(own);
+            return -1;
+        }
+        if (store->data_size < end) {
+            line_store_free(store); // The input is shorter than when it was indexed
+            free(own);
+            return -1;
+        }
+        store->offsets = own;
+        memcpy(store->offsets, offsets, ((size_t)count + 1) * sizeof(uint64_t));
+    } else {
+        // Read just the range's bytes and renumber the offsets from them
+        int fd = open(filename, O_RDONLY);
+        char* data = (char *)malloc(end > start ? (size_t)(end - start) : 1);
+        size_t done = 0;
+        while (fd >= 0 && data && done < end - start) {
+            ssize_t got = pread(fd, data + done, (size_t)(end - start) - done, (off_t)(start + done));
+            if (got <= 0) {
+                break;
+            }
+            done += (size_t)got;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!data || done < end - start) {
+            free(data);
+            free(store->offsets);
+            store->offsets = NULL;
+            return -1;
+        }
+        for (int i = 0; i <= count; i++) {
+            store->offsets[i] = offsets[i] - start;
+        }
+        store->data = data;
+        store->data_size = (size_t)(end - start);
+    }
+    store->num_lines = count;
+    return 0;
+}
+
+/*
+ * line_store_load
+ * Loads lines [first, first + count) of a file, opening and closing the
+ * index at index_path for the call
+ * @param store Pointer to the line store to fill
+ * @param filename Input filename
+ * @param index_path Index of the input, or NULL to find the lines by scanning
+ * @param use_mmap Map the file instead of reading it
+ * @param first First line to load
+ * @param count Maximum number of lines to load
+ * @return int 0 on success, -1 on failure
+ */
+int line_store_load(line_store_t* store, const char* filename, const char* index_path, int use_mmap, int first, int count)
+{
+    if (!index_path) {
+        return line_index_load(store, filename, NULL, use_mmap, first, count);
+    }
+
+    line_index_t index;
+    if (line_index_open(&index, index_path, filename) != 0) {
+        return -1;
+    }
+    int status = line_index_load(store, filename, &index, use_mmap, first, count);
+    line_index_close(&index);
+    return status;
+}
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "line_stats.h"
+#include "output.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Results of one line before they are stored in the columns
+typedef struct line_result {
+    int max;
+    int min;
+    long long sum;
+} line_result_t;
+
+/*
+ * stats_parse
+ * Parses the --stats list
+ * @param list Comma-separated names: max, min, mean, hist or all
+ * @param mask Set to the selected STAT_* bits, always including STAT_MAX
+ * @return int 0 on success, -1 on an unknown name
+ */
+int stats_parse(const char* list, unsigned* mask)
+{
+    *mask = STAT_MAX;
+    while (*list) {
+        size_t length = strcspn(list, ",");
+        if (length == 3 && strncmp(list, "max", 3) == 0) {
+            *mask |= STAT_MAX;
+        } else if (length == 3 && strncmp(list, "min", 3) == 0) {
+            *mask |= STAT_MIN;
+        } else if (length == 4 && strncmp(list, "mean", 4) == 0) {
+            *mask |= STAT_MEAN;
+        } else if (length == 4 && strncmp(list, "hist", 4) == 0) {
+            *mask |= STAT_HIST;
+        } else if (length == 3 && strncmp(list, "all", 3) == 0) {
+            *mask |= STAT_ALL;
+        } else {
+            fprintf(stderr, "ERROR: Unknown statistic '%.*s'.\n", (int)length, list);
+            return -1;
+        }
+        list += length;
+        if (*list == ',') {
+            list++;
+        }
+    }
+    return 0;
+}
+
+/*
+ * stats_columns_alloc
+ * Sets up the per-line columns for count lines
+ * @param cols Columns to fill
+ * @param mask STAT_* bits to compute
+ * @param max_values Caller's array for the max values (always computed)
+ * @param count Number of lines
+ * @return int 0 on success, -1 on allocation failure
+ */
+int stats_columns_alloc(stats_columns_t* cols, unsigned mask, int* max_values, int count)
+{
+    size_t size = count > 0 ? (size_t)count : 1;
+
+    memset(cols, 0, sizeof(*cols));
+    cols->mask = mask | STAT_MAX;
+    cols->max = max_values;
+    if (mask & STAT_MIN) {
+        cols->min = (int *)malloc(size * sizeof(int));
+    }
+    if (mask & STAT_MEAN) {
+        cols->mean = (double *)malloc(size * sizeof(double));
+    }
+    if (((mask & STAT_MIN) && !cols->min) || ((mask & STAT_MEAN) && !cols->mean)) {
+        stats_columns_free(cols);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * stats_columns_bytes
+ * Counts the memory of every column, the caller's max column included
+ * @param cols Columns set up by stats_columns_alloc
+ * @param count Number of lines
+ * @return size_t Bytes held
+ */
+size_t stats_columns_bytes(const stats_columns_t* cols, int count)
+{
+    size_t size = count > 0 ? (size_t)count : 0;
+    return size * sizeof(int) + (cols->min ? size * sizeof(int) : 0) + (cols->mean ? size * sizeof(double) : 0);
+}
+
+/*
+ * stats_columns_free
+ * Frees the min and mean columns (the max column belongs to the caller)
+ * @param cols Columns to free
+ */
+void stats_columns_free(stats_columns_t* cols)
+{
+    free(cols->min);
+    free(cols->mean);
+    cols->min = NULL;
+    cols->mean = NULL;
+}
+
+/*
+ * scan_line
+ * Computes the statistics in mask over one line. Every specialization below
+ * passes a constant mask, so the compiler drops the reductions that are not
+ * selected and the rest share each 16-byte load.
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @param mask STAT_* bits to compute
+ * @param result Set to the line's max, min and sum
+ * @param hist Private bins the bytes are counted into (STAT_HIST)
+ */
+static inline __attribute__((always_inline))
+void scan_line(const char* line, size_t length, unsigned mask, line_result_t* result, byte_histogram_t* hist)
+{
+    int maxVal = 0; // Floor of 0, as line_max
+    int minVal = 127;
+    long long sum = 0;
+    size_t j = 0;
+
+#if defined(__SSE2__)
+    // Bytes are flipped by 0x80 into unsigned order, so SSE2's unsigned max/min
+    // and sum of absolute differences work on them
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    __m128i vmax = bias; // Flipped form of 0
+    __m128i vmin = _mm_set1_epi8((char)0xff); // Flipped form of 127
+    __m128i vsum = _mm_setzero_si128();
+
+    for (; j + 16 <= length; j += 16) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(line + j)), bias);
+        if (mask & STAT_MAX) {
+            vmax = _mm_max_epu8(vmax, v);
+        }
+        if (mask & STAT_MIN) {
+            vmin = _mm_min_epu8(vmin, v);
+        }
+        if (mask & STAT_MEAN) {
+            vsum = _mm_add_epi64(vsum, _mm_sad_epu8(v, _mm_setzero_si128()));
+        }
+        if (mask & STAT_HIST) {
+            // The block is already in L1, so counting it costs no extra memory traffic
+            for (int k = 0; k < 16; k++) {
+                hist->bins[k & (HIST_LANES - 1)][(unsigned char)line[j + k]]++;
+            }
+        }
+    }
+
+    if (mask & STAT_MAX) {
+        vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 8));
+        vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 4));
+        vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 2));
+        vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 1));
+        maxVal = (signed char)((_mm_cvtsi128_si32(vmax) & 0xff) ^ 0x80);
+    }
+    if (mask & STAT_MIN) {
+        vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 8));
+        vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 4));
+        vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 2));
+        vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 1));
+        minVal = (signed char)((_mm_cvtsi128_si32(vmin) & 0xff) ^ 0x80);
+    }
+    if (mask & STAT_MEAN) {
+        // Each flipped byte is 128 more than the signed value it stands for
+        long long lanes[2];
+        _mm_storeu_si128((__m128i *)lanes, vsum);
+        sum = lanes[0] + lanes[1] - 128LL * (long long)j;
+    }
+#endif
+
+    for (; j < length; j++) {
+        int value = line[j];
+        if ((mask & STAT_MAX) && value > maxVal) {
+            maxVal = value;
+        }
+        if ((mask & STAT_MIN) && value < minVal) {
+            minVal = value;
+        }
+        if (mask & STAT_MEAN) {
+            sum += value;
+        }
+        if (mask & STAT_HIST) {
+            hist->bins[j & (HIST_LANES - 1)][(unsigned char)line[j]]++;
+        }
+    }
+
+    result->max = maxVal;
+    result->min = length > 0 ? minVal : 0;
+    result->sum = sum;
+}
+
+// Signature of a specialized scan over a range of lines
+typedef void (*stats_range_fn)(const line_store_t* store, int first, int last, stats_columns_t* cols, int out_first, byte_histogram_t* hist);
+
+// One range scan per combination of statistics, each with its own inlined scan_line
+#define STATS_RANGE(MASK) \
+    static void stats_range_##MASK(const line_store_t* store, int first, int last, stats_columns_t* cols, int out_first, byte_histogram_t* hist) \
+    { \
+        for (int i = first; i < last; i++) { \
+            size_t length; \
+            const char* line = line_store_line(store, i, &length); \
+            line_result_t result; \
+            scan_line(line, length, (MASK), &result, hist); \
+            cols->max[i - out_first] = result.max; \
+            if ((MASK) & STAT_MIN) { \
+                cols->min[i - out_first] = result.min; \
+            } \
+            if ((MASK) & STAT_MEAN) { \
+                cols->mean[i - out_first] = length > 0 ? (double)result.sum / (double)length : 0.0; \
+            } \
+        } \
+    }
+
+STATS_RANGE(1)
+STATS_RANGE(3)
+STATS_RANGE(5)
+STATS_RANGE(7)
+STATS_RANGE(9)
+STATS_RANGE(11)
+STATS_RANGE(13)
+STATS_RANGE(15)
+
+// Indexed by the mask with STAT_MAX (bit 0) dropped
+static const stats_range_fn stats_ranges[8] = {
+    stats_range_1, stats_range_3, stats_range_5, stats_range_7,
+    stats_range_9, stats_range_11, stats_range_13, stats_range_15,
+};
+
+/*
+ * stats_scan_lines
+ * Computes the statistics selected in cols over a range of lines, reading
+ * each line once
+ * @param store Lines to scan
+ * @param first First line index
+ * @param last One past the last line index
+ * @param cols Columns the results go to, line i at index i - out_first
+ * @param out_first Line index stored at column index 0
+ * @param hist This thread's private bins (STAT_HIST)
+ */
+void stats_scan_lines(const line_store_t* store, int first, int last, stats_columns_t* cols, int out_first, byte_histogram_t* hist)
+{
+    stats_ranges[(cols->mask & STAT_ALL) >> 1](store, first, last, cols, out_first, hist);
+}
+
+/*
+ * histogram_merge
+ * Adds every lane of a thread's private bins into a total
+ * @param total Array of HIST_BINS counts to add to
+ * @param hist Private bins to add
+ */
+void histogram_merge(uint64_t* total, const byte_histogram_t* hist)
+{
+    for (int lane = 0; lane < HIST_LANES; lane++) {
+        for (int b = 0; b < HIST_BINS; b++) {
+            total[b] += hist->bins[lane][b];
+        }
+    }
+}
+
+/*
+ * stats_format_alloc
+ * Formats results like printf("%d: %d %d %.1f\n", i, max, min, mean), with
+ * only the selected columns. Max-only results use the faster results_format.
+ * @param cols Columns to format, index 0 is line first_index
+ * @param first_index Line number of the first result
+ * @param count Number of results
+ * @param length Set to the number of bytes formatted
+ * @return char* The buffer (free it), NULL on allocation failure
+ */
+char* stats_format_alloc(const stats_columns_t* cols, int first_index, int count, size_t* length)
+{
+    if (!(cols->mask & (STAT_MIN | STAT_MEAN))) {
+        return results_format_alloc(cols->max, first_index, count, length);
+    }
+
+    char* out = (char *)malloc(count > 0 ? (size_t)count * STATS_LINE_MAX : 1);
+    if (!out) {
+        return NULL;
+    }
+    char* pos = out;
+    for (int i = 0; i < count; i++) {
+        pos += sprintf(pos, "%d: %d", first_index + i, cols->max[i]);
+        if (cols->mask & STAT_MIN) {
+            pos += sprintf(pos, " %d", cols->min[i]);
+        }
+        if (cols->mask & STAT_MEAN) {
+            pos += sprintf(pos, " %.1f", cols->mean[i]);
+        }
+        *pos++ = '\n';
+    }
+    *length = (size_t)(pos - out);
+    return out;
+}
+
+/*
+ * stats_write_histogram
+ * Writes "Histogram:" and then one "<byte>: <count>" line per nonzero bin
+ * @param fd File descriptor to write to
+ * @param total Array of HIST_BINS counts
+ * @return int 0 on success, -1 on a write error
+ */
+int stats_write_histogram(int fd, const uint64_t* total)
+{
+    char text[16 + HIST_BINS * 26];
+    char* pos = text;
+
+    pos += sprintf(pos, "\nHistogram:\n");
+    for (int b = 0; b < HIST_BINS; b++) {
+        if (total[b] > 0) {
+            pos += sprintf(pos, "%d: %llu\n", b, (unsigned long long)total[b]);
+        }
+    }
+    struct iovec iov = { text, (size_t)(pos - text) };
+    return results_write(fd, &iov, 1);
+}
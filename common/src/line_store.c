@@ -0,0 +1,289 @@
+#define _GNU_SOURCE // posix_madvise is hidden by the pthreads build's _XOPEN_SOURCE=500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "line_store.h"
+
+#define READ_CHUNK_SIZE (1 << 20) // Bytes requested per read() call
+
+static size_t split_length = MAX_LINE_LENGTH - 1; // Lines are cut after this many bytes, 0 keeps them whole
+
+/*
+ * line_store_set_max_length
+ * Sets where line_store_index cuts long lines. Call before loading any store.
+ * @param max_length Longest line in bytes before it is cut, or 0 to keep every line whole
+ */
+void line_store_set_max_length(size_t max_length)
+{
+    split_length = max_length;
+}
+
+/*
+ * line_store_max_length
+ * Returns where line_store_index cuts long lines
+ * @return size_t Longest line in bytes before it is cut, or 0 when lines are kept whole
+ */
+size_t line_store_max_length(void)
+{
+    return split_length;
+}
+
+/*
+ * line_store_index
+ * Builds the offsets array for up to max_lines lines of store->data.
+ * Lines are split the same way the old fgets(buffer, MAX_LINE_LENGTH) loop
+ * split them, so longer lines still become several lines, unless
+ * line_store_set_max_length(0) asked for whole lines.
+ * @param store Pointer to the line store (data and data_size must be set)
+ * @param max_lines Maximum number of lines to index
+ * @return int 0 on success, -1 on allocation failure
+ */
+int line_store_index(line_store_t* store, int max_lines)
+{
+    size_t capacity = 1024; // Initial offsets capacity, grown by doubling
+    uint64_t pos = 0; // Start of the current line
+    int count = 0; // Lines indexed so far
+
+    store->offsets = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+    if (!store->offsets) {
+        return -1;
+    }
+
+    while (pos < store->data_size && count < max_lines) {
+        size_t remaining = store->data_size - pos;
+        size_t limit = split_length == 0 || remaining < split_length ? remaining : split_length;
+        const char* newline = memchr(store->data + pos, '\n', limit);
+        size_t length = newline ? (size_t)(newline - (store->data + pos)) + 1 : limit;
+
+        if ((size_t)count + 2 > capacity) {
+            capacity *= 2;
+            uint64_t* grown = (uint64_t *)realloc(store->offsets, capacity * sizeof(uint64_t));
+            if (!grown) {
+                return -1;
+            }
+            store->offsets = grown;
+        }
+        store->offsets[count++] = pos;
+        pos += length;
+    }
+    store->offsets[count] = pos; // End of the last line
+    store->num_lines = count;
+    return 0;
+}
+
+/*
+ * count_newlines
+ * Counts the newline characters in a buffer
+ * @param data Pointer to the bytes
+ * @param size Number of bytes
+ * @return size_t Number of newlines
+ */
+static size_t count_newlines(const char* data, size_t size)
+{
+    size_t count = 0;
+    const char* end = data + size;
+    while ((data = memchr(data, '\n', (size_t)(end - data))) != NULL) {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+/*
+ * read_fd_bytes
+ * Reads an open descriptor into one packed heap buffer until it holds at
+ * least max_lines lines, without indexing them
+ * @param store Pointer to the line store to fill (num_lines stays 0)
+ * @param fd Descriptor to read, left open
+ * @param max_lines Minimum number of lines to read before stopping
+ * @return int 0 on success, -1 on failure
+ */
+static int read_fd_bytes(line_store_t* store, int fd, int max_lines)
+{
+    char* data = NULL; // Packed arena
+    size_t size = 0; // Bytes read so far
+    size_t capacity = 0; // Bytes allocated
+    size_t newlines = 0; // Complete lines read so far
+
+    // Every newline ends at least one line, so stop once there are enough of them
+    while (newlines < (size_t)max_lines) {
+        if (capacity - size < READ_CHUNK_SIZE) {
+            capacity = capacity ? capacity * 2 : READ_CHUNK_SIZE;
+            char* grown = (char *)realloc(data, capacity);
+            if (!grown) {
+                free(data);
+                return -1;
+            }
+            data = grown;
+        }
+
+        ssize_t got = read(fd, data + size, READ_CHUNK_SIZE);
+        if (got <= 0) {
+            break; // End of file (or a read error, which ends the input the same way fgets did)
+        }
+        newlines += count_newlines(data + size, (size_t)got);
+        size += (size_t)got;
+    }
+
+    if (size > 0 && size < capacity) {
+        char* shrunk = (char *)realloc(data, size);
+        if (shrunk) {
+            data = shrunk;
+        }
+    }
+    store->data = data;
+    store->data_size = size;
+    return 0;
+}
+
+/*
+ * line_store_read_bytes
+ * Reads a file into one packed heap buffer until it holds at least max_lines
+ * lines, without indexing them. "-" reads standard input.
+ * @param store Pointer to the line store to fill (num_lines stays 0)
+ * @param filename Input filename
+ * @param max_lines Minimum number of lines to read before stopping
+ * @return int 0 on success, -1 on failure
+ */
+int line_store_read_bytes(line_store_t* store, const char* filename, int max_lines)
+{
+    memset(store, 0, sizeof(*store));
+
+    int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    int status = read_fd_bytes(store, fd, max_lines);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return status;
+}
+
+/*
+ * line_store_read
+ * Reads a file into one packed heap buffer and indexes up to max_lines lines
+ * @param store Pointer to the line store to fill
+ * @param filename Input filename, or "-" for standard input
+ * @param max_lines Maximum number of lines to index
+ * @return int 0 on success, -1 on failure
+ */
+int line_store_read(line_store_t* store, const char* filename, int max_lines)
+{
+    if (line_store_read_bytes(store, filename, max_lines) != 0) {
+        return -1;
+    }
+    if (line_store_index(store, max_lines) != 0) {
+        line_store_free(store);
+        return -1;
+    }
+
+    // Give back the bytes past the last indexed line
+    size_t used = (size_t)store->offsets[store->num_lines];
+    if (used > 0 && used < store->data_size) {
+        char* shrunk = (char *)realloc((void *)store->data, used);
+        if (shrunk) {
+            store->data = shrunk;
+        }
+    }
+    store->data_size = used;
+    return 0;
+}
+
+/*
+ * line_store_map_bytes
+ * Maps a file read-only without indexing it. Pipes and other inputs that
+ * cannot be mapped (their size reads as 0) are read like line_store_read_bytes.
+ * @param store Pointer to the line store to fill (num_lines stays 0)
+ * @param filename Input filename
+ * @param max_lines Minimum number of lines to read when the input is not a regular file
+ * @return int 0 on success, -1 on failure
+ */
+int line_store_map_bytes(line_store_t* store, const char* filename, int max_lines)
+{
+    memset(store, 0, sizeof(*store));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        int status = read_fd_bytes(store, fd, max_lines);
+        close(fd);
+        return status;
+    }
+
+    if (st.st_size > 0) {
+        void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL); // Lines are scanned front to back
+        store->data = (const char *)map;
+        store->data_size = (size_t)st.st_size;
+        store->mapped = 1;
+    }
+    close(fd); // The mapping stays valid after the descriptor is closed
+    return 0;
+}
+
+/*
+ * line_store_map
+ * Maps a file read-only and indexes its lines in place, without copying them
+ * @param store Pointer to the line store to fill
+ * @param filename Input filename
+ * @param max_lines Maximum number of lines to index
+ * @return int 0 on success, -1 on failure
+ */
+int line_store_map(line_store_t* store, const char* filename, int max_lines)
+{
+    if (line_store_map_bytes(store, filename, max_lines) != 0) {
+        return -1;
+    }
+    if (line_store_index(store, max_lines) != 0) {
+        line_store_free(store);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * line_store_bytes
+ * Counts the memory a store holds: its bytes (mapped pages count too once
+ * they are read) and its offsets
+ * @param store Pointer to the line store
+ * @return size_t Bytes held
+ */
+size_t line_store_bytes(const line_store_t* store)
+{
+    return store->data_size + (store->offsets ? ((size_t)store->num_lines + 1) * sizeof(uint64_t) : 0);
+}
+
+/*
+ * line_store_free
+ * Releases the data (unmapping or freeing it) and the offsets array
+ * @param store Pointer to the line store
+ */
+void line_store_free(line_store_t* store)
+{
+    if (store->mapped) {
+        munmap((void *)store->data, store->data_size);
+    } else {
+        free((void *)store->data);
+    }
+    free(store->offsets);
+    memset(store, 0, sizeof(*store));
+}
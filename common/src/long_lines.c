@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <string.h>
+#include "long_lines.h"
+#include "max_kernel.h"
+
+/*
+ * long_lines_plan
+ * Cuts every line of [first, last) longer than threshold into pieces of
+ * about threshold bytes. With --semantics codepoint a cut is moved past any
+ * UTF-8 continuation bytes, so no character is split between two pieces.
+ * @param store Lines to plan
+ * @param first First line index
+ * @param last One past the last line index
+ * @param threshold Longest line scanned whole, and the size of the pieces
+ * @param plan Set to the pieces (empty when no line is long)
+ * @return int 0 on success, -1 on allocation failure
+ */
+int long_lines_plan(const line_store_t* store, int first, int last, size_t threshold, long_lines_t* plan)
+{
+    int utf8 = max_kernel_semantics() == SEMANTICS_CODEPOINT;
+    int capacity = 0;
+
+    memset(plan, 0, sizeof(*plan));
+    for (int i = first; i < last; i++) {
+        size_t length;
+        const char* line = line_store_line(store, i, &length);
+        if (length <= threshold) {
+            continue;
+        }
+
+        size_t start = 0;
+        while (start < length) {
+            size_t end = length - start > threshold ? start + threshold : length;
+            while (utf8 && end < length && ((unsigned char)line[end] & 0xc0) == 0x80) {
+                end++;
+            }
+
+            if (plan->num_chunks == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                line_chunk_t* grown = (line_chunk_t *)realloc(plan->chunks, (size_t)capacity * sizeof(line_chunk_t));
+                if (!grown) {
+                    long_lines_free(plan);
+                    return -1;
+                }
+                plan->chunks = grown;
+            }
+            plan->chunks[plan->num_chunks].line = i;
+            plan->chunks[plan->num_chunks].data = line + start;
+            plan->chunks[plan->num_chunks].length = end - start;
+            plan->num_chunks++;
+            start = end;
+        }
+    }
+
+    plan->values = (int *)calloc(plan->num_chunks > 0 ? (size_t)plan->num_chunks : 1, sizeof(int));
+    if (!plan->values) {
+        long_lines_free(plan);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * long_lines_scan
+ * Computes the max value of a range of pieces
+ * @param plan Pieces to scan
+ * @param first First piece
+ * @param last One past the last piece
+ */
+void long_lines_scan(long_lines_t* plan, int first, int last)
+{
+    for (int c = first; c < last; c++) {
+        plan->values[c] = line_max(plan->chunks[c].data, plan->chunks[c].length);
+    }
+}
+
+/*
+ * long_lines_claim
+ * Takes pieces off a shared counter and scans them until there are none
+ * left, so a thread that finishes early picks up more of the long lines
+ * @param plan Pieces to scan (next must start at 0)
+ */
+void long_lines_claim(long_lines_t* plan)
+{
+    int c;
+    while ((c = __atomic_fetch_add(&plan->next, 1, __ATOMIC_RELAXED)) < plan->num_chunks) {
+        long_lines_scan(plan, c, c + 1);
+    }
+}
+
+/*
+ * long_lines_combine
+ * Reduces the pieces of every long line to the line's max value. Every
+ * semantics floors values at 0, so the max of the pieces is the line's max.
+ * @param plan Scanned pieces
+ * @param max_values Max value of each line, line i at index i - out_first
+ * @param out_first Line index stored at max_values[0]
+ */
+void long_lines_combine(const long_lines_t* plan, int* max_values, int out_first)
+{
+    for (int c = 0; c < plan->num_chunks; c++) {
+        int* value = &max_values[plan->chunks[c].line - out_first];
+        if (c == 0 || plan->chunks[c - 1].line != plan->chunks[c].line || plan->values[c] > *value) {
+            *value = plan->values[c]; // The first piece of a line overwrites what the line pass left
+        }
+    }
+}
+
+/*
+ * long_lines_free
+ * Releases the pieces
+ * @param plan Pieces to free
+ */
+void long_lines_free(long_lines_t* plan)
+{
+    free(plan->chunks);
+    free(plan->values);
+    memset(plan, 0, sizeof(*plan));
+}
@@ -0,0 +1,790 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "max_kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MAX_KERNEL_X86 1
+#endif
+
+/*
+ * line_max_scalar
+ * Byte-by-byte reference implementation
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum value
+ */
+static int line_max_scalar(const char* line, size_t length)
+{
+    int maxVal = 0;
+    for (size_t j = 0; j < length; j++) {
+        if (line[j] > maxVal) {
+            maxVal = line[j];
+        }
+    }
+    return maxVal;
+}
+
+/*
+ * line_max_unsigned_scalar
+ * Byte-by-byte maximum of the unsigned byte values
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum value
+ */
+static int line_max_unsigned_scalar(const char* line, size_t length)
+{
+    const unsigned char* bytes = (const unsigned char *)line;
+    int maxVal = 0;
+    for (size_t j = 0; j < length; j++) {
+        if (bytes[j] > maxVal) {
+            maxVal = bytes[j];
+        }
+    }
+    return maxVal;
+}
+
+/*
+ * utf8_decode
+ * Decodes the sequence at s following the well-formed byte ranges of the
+ * Unicode standard (no overlongs, surrogates or values past U+10FFFF)
+ * @param s Pointer to a byte of at least 0x80
+ * @param length Number of bytes available at s
+ * @param used Set to the number of bytes consumed
+ * @return int Code point, or U+FFFD (consuming one byte) for an invalid or cut-off sequence
+ */
+static int utf8_decode(const unsigned char* s, size_t length, size_t* used)
+{
+    unsigned char c = s[0];
+    size_t need;
+    unsigned char low = 0x80; // Allowed range of the second byte
+    unsigned char high = 0xbf;
+    int cp;
+
+    if (c >= 0xc2 && c <= 0xdf) {
+        need = 1;
+        cp = c & 0x1f;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        need = 2;
+        cp = c & 0x0f;
+        low = c == 0xe0 ? 0xa0 : 0x80; // Overlong
+        high = c == 0xed ? 0x9f : 0xbf; // Surrogates
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        need = 3;
+        cp = c & 0x07;
+        low = c == 0xf0 ? 0x90 : 0x80; // Overlong
+        high = c == 0xf4 ? 0x8f : 0xbf; // Past U+10FFFF
+    } else {
+        *used = 1;
+        return 0xfffd;
+    }
+
+    if (need >= length || s[1] < low || s[1] > high) {
+        *used = 1;
+        return 0xfffd;
+    }
+    for (size_t k = 1; k <= need; k++) {
+        if (k > 1 && (s[k] & 0xc0) != 0x80) {
+            *used = 1;
+            return 0xfffd;
+        }
+        cp = (cp << 6) | (s[k] & 0x3f);
+    }
+    *used = need + 1;
+    return cp;
+}
+
+/*
+ * line_max_utf8_scalar
+ * Decodes the line and returns its largest code point. ASCII bytes are
+ * compared directly and only the other bytes are decoded.
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum code point
+ */
+static int line_max_utf8_scalar(const char* line, size_t length)
+{
+    const unsigned char* bytes = (const unsigned char *)line;
+    int maxVal = 0;
+    size_t j = 0;
+
+    while (j < length) {
+        if (bytes[j] < 0x80) {
+            if (bytes[j] > maxVal) {
+                maxVal = bytes[j];
+            }
+            j++;
+            continue;
+        }
+        size_t used;
+        int cp = utf8_decode(bytes + j, length - j, &used);
+        if (cp > maxVal) {
+            maxVal = cp;
+        }
+        j += used;
+    }
+    return maxVal;
+}
+
+#ifdef MAX_KERNEL_X86
+
+/*
+ * line_max_sse2
+ * SSE2 has no signed byte max, so bytes are flipped by 0x80 into unsigned
+ * order and reduced with _mm_max_epu8
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum value
+ */
+__attribute__((target("sse2")))
+static int line_max_sse2(const char* line, size_t length)
+{
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    __m128i acc0 = bias; // bias is the flipped form of 0
+    __m128i acc1 = bias;
+    size_t j = 0;
+
+    for (; j + 32 <= length; j += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(line + j));
+        __m128i b = _mm_loadu_si128((const __m128i *)(line + j + 16));
+        acc0 = _mm_max_epu8(acc0, _mm_xor_si128(a, bias));
+        acc1 = _mm_max_epu8(acc1, _mm_xor_si128(b, bias));
+    }
+    for (; j + 16 <= length; j += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(line + j));
+        acc0 = _mm_max_epu8(acc0, _mm_xor_si128(a, bias));
+    }
+
+    __m128i v = _mm_max_epu8(acc0, acc1);
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 4));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 2));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 1));
+    int maxVal = (signed char)((_mm_cvtsi128_si32(v) & 0xff) ^ 0x80);
+
+    int tail = line_max_scalar(line + j, length - j);
+    return tail > maxVal ? tail : maxVal;
+}
+
+/*
+ * reduce_max_128
+ * Reduces 16 signed bytes to their maximum (SSE4.1, implied by AVX2)
+ * @param v Vector to reduce
+ * @return int Maximum lane value
+ */
+__attribute__((target("avx2")))
+static inline int reduce_max_128(__m128i v)
+{
+    v = _mm_max_epi8(v, _mm_srli_si128(v, 8));
+    v = _mm_max_epi8(v, _mm_srli_si128(v, 4));
+    v = _mm_max_epi8(v, _mm_srli_si128(v, 2));
+    v = _mm_max_epi8(v, _mm_srli_si128(v, 1));
+    return (signed char)(_mm_cvtsi128_si32(v) & 0xff);
+}
+
+/*
+ * line_max_avx2
+ * AVX2 implementation, 128 bytes per iteration over four accumulators
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum value
+ */
+__attribute__((target("avx2")))
+static int line_max_avx2(const char* line, size_t length)
+{
+    __m256i acc0 = _mm256_setzero_si256(); // Starting at 0 gives the floor for free
+    __m256i acc1 = _mm256_setzero_si256();
+    __m256i acc2 = _mm256_setzero_si256();
+    __m256i acc3 = _mm256_setzero_si256();
+    size_t j = 0;
+
+    for (; j + 128 <= length; j += 128) {
+        acc0 = _mm256_max_epi8(acc0, _mm256_loadu_si256((const __m256i *)(line + j)));
+        acc1 = _mm256_max_epi8(acc1, _mm256_loadu_si256((const __m256i *)(line + j + 32)));
+        acc2 = _mm256_max_epi8(acc2, _mm256_loadu_si256((const __m256i *)(line + j + 64)));
+        acc3 = _mm256_max_epi8(acc3, _mm256_loadu_si256((const __m256i *)(line + j + 96)));
+    }
+    for (; j + 32 <= length; j += 32) {
+        acc0 = _mm256_max_epi8(acc0, _mm256_loadu_si256((const __m256i *)(line + j)));
+    }
+
+    __m256i v = _mm256_max_epi8(_mm256_max_epi8(acc0, acc1), _mm256_max_epi8(acc2, acc3));
+    __m128i half = _mm_max_epi8(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    if (j + 16 <= length) {
+        half = _mm_max_epi8(half, _mm_loadu_si128((const __m128i *)(line + j)));
+        j += 16;
+    }
+    int maxVal = reduce_max_128(half);
+
+    int tail = line_max_scalar(line + j, length - j);
+    return tail > maxVal ? tail : maxVal;
+}
+
+/*
+ * line_max_avx512
+ * AVX-512BW implementation. The tail uses a masked load, and the zeroed
+ * lanes cannot raise the result above the 0 floor.
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum value
+ */
+__attribute__((target("avx512f,avx512bw,avx2,bmi2")))
+static int line_max_avx512(const char* line, size_t length)
+{
+    __m512i acc0 = _mm512_setzero_si512();
+    __m512i acc1 = _mm512_setzero_si512();
+    size_t j = 0;
+
+    for (; j + 128 <= length; j += 128) {
+        acc0 = _mm512_max_epi8(acc0, _mm512_loadu_si512((const void *)(line + j)));
+        acc1 = _mm512_max_epi8(acc1, _mm512_loadu_si512((const void *)(line + j + 64)));
+    }
+    for (; j + 64 <= length; j += 64) {
+        acc0 = _mm512_max_epi8(acc0, _mm512_loadu_si512((const void *)(line + j)));
+    }
+    if (j < length) {
+        __mmask64 mask = _bzhi_u64(~0ULL, (unsigned)(length - j));
+        acc1 = _mm512_max_epi8(acc1, _mm512_maskz_loadu_epi8(mask, line + j));
+    }
+
+    __m512i v = _mm512_max_epi8(acc0, acc1);
+    __m256i quarter = _mm256_max_epi8(_mm512_castsi512_si256(v), _mm512_extracti64x4_epi64(v, 1));
+    __m128i half = _mm_max_epi8(_mm256_castsi256_si128(quarter), _mm256_extracti128_si256(quarter, 1));
+    return reduce_max_128(half);
+}
+
+/*
+ * reduce_max_epu8
+ * Reduces 16 unsigned bytes to their maximum
+ * @param v Vector to reduce
+ * @return int Maximum lane value
+ */
+__attribute__((target("sse2")))
+static inline int reduce_max_epu8(__m128i v)
+{
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 4));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 2));
+    v = _mm_max_epu8(v, _mm_srli_si128(v, 1));
+    return _mm_cvtsi128_si32(v) & 0xff;
+}
+
+/*
+ * line_max_unsigned_sse2
+ * SSE2 implementation of the unsigned byte max
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum value
+ */
+__attribute__((target("sse2")))
+static int line_max_unsigned_sse2(const char* line, size_t length)
+{
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    size_t j = 0;
+
+    for (; j + 32 <= length; j += 32) {
+        acc0 = _mm_max_epu8(acc0, _mm_loadu_si128((const __m128i *)(line + j)));
+        acc1 = _mm_max_epu8(acc1, _mm_loadu_si128((const __m128i *)(line + j + 16)));
+    }
+    for (; j + 16 <= length; j += 16) {
+        acc0 = _mm_max_epu8(acc0, _mm_loadu_si128((const __m128i *)(line + j)));
+    }
+    int maxVal = reduce_max_epu8(_mm_max_epu8(acc0, acc1));
+
+    int tail = line_max_unsigned_scalar(line + j, length - j);
+    return tail > maxVal ? tail : maxVal;
+}
+
+/*
+ * line_max_unsigned_avx2
+ * AVX2 implementation of the unsigned byte max
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum value
+ */
+__attribute__((target("avx2")))
+static int line_max_unsigned_avx2(const char* line, size_t length)
+{
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t j = 0;
+
+    for (; j + 64 <= length; j += 64) {
+        acc0 = _mm256_max_epu8(acc0, _mm256_loadu_si256((const __m256i *)(line + j)));
+        acc1 = _mm256_max_epu8(acc1, _mm256_loadu_si256((const __m256i *)(line + j + 32)));
+    }
+    for (; j + 32 <= length; j += 32) {
+        acc0 = _mm256_max_epu8(acc0, _mm256_loadu_si256((const __m256i *)(line + j)));
+    }
+
+    __m256i v = _mm256_max_epu8(acc0, acc1);
+    __m128i half = _mm_max_epu8(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    int maxVal = reduce_max_epu8(half);
+
+    int tail = line_max_unsigned_scalar(line + j, length - j);
+    return tail > maxVal ? tail : maxVal;
+}
+
+/*
+ * line_max_unsigned_avx512
+ * AVX-512BW implementation of the unsigned byte max, with a masked tail
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum value
+ */
+__attribute__((target("avx512f,avx512bw,avx2,bmi2")))
+static int line_max_unsigned_avx512(const char* line, size_t length)
+{
+    __m512i acc = _mm512_setzero_si512();
+    size_t j = 0;
+
+    for (; j + 64 <= length; j += 64) {
+        acc = _mm512_max_epu8(acc, _mm512_loadu_si512((const void *)(line + j)));
+    }
+    if (j < length) {
+        __mmask64 mask = _bzhi_u64(~0ULL, (unsigned)(length - j));
+        acc = _mm512_max_epu8(acc, _mm512_maskz_loadu_epi8(mask, line + j));
+    }
+
+    __m256i quarter = _mm256_max_epu8(_mm512_castsi512_si256(acc), _mm512_extracti64x4_epi64(acc, 1));
+    __m128i half = _mm_max_epu8(_mm256_castsi256_si128(quarter), _mm256_extracti128_si256(quarter, 1));
+    return reduce_max_epu8(half);
+}
+
+// Error bits of the UTF-8 lookup tables, see utf8_block_errors
+#define UTF8_TOO_SHORT (1 << 0) // Lead byte not followed by enough continuations
+#define UTF8_TOO_LONG (1 << 1) // Continuation byte after an ASCII byte
+#define UTF8_OVERLONG_3 (1 << 2)
+#define UTF8_TOO_LARGE (1 << 3) // Above U+10FFFF
+#define UTF8_SURROGATE (1 << 4)
+#define UTF8_OVERLONG_2 (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4 (1 << 6)
+#define UTF8_TWO_CONTS (1 << 7) // Two continuations where only 3rd/4th bytes may be
+#define UTF8_CARRY (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+// Lookup tables of the validator, indexed by a nibble
+static const unsigned char utf8_tables[3][16] __attribute__((aligned(16))) = {
+    { // High nibble of the first byte of a pair
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+    },
+    { // Low nibble of the first byte of a pair
+        UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+        UTF8_CARRY | UTF8_OVERLONG_2,
+        UTF8_CARRY,
+        UTF8_CARRY,
+        UTF8_CARRY | UTF8_TOO_LARGE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+    },
+    { // High nibble of the second byte of a pair
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+    },
+};
+
+// Subtracted from the last three bytes of a block to flag sequences that run past it
+static const unsigned char utf8_incomplete_limit[16] __attribute__((aligned(16))) = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1,
+};
+
+/*
+ * utf8_key_decode
+ * Decodes a key made by utf8_block_keys
+ * @param key Sequence bytes, first byte highest
+ * @return int Code point
+ */
+static int utf8_key_decode(uint32_t key)
+{
+    unsigned char bytes[4] = { (unsigned char)(key >> 24), (unsigned char)(key >> 16), (unsigned char)(key >> 8), (unsigned char)key };
+    size_t used;
+    return utf8_decode(bytes, sizeof(bytes), &used);
+}
+
+/*
+ * utf8_block_errors
+ * Checks 16 bytes with three 16-entry table lookups (Keiser and Lemire,
+ * "Validating UTF-8 in less than one instruction per byte"). Every pair of
+ * adjacent bytes is classified by the high nibble of both and the low nibble
+ * of the first, and the 3rd/4th byte rule is checked with saturating subtracts.
+ * @param input Current 16 bytes
+ * @param prev1 Bytes one before input (from the previous block, zero at the start of the line)
+ * @param prev2 Bytes two before input
+ * @param prev3 Bytes three before input
+ * @return __m128i Nonzero lanes where the bytes are not valid UTF-8
+ */
+__attribute__((target("ssse3")))
+static inline __m128i utf8_block_errors(__m128i input, __m128i prev1, __m128i prev2, __m128i prev3)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i byte_1_high = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)utf8_tables[0]), _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i byte_1_low = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)utf8_tables[1]), _mm_and_si128(prev1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(_mm_load_si128((const __m128i *)utf8_tables[2]), _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i special_cases = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    // Bytes two after a 3/4-byte lead or three after a 4-byte lead must be continuations
+    __m128i is_third_byte = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xe0 - 0x80)));
+    __m128i is_fourth_byte = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xf0 - 0x80)));
+    __m128i must_be_23 = _mm_and_si128(_mm_or_si128(is_third_byte, is_fourth_byte), _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must_be_23, special_cases);
+}
+
+/*
+ * utf8_block_keys
+ * Keeps the largest of the 4-byte windows ending in input, taken as
+ * big-endian keys of the sequences starting at prev3. Code points order the
+ * same way as their encodings, and in valid UTF-8 a window starting anywhere
+ * but a lead byte has a top byte below 0xc0, so it loses to every sequence.
+ * The bytes after a sequence only break ties between equal sequences, so the
+ * largest key decodes to the max. SSSE3 has no unsigned 32-bit max: the keys
+ * are kept with the top bit flipped and compared signed.
+ * @param input Current 16 bytes
+ * @param prev1 Bytes one before input
+ * @param prev2 Bytes two before input
+ * @param prev3 Bytes three before input
+ * @param best Largest keys so far, top bit flipped
+ * @return __m128i Largest keys including this block's, top bit flipped
+ */
+__attribute__((target("ssse3")))
+static inline __m128i utf8_block_keys(__m128i input, __m128i prev1, __m128i prev2, __m128i prev3, __m128i best)
+{
+    // Little-endian lanes, so the last byte of the window goes in first
+    __m128i low_lo = _mm_unpacklo_epi8(input, prev1);
+    __m128i low_hi = _mm_unpackhi_epi8(input, prev1);
+    __m128i lead = _mm_xor_si128(prev3, _mm_set1_epi8((char)0x80));
+    __m128i high_lo = _mm_unpacklo_epi8(prev2, lead);
+    __m128i high_hi = _mm_unpackhi_epi8(prev2, lead);
+    __m128i keys[4] = {
+        _mm_unpacklo_epi16(low_lo, high_lo), _mm_unpackhi_epi16(low_lo, high_lo),
+        _mm_unpacklo_epi16(low_hi, high_hi), _mm_unpackhi_epi16(low_hi, high_hi),
+    };
+    for (int k = 0; k < 4; k++) {
+        __m128i greater = _mm_cmpgt_epi32(keys[k], best);
+        best = _mm_or_si128(_mm_and_si128(greater, keys[k]), _mm_andnot_si128(greater, best));
+    }
+    return best;
+}
+
+/*
+ * line_max_utf8_ssse3
+ * Validates the line 16 bytes at a time (ASCII blocks only check that no
+ * sequence was left open) while keeping the max byte and the largest
+ * sequence key. The first invalid block sends the line to the scalar
+ * decoder for the U+FFFD handling.
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum code point
+ */
+__attribute__((target("ssse3")))
+static int line_max_utf8_ssse3(const char* line, size_t length)
+{
+    const __m128i incomplete_limit = _mm_load_si128((const __m128i *)utf8_incomplete_limit);
+    __m128i prev_input = _mm_setzero_si128();
+    __m128i prev_incomplete = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    __m128i best = _mm_set1_epi32(INT32_MIN); // Key 0 with the top bit flipped
+    int prev_high = 0;
+    char padded[16];
+
+    for (size_t j = 0; j < length; j += 16) {
+        __m128i input;
+        if (j + 16 <= length) {
+            input = _mm_loadu_si128((const __m128i *)(line + j));
+        } else {
+            // Zero padding makes a sequence cut off by the end of the line show up as too short
+            memset(padded, 0, sizeof(padded));
+            memcpy(padded, line + j, length - j);
+            input = _mm_loadu_si128((const __m128i *)padded);
+        }
+        int high = _mm_movemask_epi8(input);
+        __m128i error = prev_incomplete; // ASCII blocks only need the previous block's sequences closed
+        prev_incomplete = _mm_setzero_si128();
+        if (high != 0 || prev_high != 0) {
+            __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+            __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+            __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+            best = utf8_block_keys(input, prev1, prev2, prev3, best); // Only used once the whole line is valid
+            if (high != 0) {
+                error = utf8_block_errors(input, prev1, prev2, prev3); // Also checks sequences carried over from prev_input
+                prev_incomplete = _mm_subs_epu8(input, incomplete_limit);
+            }
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) != 0xffff) {
+            return line_max_utf8_scalar(line, length);
+        }
+        acc = _mm_max_epu8(acc, input);
+        prev_input = input;
+        prev_high = high;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(prev_incomplete, _mm_setzero_si128())) != 0xffff) {
+        return line_max_utf8_scalar(line, length);
+    }
+
+    int maxByte = reduce_max_epu8(acc);
+    if (maxByte < 0x80) {
+        return maxByte;
+    }
+
+    // Windows starting in the last three bytes of the line
+    const __m128i zero = _mm_setzero_si128();
+    best = utf8_block_keys(zero, _mm_alignr_epi8(zero, prev_input, 15), _mm_alignr_epi8(zero, prev_input, 14),
+                           _mm_alignr_epi8(zero, prev_input, 13), best);
+    int32_t keys[4];
+    _mm_storeu_si128((__m128i *)keys, best);
+    int32_t key = keys[0];
+    for (int k = 1; k < 4; k++) {
+        if (keys[k] > key) {
+            key = keys[k];
+        }
+    }
+    return utf8_key_decode((uint32_t)key ^ 0x80000000u);
+}
+
+/*
+ * utf8_block_errors_avx2
+ * utf8_block_errors over 32 bytes. The tables are repeated in both 128-bit
+ * lanes.
+ * @param input Current 32 bytes
+ * @param prev1 Bytes one before input (from the previous block, zero at the start of the line)
+ * @param prev2 Bytes two before input
+ * @param prev3 Bytes three before input
+ * @return __m256i Nonzero lanes where the bytes are not valid UTF-8
+ */
+__attribute__((target("avx2")))
+static inline __m256i utf8_block_errors_avx2(__m256i input, __m256i prev1, __m256i prev2, __m256i prev3)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    __m256i byte_1_high = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)utf8_tables[0])),
+                                              _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)utf8_tables[1])),
+                                             _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)utf8_tables[2])),
+                                              _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special_cases = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    __m256i is_third_byte = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80)));
+    __m256i is_fourth_byte = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80)));
+    __m256i must_be_23 = _mm256_and_si256(_mm256_or_si256(is_third_byte, is_fourth_byte), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_be_23, special_cases);
+}
+
+/*
+ * utf8_block_keys_avx2
+ * utf8_block_keys over 32 bytes, with the keys compared unsigned
+ * @param input Current 32 bytes
+ * @param prev1 Bytes one before input
+ * @param prev2 Bytes two before input
+ * @param prev3 Bytes three before input
+ * @param best Largest keys so far
+ * @return __m256i Largest keys including this block's
+ */
+__attribute__((target("avx2")))
+static inline __m256i utf8_block_keys_avx2(__m256i input, __m256i prev1, __m256i prev2, __m256i prev3, __m256i best)
+{
+    // The unpacks stay within 128-bit lanes, which only reorders the keys
+    __m256i low_lo = _mm256_unpacklo_epi8(input, prev1);
+    __m256i low_hi = _mm256_unpackhi_epi8(input, prev1);
+    __m256i high_lo = _mm256_unpacklo_epi8(prev2, prev3);
+    __m256i high_hi = _mm256_unpackhi_epi8(prev2, prev3);
+    best = _mm256_max_epu32(best, _mm256_max_epu32(_mm256_unpacklo_epi16(low_lo, high_lo), _mm256_unpackhi_epi16(low_lo, high_lo)));
+    return _mm256_max_epu32(best, _mm256_max_epu32(_mm256_unpacklo_epi16(low_hi, high_hi), _mm256_unpackhi_epi16(low_hi, high_hi)));
+}
+
+/*
+ * line_max_utf8_avx2
+ * line_max_utf8_ssse3 with 32-byte blocks. The previous bytes are brought
+ * across the 128-bit lane boundary with a permute before the byte shifts.
+ * @param line Pointer to the first byte of the line
+ * @param length Number of bytes in the line
+ * @return int Maximum code point
+ */
+__attribute__((target("avx2")))
+static int line_max_utf8_avx2(const char* line, size_t length)
+{
+    const __m256i incomplete_limit = _mm256_inserti128_si256(_mm256_set1_epi8((char)0xff),
+                                                             _mm_load_si128((const __m128i *)utf8_incomplete_limit), 1);
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    __m256i acc = _mm256_setzero_si256();
+    __m256i best = _mm256_setzero_si256();
+    int prev_high = 0;
+    char padded[32];
+
+    for (size_t j = 0; j < length; j += 32) {
+        __m256i input;
+        if (j + 32 <= length) {
+            input = _mm256_loadu_si256((const __m256i *)(line + j));
+        } else {
+            // Zero padding makes a sequence cut off by the end of the line show up as too short
+            memset(padded, 0, sizeof(padded));
+            memcpy(padded, line + j, length - j);
+            input = _mm256_loadu_si256((const __m256i *)padded);
+        }
+        int high = _mm256_movemask_epi8(input);
+        __m256i error = prev_incomplete; // ASCII blocks only need the previous block's sequences closed
+        prev_incomplete = _mm256_setzero_si256();
+        if (high != 0 || prev_high != 0) {
+            __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21); // Last 16 bytes of prev_input, first 16 of input
+            __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+            __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+            __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+            best = utf8_block_keys_avx2(input, prev1, prev2, prev3, best); // Only used once the whole line is valid
+            if (high != 0) {
+                error = utf8_block_errors_avx2(input, prev1, prev2, prev3); // Also checks sequences carried over from prev_input
+                prev_incomplete = _mm256_subs_epu8(input, incomplete_limit);
+            }
+        }
+        if (!_mm256_testz_si256(error, error)) {
+            return line_max_utf8_scalar(line, length);
+        }
+        acc = _mm256_max_epu8(acc, input);
+        prev_input = input;
+        prev_high = high;
+    }
+    if (!_mm256_testz_si256(prev_incomplete, prev_incomplete)) {
+        return line_max_utf8_scalar(line, length);
+    }
+
+    int maxByte = reduce_max_epu8(_mm_max_epu8(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+    if (maxByte < 0x80) {
+        return maxByte;
+    }
+
+    // Windows starting in the last three bytes of the line
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i shifted = _mm256_permute2x128_si256(prev_input, zero, 0x21);
+    best = utf8_block_keys_avx2(zero, _mm256_alignr_epi8(zero, shifted, 15), _mm256_alignr_epi8(zero, shifted, 14),
+                                _mm256_alignr_epi8(zero, shifted, 13), best);
+    uint32_t keys[8];
+    _mm256_storeu_si256((__m256i *)keys, best);
+    uint32_t key = keys[0];
+    for (int k = 1; k < 8; k++) {
+        if (keys[k] > key) {
+            key = keys[k];
+        }
+    }
+    return utf8_key_decode(key);
+}
+
+#endif
+
+// Table of the available implementations, best last, one column per semantics
+static const struct {
+    const char* name;
+    max_kernel_fn fn[3]; // Indexed by semantics_t
+} kernels[] = {
+    { "scalar", { line_max_scalar, line_max_unsigned_scalar, line_max_utf8_scalar } },
+#ifdef MAX_KERNEL_X86
+    { "sse2", { line_max_sse2, line_max_unsigned_sse2, line_max_utf8_scalar } },
+    { "ssse3", { line_max_sse2, line_max_unsigned_sse2, line_max_utf8_ssse3 } },
+    { "avx2", { line_max_avx2, line_max_unsigned_avx2, line_max_utf8_avx2 } },
+    { "avx512", { line_max_avx512, line_max_unsigned_avx512, line_max_utf8_avx2 } },
+#endif
+};
+
+#define NUM_KERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+max_kernel_fn max_kernel_impl = line_max_scalar;
+static const char* selected_name = "scalar";
+static semantics_t selected_semantics = SEMANTICS_SIGNED;
+
+/*
+ * kernel_supported
+ * Checks CPUID for the instructions an implementation needs
+ * @param index Index into kernels
+ * @return int Nonzero if the CPU can run it
+ */
+static int kernel_supported(int index)
+{
+#ifdef MAX_KERNEL_X86
+    __builtin_cpu_init();
+    if (strcmp(kernels[index].name, "sse2") == 0) {
+        return __builtin_cpu_supports("sse2");
+    }
+    if (strcmp(kernels[index].name, "ssse3") == 0) {
+        return __builtin_cpu_supports("ssse3");
+    }
+    if (strcmp(kernels[index].name, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+    if (strcmp(kernels[index].name, "avx512") == 0) {
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+            && __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("avx2");
+    }
+#endif
+    return index == 0;
+}
+
+/*
+ * max_kernel_select
+ * Picks the line_max implementation. Call once before starting any threads.
+ * @param name "scalar", "sse2", "ssse3", "avx2", "avx512", or NULL/"auto" for the best supported one
+ * @param semantics What the max is taken over
+ * @return int 0 on success, -1 if the name is unknown or the CPU lacks the instructions
+ */
+int max_kernel_select(const char* name, semantics_t semantics)
+{
+    int auto_select = name == NULL || strcmp(name, "auto") == 0;
+
+    for (int i = NUM_KERNELS - 1; i >= 0; i--) {
+        if (!auto_select && strcmp(kernels[i].name, name) != 0) {
+            continue;
+        }
+        if (!kernel_supported(i)) {
+            if (!auto_select) {
+                fprintf(stderr, "ERROR: This CPU does not support the %s kernel.\n", name);
+                return -1;
+            }
+            continue;
+        }
+        max_kernel_impl = kernels[i].fn[semantics];
+        selected_name = kernels[i].name;
+        selected_semantics = semantics;
+        return 0;
+    }
+
+    fprintf(stderr, "ERROR: Unknown kernel '%s'.\n", name);
+    return -1;
+}
+
+/*
+ * max_kernel_name
+ * Gets the name of the selected implementation
+ * @return const char* Implementation name
+ */
+const char* max_kernel_name(void)
+{
+    return selected_name;
+}
+
+/*
+ * max_kernel_semantics
+ * Gets what the selected implementation takes the max over
+ * @return semantics_t Selected semantics
+ */
+semantics_t max_kernel_semantics(void)
+{
+    return selected_semantics;
+}
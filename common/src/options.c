@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "options.h"
+#include "line_stats.h"
+
+/*
+ * parse_options
+ * Parses the optional flags that follow the positional arguments
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param first Index of the first optional argument
+ * @param options Pointer to the run_options_t structure to fill
+ * @return int 0 on success, -1 on an unknown flag or a missing value
+ */
+int parse_options(int argc, char* argv[], int first, run_options_t* options)
+{
+    memset(options, 0, sizeof(*options));
+    options->budget_mb = 64;
+    options->stats = STAT_MAX;
+    options->line_last = -1;
+
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], "--mmap") == 0) {
+            options->use_mmap = 1;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            options->output = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "text") == 0) {
+                options->format = FORMAT_TEXT;
+            } else if (strcmp(mode, "binary") == 0) {
+                options->format = FORMAT_BINARY;
+            } else if (strcmp(mode, "rle") == 0) {
+                options->format = FORMAT_RLE;
+            } else {
+                fprintf(stderr, "ERROR: Unknown results format '%s'.\n", mode);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            if (stats_parse(argv[++i], &options->stats) != 0) {
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--fused") == 0) {
+            options->fused = 1;
+        } else if (strcmp(argv[i], "--schedule") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "steal") == 0) {
+                options->schedule = SCHEDULE_STEAL;
+            } else if (strcmp(mode, "static") == 0) {
+                options->schedule = SCHEDULE_STATIC;
+            } else if (strcmp(mode, "dynamic") == 0) {
+                options->schedule = SCHEDULE_DYNAMIC;
+            } else {
+                fprintf(stderr, "ERROR: Unknown schedule '%s'.\n", mode);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--grain") == 0 && i + 1 < argc) {
+            options->grain = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--partition") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "lines") == 0) {
+                options->partition = PARTITION_LINES;
+            } else if (strcmp(mode, "bytes") == 0) {
+                options->partition = PARTITION_BYTES;
+            } else {
+                fprintf(stderr, "ERROR: Unknown partition '%s'.\n", mode);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--long-lines") == 0 && i + 1 < argc) {
+            long long bytes = atoll(argv[++i]);
+            if (bytes <= 0) {
+                fprintf(stderr, "ERROR: --long-lines needs a positive byte count.\n");
+                return -1;
+            }
+            options->long_lines = (size_t)bytes;
+        } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            options->index = argv[++i];
+        } else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+            const char* range = argv[++i];
+            const char* colon = strchr(range, ':');
+            if (!colon) {
+                fprintf(stderr, "ERROR: --lines needs a range like 5000000:6000000.\n");
+                return -1;
+            }
+            options->line_first = atoi(range);
+            options->line_last = colon[1] ? atoi(colon + 1) : -1;
+            if (options->line_first < 0 || (options->line_last >= 0 && options->line_last < options->line_first)) {
+                fprintf(stderr, "ERROR: --lines range '%s' is empty or negative.\n", range);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            options->report = argv[++i];
+        } else if (strcmp(argv[i], "--counters") == 0) {
+            options->counters = 1;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            options->trace = argv[++i];
+        } else if (strcmp(argv[i], "--waves") == 0 && i + 1 < argc) {
+            options->waves = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pin") == 0) {
+            options->pin = 1;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            options->stream = 1;
+        } else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+            options->budget_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            options->kernel = argv[++i];
+        } else if (strcmp(argv[i], "--semantics") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "signed") == 0) {
+                options->semantics = SEMANTICS_SIGNED;
+            } else if (strcmp(mode, "unsigned") == 0) {
+                options->semantics = SEMANTICS_UNSIGNED;
+            } else if (strcmp(mode, "codepoint") == 0 || strcmp(mode, "utf8") == 0) {
+                options->semantics = SEMANTICS_CODEPOINT;
+            } else {
+                fprintf(stderr, "ERROR: Unknown semantics '%s'.\n", mode);
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--dist") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "bcast") == 0) {
+                options->dist = DIST_BCAST;
+            } else if (strcmp(mode, "mpiio") == 0) {
+                options->dist = DIST_MPIIO;
+            } else if (strcmp(mode, "scatter") == 0) {
+                options->dist = DIST_SCATTER;
+            } else if (strcmp(mode, "shared") == 0) {
+                options->dist = DIST_SHARED;
+            } else if (strcmp(mode, "pipeline") == 0) {
+                options->dist = DIST_PIPELINE;
+            } else {
+                fprintf(stderr, "ERROR: Unknown distribution mode '%s'.\n", mode);
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "ERROR: Unknown option '%s'.\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (options->stats != STAT_MAX && options->semantics != SEMANTICS_SIGNED) {
+        fprintf(stderr, "ERROR: --stats works on signed bytes only.\n");
+        return -1;
+    }
+    if (options->long_lines > 0 && (options->stats != STAT_MAX || options->fused || options->stream)) {
+        fprintf(stderr, "ERROR: --long-lines needs the line store (no --fused or --stream) and max values only (no --stats).\n");
+        return -1;
+    }
+    if ((options->index || options->line_first > 0 || options->line_last >= 0) && (options->fused || options->stream)) {
+        fprintf(stderr, "ERROR: --index and --lines need the line store (no --fused or --stream).\n");
+        return -1;
+    }
+    if (options->counters && !options->report) {
+        fprintf(stderr, "ERROR: --counters adds to the --report phases, give a --report file too.\n");
+        return -1;
+    }
+    if ((options->line_first > 0 || options->line_last >= 0) && options->format != FORMAT_TEXT) {
+        fprintf(stderr, "ERROR: --lines writes text results only (binary results number their lines from 0).\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * options_line_count
+ * Works out how many lines to load: max_lines, but no more than --lines asks for
+ * @param options Parsed options
+ * @param max_lines The max_lines argument
+ * @return int Number of lines to load from options->line_first on
+ */
+int options_line_count(const run_options_t* options, int max_lines)
+{
+    if (options->line_last >= 0 && options->line_last - options->line_first < max_lines) {
+        return options->line_last - options->line_first;
+    }
+    return max_lines;
+}
@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include "output.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024 // Buffers per writev call (POSIX minimum is 16, Linux allows 1024)
+#endif
+
+// "00" to "99", so two digits are produced per division
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/*
+ * format_int
+ * Writes the decimal text of an int, the same text printf's %d gives
+ * @param out Pointer to at least 11 bytes
+ * @param value Value to format
+ * @return size_t Number of bytes written
+ */
+static size_t format_int(char* out, int value)
+{
+    char digits[10];
+    int pos = 10;
+    size_t length = 0;
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+
+    if (value < 0) {
+        out[length++] = '-';
+    }
+    while (magnitude >= 100) {
+        unsigned int pair = (magnitude % 100) * 2;
+        magnitude /= 100;
+        digits[--pos] = digit_pairs[pair + 1];
+        digits[--pos] = digit_pairs[pair];
+    }
+    if (magnitude >= 10) {
+        digits[--pos] = digit_pairs[magnitude * 2 + 1];
+        digits[--pos] = digit_pairs[magnitude * 2];
+    } else {
+        digits[--pos] = (char)('0' + magnitude);
+    }
+    memcpy(out + length, digits + pos, (size_t)(10 - pos));
+    return length + (size_t)(10 - pos);
+}
+
+/*
+ * results_format
+ * Formats results exactly like printf("%d: %d\n", i, values[i]), without
+ * going through stdio
+ * @param out Pointer to at least count * RESULT_LINE_MAX bytes
+ * @param values Max value of each line
+ * @param first_index Line number of values[0]
+ * @param count Number of results
+ * @return size_t Number of bytes written
+ */
+size_t results_format(char* out, const int* values, int first_index, int count)
+{
+    char* pos = out;
+    for (int i = 0; i < count; i++) {
+        pos += format_int(pos, first_index + i);
+        *pos++ = ':';
+        *pos++ = ' ';
+        pos += format_int(pos, values[i]);
+        *pos++ = '\n';
+    }
+    return (size_t)(pos - out);
+}
+
+/*
+ * results_format_alloc
+ * Formats results into a buffer allocated for them
+ * @param values Max value of each line
+ * @param first_index Line number of values[0]
+ * @param count Number of results
+ * @param length Set to the number of bytes formatted
+ * @return char* The buffer (free it), NULL on allocation failure
+ */
+char* results_format_alloc(const int* values, int first_index, int count, size_t* length)
+{
+    char* out = (char *)malloc(count > 0 ? (size_t)count * RESULT_LINE_MAX : 1);
+    if (!out) {
+        return NULL;
+    }
+    *length = results_format(out, values, first_index, count);
+    return out;
+}
+
+/*
+ * results_write
+ * Writes the buffers in order with writev, IOV_MAX at a time, picking up
+ * where a partial write stopped
+ * @param fd File descriptor to write to
+ * @param iov Buffers to write (modified while writing)
+ * @param count Number of buffers
+ * @return int 0 on success, -1 on a write error
+ */
+int results_write(int fd, struct iovec* iov, int count)
+{
+    while (count > 0) {
+        int batch = count < IOV_MAX ? count : IOV_MAX;
+        ssize_t written = writev(fd, iov, batch);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+
+        // Skip the buffers that were written completely, trim the one cut short
+        while (count > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    return 0;
+}
+
+/*
+ * results_open
+ * Opens (creating or truncating) the file the results are written to
+ * @param path Results file, or NULL for standard output
+ * @return int File descriptor, -1 on failure
+ */
+int results_open(const char* path)
+{
+    if (!path) {
+        fflush(stdout); // Anything printed before the results goes first
+        return STDOUT_FILENO;
+    }
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
@@ -0,0 +1,54 @@
+#include <stdint.h>
+#include "partition.h"
+
+/*
+ * partition_lines
+ * Cuts the lines of a store into num_parts contiguous ranges. Part p gets
+ * lines [bounds[p], bounds[p + 1]). PARTITION_LINES gives every part the
+ * same number of lines, spreading the remainder over the first parts.
+ * PARTITION_BYTES uses the offsets array, which is already a prefix sum of
+ * the line lengths, and cuts where it crosses each multiple of
+ * data_size / num_parts. The work per line is proportional to its bytes, so
+ * this evens out skewed inputs that a count split leaves unbalanced.
+ * @param store Pointer to the line store to split
+ * @param num_parts Number of ranges
+ * @param mode How to weigh the lines
+ * @param bounds Array of num_parts + 1 line indexes to fill
+ */
+void partition_lines(const line_store_t* store, int num_parts, partition_mode_t mode, int* bounds)
+{
+    int num_lines = store->num_lines;
+
+    if (mode == PARTITION_LINES || num_lines == 0) {
+        int lines_per_part = num_lines / num_parts;
+        int remainder = num_lines % num_parts;
+        for (int p = 0; p <= num_parts; p++) {
+            bounds[p] = p * lines_per_part + (p < remainder ? p : remainder);
+        }
+        return;
+    }
+
+    const uint64_t* offsets = store->offsets;
+    uint64_t base = offsets[0];
+    uint64_t total = offsets[num_lines] - base;
+    int low = 0; // Every cut is at or after the previous one
+
+    bounds[0] = 0;
+    for (int p = 1; p < num_parts; p++) {
+        // Split the multiply so total * p cannot overflow
+        uint64_t target = base + total / num_parts * p + total % num_parts * p / num_parts;
+
+        // First line that starts at or after the target byte
+        int high = num_lines;
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (offsets[mid] < target) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        bounds[p] = low;
+    }
+    bounds[num_parts] = num_lines;
+}
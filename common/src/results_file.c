@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "results_file.h"
+#include "output.h"
+
+/*
+ * value_at
+ * Reads the i-th value of a width-byte value array
+ * @param values Pointer to the array
+ * @param width Bytes per value (1 or 4)
+ * @param i Index
+ * @return int Value
+ */
+static inline int value_at(const unsigned char* values, uint32_t width, uint64_t i)
+{
+    if (width == 1) {
+        return values[i];
+    }
+    int32_t value;
+    memcpy(&value, values + i * 4, sizeof(value));
+    return value;
+}
+
+/*
+ * store_values
+ * Packs values into width-byte slots
+ * @param out Destination, count * width bytes
+ * @param values Values to pack
+ * @param count Number of values
+ * @param width Bytes per value (1 or 4)
+ */
+static void store_values(unsigned char* out, const int* values, uint64_t count, uint32_t width)
+{
+    for (uint64_t i = 0; i < count; i++) {
+        if (width == 1) {
+            out[i] = (unsigned char)values[i];
+        } else {
+            int32_t value = values[i];
+            memcpy(out + i * 4, &value, sizeof(value));
+        }
+    }
+}
+
+/*
+ * results_file_write
+ * Writes the results as a header and a value array. Values are one byte
+ * each when all of them fit in 0..255 (always the case for byte maxima).
+ * With rle the array holds one value per run of equal values, after the
+ * run ends, which shrinks the long runs of the same max in typical text.
+ * @param fd File descriptor to write to
+ * @param values Max value of each line
+ * @param count Number of lines
+ * @param rle Nonzero to run-length encode the values
+ * @return int 0 on success, -1 on failure
+ */
+int results_file_write(int fd, const int* values, int count, int rle)
+{
+    results_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RESULTS_MAGIC, 4);
+    header.version = RESULTS_VERSION;
+    header.flags = rle ? RESULTS_RLE : 0;
+    header.width = 1;
+    header.count = (uint64_t)count;
+    for (int i = 0; i < count; i++) {
+        if (values[i] < 0 || values[i] > 255) {
+            header.width = 4;
+            break;
+        }
+    }
+
+    uint64_t* run_ends = NULL;
+    int* run_values = NULL;
+    const int* packed = values; // Values to pack after the header (per line, or per run)
+    uint64_t packed_count = (uint64_t)count;
+    if (rle) {
+        run_ends = (uint64_t *)malloc((count > 0 ? (size_t)count : 1) * sizeof(uint64_t));
+        run_values = (int *)malloc((count > 0 ? (size_t)count : 1) * sizeof(int));
+        if (!run_ends || !run_values) {
+            free(run_ends);
+            free(run_values);
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (header.num_runs > 0 && run_values[header.num_runs - 1] == values[i]) {
+                run_ends[header.num_runs - 1]++;
+            } else {
+                run_values[header.num_runs] = values[i];
+                run_ends[header.num_runs++] = (uint64_t)i + 1;
+            }
+        }
+        packed = run_values;
+        packed_count = header.num_runs;
+    }
+
+    unsigned char* payload = (unsigned char *)malloc(packed_count > 0 ? packed_count * header.width : 1);
+    if (!payload) {
+        free(run_ends);
+        free(run_values);
+        return -1;
+    }
+    store_values(payload, packed, packed_count, header.width);
+
+    struct iovec iov[3] = {
+        { &header, sizeof(header) },
+        { run_ends, rle ? header.num_runs * sizeof(uint64_t) : 0 },
+        { payload, packed_count * header.width },
+    };
+    int status = results_write(fd, iov, 3);
+
+    free(payload);
+    free(run_ends);
+    free(run_values);
+    return status;
+}
+
+/*
+ * results_file_open
+ * Maps a binary results file read-only and checks that its header and sizes
+ * are consistent, so lookups need no further checks
+ * @param file Pointer to the results_file_t to fill
+ * @param path Results file
+ * @return int 0 on success, -1 if the file cannot be read or is not a results file
+ */
+int results_file_open(results_file_t* file, const char* path)
+{
+    memset(file, 0, sizeof(*file));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(results_header_t)) {
+        close(fd);
+        return -1;
+    }
+    void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping stays valid after the descriptor is closed
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    file->map = (const unsigned char *)map;
+    file->size = (size_t)st.st_size;
+    file->header = (const results_header_t *)map;
+
+    const results_header_t* header = file->header;
+    uint64_t body = file->size - sizeof(results_header_t);
+    int valid = memcmp(header->magic, RESULTS_MAGIC, 4) == 0 && header->version == RESULTS_VERSION
+                && (header->width == 1 || header->width == 4);
+    if (valid && (header->flags & RESULTS_RLE)) {
+        uint64_t run_size = sizeof(uint64_t) + header->width;
+        valid = header->num_runs <= header->count && (header->num_runs == 0) == (header->count == 0)
+                && header->num_runs <= body / run_size && body == header->num_runs * run_size;
+        file->run_ends = (const uint64_t *)(file->map + sizeof(results_header_t));
+        file->values = file->map + sizeof(results_header_t) + header->num_runs * sizeof(uint64_t);
+        if (valid && header->num_runs > 0) {
+            valid = file->run_ends[header->num_runs - 1] == header->count;
+        }
+    } else if (valid) {
+        valid = header->count <= body / header->width && body == header->count * header->width;
+        file->values = file->map + sizeof(results_header_t);
+    }
+    if (!valid) {
+        results_file_close(file);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * find_run
+ * Finds the run holding a line with a binary search over the run ends
+ * @param file Pointer to an open RLE results file
+ * @param index Line index (less than the line count)
+ * @return uint64_t Run index
+ */
+static uint64_t find_run(const results_file_t* file, uint64_t index)
+{
+    uint64_t low = 0;
+    uint64_t high = file->header->num_runs - 1;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (file->run_ends[mid] <= index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/*
+ * results_file_get
+ * Looks up the max value of one line
+ * @param file Pointer to an open results file
+ * @param index Line index (less than the line count)
+ * @return int Max value of the line
+ */
+int results_file_get(const results_file_t* file, uint64_t index)
+{
+    if (file->header->flags & RESULTS_RLE) {
+        return value_at(file->values, file->header->width, find_run(file, index));
+    }
+    return value_at(file->values, file->header->width, index);
+}
+
+/*
+ * results_file_range
+ * Copies the max values of a range of lines, walking the runs in order
+ * @param file Pointer to an open results file
+ * @param first First line (first + count must not exceed the line count)
+ * @param count Number of lines
+ * @param out Destination, count ints
+ */
+void results_file_range(const results_file_t* file, uint64_t first, uint64_t count, int* out)
+{
+    uint32_t width = file->header->width;
+    if (!(file->header->flags & RESULTS_RLE)) {
+        for (uint64_t i = 0; i < count; i++) {
+            out[i] = value_at(file->values, width, first + i);
+        }
+        return;
+    }
+
+    uint64_t run = count > 0 ? find_run(file, first) : 0;
+    for (uint64_t i = 0; i < count; i++) {
+        if (file->run_ends[run] <= first + i) {
+            run++;
+        }
+        out[i] = value_at(file->values, width, run);
+    }
+}
+
+/*
+ * results_file_close
+ * Unmaps the file
+ * @param file Pointer to the results file
+ */
+void results_file_close(results_file_t* file)
+{
+    if (file->map) {
+        munmap((void *)file->map, file->size);
+    }
+    memset(file, 0, sizeof(*file));
+}
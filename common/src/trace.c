@@ -0,0 +1,220 @@
+#define _GNU_SOURCE // open_memstream is hidden by the pthreads build's _XOPEN_SOURCE=500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+// Events of one thread. Only the owning thread writes it, so it needs no lock or atomics,
+// and each ring sits on its own cache lines so threads never share one.
+typedef struct trace_ring {
+    trace_event_t* events; // TRACE_CAPACITY events, written in a circle
+    uint64_t count; // Events ever recorded, the next one goes to count % TRACE_CAPACITY
+    const char* name; // Thread name in the viewer, NULL for the default
+} __attribute__((aligned(64))) trace_ring_t;
+
+static trace_ring_t* rings = NULL; // One ring per slot, NULL while tracing is off
+static int num_rings = 0;
+
+/*
+ * trace_init
+ * Starts tracing. Slot TRACE_MAIN is the main thread, slot 1 + t worker t,
+ * so a program with n workers asks for n + 1 slots. The rings are zeroed
+ * lazily by the kernel, so a slot that records little costs little memory.
+ * @param num_slots Number of per-thread rings
+ * @return int 0 on success, -1 on allocation failure
+ */
+int trace_init(int num_slots)
+{
+    rings = (trace_ring_t *)aligned_alloc(64, (size_t)num_slots * sizeof(trace_ring_t));
+    if (!rings) {
+        return -1;
+    }
+    memset(rings, 0, (size_t)num_slots * sizeof(trace_ring_t));
+    num_rings = num_slots;
+    for (int s = 0; s < num_slots; s++) {
+        rings[s].events = (trace_event_t *)calloc(TRACE_CAPACITY, sizeof(trace_event_t));
+        if (!rings[s].events) {
+            trace_free();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * trace_name
+ * Names the thread of a slot in the viewer, for threads that are neither
+ * main nor a numbered worker
+ * @param slot Thread slot to name (ignored if out of range)
+ * @param name Thread name, must outlive the trace (a string literal)
+ */
+void trace_name(int slot, const char* name)
+{
+    if (rings && slot >= 0 && slot < num_rings) {
+        rings[slot].name = name;
+    }
+}
+
+/*
+ * trace_now
+ * Reads the wall clock. CLOCK_REALTIME rather than CLOCK_MONOTONIC so the
+ * timelines of MPI ranks on different nodes line up.
+ * @return int64_t Nanoseconds since the epoch, 0 while tracing is off
+ */
+int64_t trace_now(void)
+{
+    if (!rings) {
+        return 0;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*
+ * trace_event
+ * Records a span that started at start_ns and ends now. Only the thread
+ * that owns the slot may call it; once the ring is full the oldest events
+ * are overwritten.
+ * @param slot Thread slot to record into (ignored if out of range)
+ * @param name Span name, must outlive the trace (a string literal)
+ * @param start_ns trace_now() at the start of the span
+ * @param arg_name Name of arg in the viewer, a string literal or NULL
+ * @param arg Value shown with the span
+ */
+void trace_event(int slot, const char* name, int64_t start_ns, const char* arg_name, uint64_t arg)
+{
+    if (!rings || slot < 0 || slot >= num_rings) {
+        return;
+    }
+    trace_ring_t* ring = &rings[slot];
+    trace_event_t* event = &ring->events[ring->count & (TRACE_CAPACITY - 1)];
+    event->start_ns = start_ns;
+    event->end_ns = trace_now();
+    event->name = name;
+    event->arg_name = arg_name;
+    event->arg = arg;
+    ring->count++;
+}
+
+/*
+ * trace_first_ns
+ * Finds the earliest start still held by any ring, so every rank can
+ * measure its times from the same base
+ * @return int64_t Earliest start, INT64_MAX if nothing was recorded
+ */
+int64_t trace_first_ns(void)
+{
+    int64_t first = INT64_MAX;
+    for (int s = 0; s < num_rings; s++) {
+        uint64_t held = rings[s].count < TRACE_CAPACITY ? rings[s].count : TRACE_CAPACITY;
+        for (uint64_t e = rings[s].count - held; e < rings[s].count; e++) {
+            int64_t start = rings[s].events[e & (TRACE_CAPACITY - 1)].start_ns;
+            if (start < first) {
+                first = start;
+            }
+        }
+    }
+    return first;
+}
+
+/*
+ * trace_format_alloc
+ * Formats every held event as a Chrome trace "complete" event, plus the
+ * process and thread names, separated by commas and without the enclosing
+ * array so the events of several ranks can be joined. A thread that
+ * overwrote events says how many in its name.
+ * @param pid Process id in the viewer (the MPI rank, 0 for the threaded programs)
+ * @param process_name Name of the process in the viewer
+ * @param base_ns Wall clock shown as time 0
+ * @param length Set to the length of the text
+ * @return char* The text (free() it), NULL on allocation failure
+ */
+char* trace_format_alloc(int pid, const char* process_name, int64_t base_ns, size_t* length)
+{
+    char* text = NULL;
+    FILE* stream = open_memstream(&text, length);
+    if (!stream) {
+        return NULL;
+    }
+
+    fprintf(stream, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}}", pid, process_name);
+    for (int s = 0; s < num_rings; s++) {
+        const trace_ring_t* ring = &rings[s];
+        if (ring->count == 0) {
+            continue;
+        }
+        uint64_t held = ring->count < TRACE_CAPACITY ? ring->count : TRACE_CAPACITY;
+
+        fprintf(stream, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"", pid, s);
+        if (ring->name) {
+            fprintf(stream, "%s", ring->name);
+        } else if (s == TRACE_MAIN) {
+            fprintf(stream, "main");
+        } else {
+            fprintf(stream, "worker %d", s - 1);
+        }
+        if (ring->count > held) {
+            fprintf(stream, " (%llu events dropped)", (unsigned long long)(ring->count - held));
+        }
+        fprintf(stream, "\"}}");
+
+        for (uint64_t e = ring->count - held; e < ring->count; e++) {
+            const trace_event_t* event = &ring->events[e & (TRACE_CAPACITY - 1)];
+            fprintf(stream, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    event->name, pid, s, (event->start_ns - base_ns) / 1e3, (event->end_ns - event->start_ns) / 1e3);
+            if (event->arg_name) {
+                fprintf(stream, ",\"args\":{\"%s\":%llu}", event->arg_name, (unsigned long long)event->arg);
+            }
+            fprintf(stream, "}");
+        }
+    }
+
+    if (fclose(stream) != 0) {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+/*
+ * trace_write_file
+ * Wraps formatted events in the JSON object format of the Chrome trace
+ * viewer, which Perfetto (ui.perfetto.dev) and chrome://tracing both open
+ * @param path Trace filename
+ * @param events Comma-separated events from trace_format_alloc
+ * @param length Length of events
+ * @return int 0 on success, -1 on a write error
+ */
+int trace_write_file(const char* path, const char* events, size_t length)
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return -1;
+    }
+    int status = 0;
+    if (fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n") < 0
+        || fwrite(events, 1, length, file) != length || fprintf(file, "\n]}\n") < 0) {
+        status = -1;
+    }
+    if (fclose(file) != 0) {
+        status = -1;
+    }
+    return status;
+}
+
+/*
+ * trace_free
+ * Stops tracing and frees the rings
+ */
+void trace_free(void)
+{
+    for (int s = 0; s < num_rings; s++) {
+        free(rings[s].events);
+    }
+    free(rings);
+    rings = NULL;
+    num_rings = 0;
+}
@@ -0,0 +1,335 @@
+#!/bin/sh
+#SBATCH --mem=16G
+#SBATCH --time=24:00:00
+#SBATCH --job-name=bench
+#SBATCH --nodes=1
+#SBATCH --ntasks-per-node=20
+#SBATCH --nodelist=mole[001-040,053-079,081-120]
+
+# Scaling benchmark of the max char finders: runs every backend x thread/rank
+# count x input size, with warmup runs and repetitions, and summarizes the
+# --report of every run as CSV, JSON and a table.
+#
+# Locally:     sh tools/bench.sh [options] <input_file>
+# Under SLURM: sbatch tools/bench.sh [options] <input_file>  (from the repository root)
+#
+# The counts should fit the allocation: request --ntasks-per-node for the
+# largest count (or --nodes for hybrid ranks). Without SLURM, MPI runs use
+# mpirun --oversubscribe, so any count works but more ranks than cores only
+# shows the overhead.
+
+usage()
+{
+    cat <<EOF
+Usage: sh tools/bench.sh [options] <input_file>
+  --backends <list>  Backends to run: pthreads,openmp,mpi,hybrid (default pthreads,openmp,mpi)
+  --counts <list>    Threads (pthreads, openmp) or ranks (mpi, hybrid) to run with (default 1,2,4,8,16,20)
+  --lines <list>     max_lines values, the input sizes (default 100,10000,100000)
+  --reps <n>         Measured runs of every combination (default 5)
+  --warmup <n>       Unmeasured runs before them (default 1)
+  --cache <mode>     warm, cold (input dropped from the page cache before every run) or both (default warm)
+  --threads <n>      OpenMP threads per hybrid rank (default \$SLURM_CPUS_PER_TASK or 2)
+  --args "<opts>"    Extra options for every run, such as "--dist scatter" or "--long-lines 65536"
+  --out <dir>        Directory for the results (default bench-<date>-<time>)
+EOF
+}
+
+backends="pthreads,openmp,mpi"
+counts="1,2,4,8,16,20"
+sizes="100,10000,100000"
+reps=5
+warmup=1
+cache="warm"
+hybrid_threads="${SLURM_CPUS_PER_TASK:-2}"
+extra=""
+out=""
+input=""
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        --backends) backends="$2"; shift 2 ;;
+        --counts) counts="$2"; shift 2 ;;
+        --lines) sizes="$2"; shift 2 ;;
+        --reps) reps="$2"; shift 2 ;;
+        --warmup) warmup="$2"; shift 2 ;;
+        --cache) cache="$2"; shift 2 ;;
+        --threads) hybrid_threads="$2"; shift 2 ;;
+        --args) extra="$2"; shift 2 ;;
+        --out) out="$2"; shift 2 ;;
+        -h|--help) usage; exit 0 ;;
+        -*) echo "ERROR: Unknown option $1." >&2; usage >&2; exit 1 ;;
+        *) input="$1"; shift ;;
+    esac
+done
+
+if [ -z "$input" ] || [ ! -r "$input" ]; then
+    echo "ERROR: Give a readable input file." >&2
+    usage >&2
+    exit 1
+fi
+case "$cache" in
+    warm|cold) cache_modes="$cache" ;;
+    both) cache_modes="warm cold" ;;
+    *) echo "ERROR: --cache is warm, cold or both." >&2; exit 1 ;;
+esac
+case "$extra" in
+    *--report*|*--output*|*--trace*) echo "ERROR: --args cannot set --report, --output or --trace, the harness uses them." >&2; exit 1 ;;
+esac
+
+# sbatch runs a copy of the script from its spool directory, so find the repository from where it was submitted
+root=$(cd "$(dirname "$0")/.." 2>/dev/null && pwd)
+if [ ! -d "$root/3way-mpi" ] && [ -n "$SLURM_SUBMIT_DIR" ]; then
+    root="$SLURM_SUBMIT_DIR"
+fi
+if [ ! -d "$root/3way-mpi" ]; then
+    echo "ERROR: Run the harness from the repository root." >&2
+    exit 1
+fi
+input=$(cd "$(dirname "$input")" && pwd)/$(basename "$input")
+
+out="${out:-bench-$(date +%Y%m%d-%H%M%S)}"
+mkdir -p "$out/raw" || exit 1
+out=$(cd "$out" && pwd)
+backends=$(echo "$backends" | tr ',' ' ')
+counts=$(echo "$counts" | tr ',' ' ')
+sizes=$(echo "$sizes" | tr ',' ' ')
+
+# Build what will be run
+for backend in $backends; do
+    case "$backend" in
+        pthreads|openmp|mpi|hybrid) ;;
+        *) echo "ERROR: Unknown backend $backend." >&2; exit 1 ;;
+    esac
+    make -s -C "$root/3way-$backend/build" || exit 1
+done
+
+# Inside a SLURM allocation mpirun takes the hosts from it, elsewhere every rank runs on this machine
+mpi_flags=""
+if [ -z "$SLURM_JOB_ID" ]; then
+    mpi_flags="--oversubscribe"
+    if [ "$(id -u)" = "0" ]; then
+        mpi_flags="$mpi_flags --allow-run-as-root"
+    fi
+fi
+
+# drop_cache
+# Evicts the input from the page cache of every node in the job (dd's
+# nocache flag asks the kernel to drop the file's clean pages, which needs
+# no root), so the next run reads it from disk
+drop_cache()
+{
+    if [ -n "$SLURM_JOB_ID" ] && command -v srun >/dev/null 2>&1; then
+        srun --ntasks-per-node=1 dd if="$input" iflag=nocache count=0 status=none
+    else
+        dd if="$input" iflag=nocache count=0 status=none
+    fi
+}
+
+# run_program <backend> <count> <lines> <report> <log>
+# Runs one backend once, writing its results to a scratch file
+run_program()
+{
+    results="$out/raw/results.tmp"
+    case "$1" in
+        pthreads) "$root/3way-pthreads/build/pthreads_program" "$input" "$3" "$2" $extra --output "$results" --report "$4" > "$5" 2>&1 ;;
+        openmp) "$root/3way-openmp/build/openmp_program" "$input" "$3" "$2" $extra --output "$results" --report "$4" > "$5" 2>&1 ;;
+        mpi) mpirun $mpi_flags -np "$2" "$root/3way-mpi/build/mpi_program" "$input" "$3" $extra --output "$results" --report "$4" > "$5" 2>&1 ;;
+        hybrid) mpirun $mpi_flags -np "$2" --map-by node --bind-to none "$root/3way-hybrid/build/hybrid_program" "$input" "$3" "$hybrid_threads" \
+                    $extra --output "$results" --report "$4" > "$5" 2>&1 ;;
+    esac
+}
+
+# Phase times of a report (the span of each phase over all threads and ranks), its total and the summed node peaks
+read_report()
+{
+    awk '
+        /^  "phases": \{/ { top = 1; next }
+        top && /^  \}/ { top = 0 }
+        top && match($0, /"wall_us": [0-9.]+/) {
+            split($0, name, "\"")
+            wall[name[2]] = substr($0, RSTART + 11, RLENGTH - 11)
+        }
+        /^  "total_us": / { total = $2; sub(/,$/, "", total) }
+        /^  "nodes": / { nodes = 1 }
+        nodes && match($0, /"vm_hwm_kb": [0-9]+/) { hwm += substr($0, RSTART + 13, RLENGTH - 13) }
+        END {
+            printf "%s,%s,%s,%s,%s,%s,%s,%s", total, wall["read"], wall["distribute"], wall["compute"],
+                   wall["gather"], wall["format"], wall["write"], hwm
+        }' "$1"
+}
+
+runs="$out/runs.csv"
+echo "backend,count,workers,lines,cache,rep,status,runtime_us,total_us,read_us,distribute_us,compute_us,gather_us,format_us,write_us,peak_rss_kb" > "$runs"
+{
+    echo "input: $input"
+    echo "host: $(hostname)"
+    echo "slurm_job: ${SLURM_JOB_ID:-none}"
+    echo "backends: $backends"
+    echo "counts: $counts"
+    echo "lines: $sizes"
+    echo "reps: $reps, warmup: $warmup, cache: $cache"
+    echo "hybrid threads per rank: $hybrid_threads"
+    echo "extra options: $extra"
+    echo "commit: $(git -C "$root" rev-parse --short HEAD 2>/dev/null)"
+} > "$out/config.txt"
+
+for backend in $backends; do
+    for lines in $sizes; do
+        for mode in $cache_modes; do
+            for count in $counts; do
+                workers=$count
+                if [ "$backend" = "hybrid" ]; then
+                    workers=$((count * hybrid_threads))
+                fi
+                echo "$backend, $count x, $lines lines, $mode cache" >&2
+                rep=$((-warmup + 1))
+                while [ "$rep" -le "$reps" ]; do
+                    name="$backend-$count-$lines-$mode-$rep"
+                    if [ "$mode" = "cold" ]; then
+                        drop_cache
+                    fi
+                    if run_program "$backend" "$count" "$lines" "$out/raw/$name.json" "$out/raw/$name.log" && [ -s "$out/raw/$name.json" ]; then
+                        status="ok"
+                    else
+                        status="failed"
+                        echo "WARNING: $name failed, see $out/raw/$name.log" >&2
+                    fi
+                    if [ "$rep" -ge 1 ]; then
+                        runtime=$(awk '/^Total runtime: / { print $3 }' "$out/raw/$name.log")
+                        metrics=",,,,,,,"
+                        if [ "$status" = "ok" ]; then
+                            metrics=$(read_report "$out/raw/$name.json")
+                        fi
+                        echo "$backend,$count,$workers,$lines,$mode,$rep,$status,$runtime,$metrics" >> "$runs"
+                    else
+                        rm -f "$out/raw/$name.json" "$out/raw/$name.log" # Warmup runs are not kept
+                    fi
+                    rep=$((rep + 1))
+                done
+            done
+        done
+    done
+done
+rm -f "$out/raw/results.tmp"
+
+# Median, standard deviation, speedup and efficiency of every combination. Speedup is
+# against the smallest count of the same backend, input size and cache mode.
+awk -F, '
+    # Sorts v[1..n] in place (insertion sort, there are only a few repetitions)
+    function sort(v, n,    i, j, x) {
+        for (i = 2; i <= n; i++) {
+            x = v[i]
+            for (j = i - 1; j >= 1 && v[j] > x; j--) {
+                v[j + 1] = v[j]
+            }
+            v[j + 1] = x
+        }
+    }
+    function median(v, n) {
+        sort(v, n)
+        return n % 2 ? v[(n + 1) / 2] : (v[n / 2] + v[n / 2 + 1]) / 2
+    }
+    NR == 1 { next }
+    {
+        key = $1 SUBSEP $4 SUBSEP $5 SUBSEP $2
+        if (!(key in workers)) {
+            workers[key] = $3
+            keys[++num_keys] = key
+        }
+        if ($7 != "ok") {
+            failed[key]++
+            next
+        }
+        n = ++runs[key]
+        total[key, n] = $9
+        compute[key, n] = $12
+        peak[key, n] = $16
+        group = $1 SUBSEP $4 SUBSEP $5
+        if (!(group in base_count) || $2 + 0 < base_count[group] + 0) {
+            base_count[group] = $2
+        }
+    }
+    END {
+        print "backend,lines,cache,count,workers,runs,failed,median_us,stddev_us,min_us,median_compute_us,median_peak_rss_kb,speedup,efficiency"
+        # Medians first, the speedups need the one of the smallest count
+        for (k = 1; k <= num_keys; k++) {
+            key = keys[k]
+            n = runs[key]
+            if (n == 0) {
+                continue
+            }
+            sum = 0
+            for (i = 1; i <= n; i++) {
+                t[i] = total[key, i]
+                c[i] = compute[key, i]
+                p[i] = peak[key, i]
+                sum += t[i]
+            }
+            mean = sum / n
+            squares = 0
+            for (i = 1; i <= n; i++) {
+                squares += (t[i] - mean) ^ 2
+            }
+            stddev[key] = n > 1 ? sqrt(squares / (n - 1)) : 0
+            med[key] = median(t, n)
+            low[key] = t[1]
+            med_compute[key] = median(c, n)
+            med_peak[key] = median(p, n)
+        }
+        for (k = 1; k <= num_keys; k++) {
+            key = keys[k]
+            split(key, part, SUBSEP)
+            printf "%s,%s,%s,%s,%s,%d,%d", part[1], part[2], part[3], part[4], workers[key], runs[key], failed[key]
+            group = part[1] SUBSEP part[2] SUBSEP part[3]
+            base = group SUBSEP base_count[group]
+            if (!(key in med)) {
+                printf ",,,,,,,\n"
+            } else if (!(base in med) || med[key] <= 0) {
+                printf ",%.1f,%.1f,%.1f,%.1f,%d,,\n", med[key], stddev[key], low[key], med_compute[key], med_peak[key]
+            } else {
+                speedup = med[base] / med[key]
+                printf ",%.1f,%.1f,%.1f,%.1f,%d,%.3f,%.3f\n", med[key], stddev[key], low[key], med_compute[key], med_peak[key],
+                       speedup, speedup * workers[base] / workers[key]
+            }
+        }
+    }' "$runs" > "$out/summary.csv"
+
+# The same summary as JSON
+awk -F, '
+    NR == 1 {
+        for (i = 1; i <= NF; i++) {
+            field[i] = $i
+        }
+        printf "{\n  \"config\": \"%s/config.txt\",\n  \"runs\": \"%s/runs.csv\",\n  \"summary\": [", dir, dir
+        next
+    }
+    {
+        printf "%s\n    {", (NR > 2 ? "," : "")
+        for (i = 1; i <= NF; i++) {
+            value = $i
+            if (value == "") {
+                value = "null"
+            } else if (field[i] == "backend" || field[i] == "cache") {
+                value = "\"" value "\""
+            } else {
+                value = value + 0
+            }
+            printf "%s\"%s\": %s", (i > 1 ? ", " : ""), field[i], value
+        }
+        printf "}"
+    }
+    END { printf "\n  ]\n}\n" }' dir="$out" "$out/summary.csv" > "$out/summary.json"
+
+# And as a table, "!" marking combinations with failed runs
+awk -F, '
+    function cell(v) { return v == "" ? "-" : v }
+    NR == 1 {
+        printf "%-9s %9s %5s %6s %7s %5s %12s %10s %12s %11s %8s %10s\n", "backend", "lines", "cache", "count", "workers",
+               "runs", "median_us", "stddev_us", "compute_us", "peak_kb", "speedup", "efficiency"
+        next
+    }
+    {
+        printf "%-9s %9s %5s %6s %7s %5s %12s %10s %12s %11s %8s %10s\n", $1, $2, $3, $4, $5, $6 ($7 > 0 ? "!" : ""),
+               cell($8), cell($9), cell($11), cell($12), cell($13), cell($14)
+    }' "$out/summary.csv" | tee "$out/summary.txt"
+echo "Results are in $out (runs.csv, summary.csv, summary.json, summary.txt, raw/)" >&2
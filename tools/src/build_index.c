@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "line_index.h"
+#include "line_store.h"
+
+/*
+ * main 
+ * Entry point of the program: writes a sidecar file with the offset of
+ * every line of the input, which the programs load with --index instead of
+ * scanning the input for newlines
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return int Exit status
+ */
+int main(int argc, char *argv[]) 
+{
+    if (argc < 2) {
+        printf("Usage: %s <filename> [<index_file>] [--whole]\n"
+               "  Writes <index_file> (default <filename>%s) for the programs' --index option.\n"
+               "  --whole  Keep lines whole, for runs with --long-lines (default: cut lines after 2999 bytes)\n",
+               argv[0], LINE_INDEX_SUFFIX);
+        exit(1);
+    }
+
+    const char *filename = argv[1];
+    const char *index_path = NULL;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--whole") == 0) {
+            line_store_set_max_length(0);
+        } else if (!index_path) {
+            index_path = argv[i];
+        } else {
+            fprintf(stderr, "ERROR: Unknown option '%s'.\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    char *default_path = NULL;
+    if (!index_path) {
+        default_path = (char *)malloc(strlen(filename) + sizeof(LINE_INDEX_SUFFIX));
+        if (!default_path) {
+            fprintf(stderr, "Memory allocation failed for the index filename.\n");
+            exit(1);
+        }
+        strcpy(default_path, filename);
+        strcat(default_path, LINE_INDEX_SUFFIX);
+        index_path = default_path;
+    }
+
+    if (line_index_build(filename, index_path) != 0) {
+        fprintf(stderr, "ERROR: Could not index %s into %s.\n", filename, index_path);
+        exit(1);
+    }
+
+    line_index_t index;
+    if (line_index_open(&index, index_path, filename) != 0) {
+        exit(1);
+    }
+    printf("Indexed %d lines of %s into %s\n", index.num_lines, filename, index_path);
+    line_index_close(&index);
+    free(default_path);
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include "results_file.h"
+#include "output.h"
+
+#define PRINT_BATCH 65536 // Lines decoded and formatted per write
+
+/*
+ * print_range
+ * Prints lines [first, first + count) in the programs' text format
+ * @param file Pointer to the open results file
+ * @param first First line
+ * @param count Number of lines
+ * @return int 0 on success, -1 on failure
+ */
+int print_range(const results_file_t* file, uint64_t first, uint64_t count)
+{
+    int* values = (int *)malloc(PRINT_BATCH * sizeof(int));
+    char* text = (char *)malloc(PRINT_BATCH * RESULT_LINE_MAX);
+    if (!values || !text) {
+        free(values);
+        free(text);
+        return -1;
+    }
+
+    int status = 0;
+    for (uint64_t done = 0; done < count && status == 0; ) {
+        int batch = count - done < PRINT_BATCH ? (int)(count - done) : PRINT_BATCH;
+        results_file_range(file, first + done, (uint64_t)batch, values);
+        struct iovec iov = { text, results_format(text, values, (int)(first + done), batch) };
+        status = results_write(STDOUT_FILENO, &iov, 1);
+        done += (uint64_t)batch;
+    }
+
+    free(values);
+    free(text);
+    return status;
+}
+
+/*
+ * main 
+ * Entry point of the program: maps a binary results file and answers
+ * point and range lookups without reading the whole file
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @return int Exit status
+ */
+int main(int argc, char *argv[]) 
+{
+    if (argc < 3) {
+        printf("Usage: %s <results_file> info\n"
+               "       %s <results_file> get <line>\n"
+               "       %s <results_file> range <first> <count>\n"
+               "       %s <results_file> dump\n", argv[0], argv[0], argv[0], argv[0]);
+        exit(1);
+    }
+
+    results_file_t file;
+    if (results_file_open(&file, argv[1]) != 0) {
+        fprintf(stderr, "ERROR: %s is not a readable results file.\n", argv[1]);
+        exit(1);
+    }
+    uint64_t count = file.header->count;
+
+    int status = 0;
+    if (strcmp(argv[2], "info") == 0) {
+        printf("Lines: %llu\n", (unsigned long long)count);
+        printf("Value width: %u bytes\n", file.header->width);
+        printf("Encoding: %s\n", (file.header->flags & RESULTS_RLE) ? "run-length" : "plain");
+        if (file.header->flags & RESULTS_RLE) {
+            printf("Runs: %llu\n", (unsigned long long)file.header->num_runs);
+        }
+        printf("File size: %zu bytes\n", file.size);
+    } else if (strcmp(argv[2], "get") == 0 && argc == 4) {
+        uint64_t line = strtoull(argv[3], NULL, 10);
+        if (line >= count) {
+            fprintf(stderr, "ERROR: Line %llu is past the last line (%llu lines).\n", (unsigned long long)line, (unsigned long long)count);
+            status = 1;
+        } else {
+            printf("%llu: %d\n", (unsigned long long)line, results_file_get(&file, line));
+        }
+    } else if (strcmp(argv[2], "range") == 0 && argc == 5) {
+        uint64_t first = strtoull(argv[3], NULL, 10);
+        uint64_t length = strtoull(argv[4], NULL, 10);
+        if (first > count) {
+            first = count;
+        }
+        if (length > count - first) {
+            length = count - first; // Clip the range to the file
+        }
+        status = print_range(&file, first, length) != 0;
+    } else if (strcmp(argv[2], "dump") == 0) {
+        status = print_range(&file, 0, count) != 0;
+    } else {
+        fprintf(stderr, "ERROR: Unknown command '%s'.\n", argv[2]);
+        status = 1;
+    }
+
+    results_file_close(&file);
+    return status;
+}